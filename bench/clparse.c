@@ -0,0 +1,148 @@
+// Parses 10^6 synthetic pdfutils job lines with one reused Clparse context
+// and prints the time per line. Each line gives a random subset of its
+// subcommand's flags in random order, mixing long and short names, so the
+// flag lookup rather than the schema dominates.
+//
+//     ./nob clparse-bench
+
+#define CLPARSE_IMPLEMENTATION
+#define NO_USE_WIDE_ARGV
+#include "../src/clparse.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define LINES 1000000
+#define SHAPES 4096 // distinct lines, cycled through
+#define MAX_TOKENS 64
+
+typedef struct {
+    const char* name;
+    char short_name;
+    const char* value; // NULL for a bool flag
+} BenchFlag;
+
+typedef struct {
+    const char* name;
+    const char* main_args[2];
+    BenchFlag flags[20];
+    size_t flags_len;
+} BenchSubcmd;
+
+static const BenchSubcmd subcmds[] = {
+    { "subpdf", { "in.pdf", "3-5,8" }, {
+        { "output", 'o', "out.pdf" }, { "sparse", 's', NULL },
+    }, 2 },
+    { "render", { "in.pdf", "1-20" }, {
+        { "format", NO_SHORT, "png" }, { "colorspace", NO_SHORT, "gray" },
+        { "dpi", 'r', "150" }, { "aa", NO_SHORT, "4" },
+        { "no-icc", NO_SHORT, NULL }, { "no-annots", NO_SHORT, NULL },
+        { "luma", NO_SHORT, NULL }, { "levels", NO_SHORT, "8" },
+        { "gamma", NO_SHORT, "2.2" }, { "threshold", NO_SHORT, "100" },
+        { "png-level", NO_SHORT, "6" }, { "png-filter", NO_SHORT, "paeth" },
+        { "jobs", 'j', "4" }, { "vision", NO_SHORT, NULL },
+        { "bench", NO_SHORT, NULL }, { "output", 'o', "out/" },
+    }, 16 },
+    { "text", { "in.pdf", "1-100" }, {
+        { "jobs", 'j', "8" }, { "output", 'o', "out.txt" },
+    }, 2 },
+};
+#define SUBCMDS_LEN (sizeof(subcmds) / sizeof(subcmds[0]))
+
+static uint64_t rng_state = 0x9e3779b97f4a7c15ull;
+
+static uint32_t nextRandom(void) {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return (uint32_t)(rng_state >> 32);
+}
+
+static void declare(Clparse* cp) {
+    for (size_t s = 0; s < SUBCMDS_LEN; ++s) {
+        const BenchSubcmd* sub = &subcmds[s];
+        clparseCtxSubcmd(cp, sub->name, "");
+        clparseCtxMainArg(cp, "IN_PATH", "", sub->name);
+        clparseCtxMainArg(cp, "RANGE", "", sub->name);
+        for (size_t f = 0; f < sub->flags_len; ++f) {
+            const BenchFlag* flag = &sub->flags[f];
+            if (!flag->value) clparseCtxBool(cp, flag->name, flag->short_name, false, "", sub->name);
+            else clparseCtxStr(cp, flag->name, flag->short_name, "", "", sub->name);
+        }
+    }
+}
+
+// argv for one random job line; names point into a per-shape buffer
+static int makeLine(const char** argv, char* names, size_t names_cap) {
+    const BenchSubcmd* sub = &subcmds[nextRandom() % SUBCMDS_LEN];
+    size_t order[20];
+    int argc = 0;
+
+    argv[argc++] = "pdfutils";
+    argv[argc++] = sub->name;
+    argv[argc++] = sub->main_args[0];
+    argv[argc++] = sub->main_args[1];
+
+    for (size_t f = 0; f < sub->flags_len; ++f) order[f] = f;
+    for (size_t f = sub->flags_len; f > 1; --f) {
+        size_t k = nextRandom() % f;
+        size_t tmp = order[f - 1];
+        order[f - 1] = order[k];
+        order[k] = tmp;
+    }
+
+    size_t used = 0;
+    for (size_t f = 0; f < sub->flags_len; ++f) {
+        const BenchFlag* flag = &sub->flags[order[f]];
+        if (nextRandom() % 4 == 0) continue;
+
+        bool use_short = flag->short_name != NO_SHORT && nextRandom() % 2;
+        int n = use_short ? snprintf(names + used, names_cap - used, "-%c", flag->short_name)
+                          : snprintf(names + used, names_cap - used, "--%s", flag->name);
+        argv[argc++] = names + used;
+        used += (size_t)n + 1;
+        if (flag->value) argv[argc++] = flag->value;
+    }
+    return argc;
+}
+
+static double seconds(void) {
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+int main(void) {
+    static const char* argvs[SHAPES][MAX_TOKENS];
+    static char names[SHAPES][512];
+    static int argcs[SHAPES];
+
+    for (size_t i = 0; i < SHAPES; ++i) {
+        argcs[i] = makeLine(argvs[i], names[i], sizeof(names[i]));
+    }
+
+    Clparse* cp = clparseNew("pdfutils", "clparse benchmark");
+    if (!cp) {
+        fprintf(stderr, "ERROR: out of memory\n");
+        return 1;
+    }
+    declare(cp);
+
+    size_t failed = 0;
+    double start = seconds();
+    for (size_t i = 0; i < LINES; ++i) {
+        size_t shape = i % SHAPES;
+        if (!clparseCtxParse(cp, argcs[shape], (cchar**)argvs[shape])) ++failed;
+    }
+    double elapsed = seconds() - start;
+
+    clparseFree(cp);
+
+    if (failed) {
+        fprintf(stderr, "ERROR: %zu of %d lines failed to parse\n", failed, LINES);
+        return 1;
+    }
+    printf("%d lines in %.3f s, %.1f ns/line\n", LINES, elapsed, elapsed * 1e9 / LINES);
+    return 0;
+}
@@ -7,28 +7,410 @@
 #define SRC_DIR "src/"
 #ifdef _WIN32
 #define PROG_NAME "pdfutils.exe"
+#define LIB_OBJ "pdfutils.o"
+#define STATIC_LIB_NAME "pdfutils_static.lib"
+#define SHARED_LIB_NAME "pdfutils.dll" // clang also writes the import lib pdfutils.lib
 #else
 #define PROG_NAME "pdfutils"
+#define BUILD_DIR "build/"
+#define LIB_OBJ BUILD_DIR"pdfutils.o"
+#define STATIC_LIB_NAME "libpdfutils.a"
+#define SHARED_LIB_NAME "libpdfutils.so"
 #endif
 
-int main(int argc, char** argv) {
-    NOB_GO_REBUILD_URSELF(argc, argv);
+#ifdef _WIN32
+#define CLPARSE_BENCH "clparse-bench.exe"
+#else
+#define CLPARSE_BENCH BUILD_DIR"clparse-bench"
+#endif
+
+// ./nob [--o3] [--no-lto] [pgo] [bench] [clparse-bench]
+typedef struct {
+    bool o3;
+    bool no_lto;
+    bool pgo;   // profile the CLI on the training workload and rebuild it
+    bool bench; // time the training workload against a plain -O2 build
+    bool clparse_bench; // only build and run bench/clparse.c; needs no MuPDF
+} Options;
 
-    Cmd cmd = {0};
 #ifdef _WIN32
 #ifndef USE_CLANG_INSTEAD
 #error "`cefer.h` does not support for msvc"
 #else
-    cmd_append(&cmd, "clang", "-std=c11");
-    cmd_append(&cmd, "-Wall", "-Wextra", "-Wpedantic", "-Wno-unused-parameter");
-    cmd_append(&cmd, SRC_DIR"main.c");
-    cmd_append(&cmd, "-o", PROG_NAME);
-    cmd_append(&cmd, "-I", "C:/Users/almag/.local/mupdf/include");
-    cmd_append(&cmd, "-L", "C:/Users/almag/.local/mupdf/platform/win32/x64/Release");
-    cmd_append(&cmd, "-llibmupdf", "-llibthirdparty", "-lmsvcrt");
+static void appendCompiler(Cmd* cmd) {
+    cmd_append(cmd, "clang", "-std=c11");
+    cmd_append(cmd, "-Wall", "-Wextra", "-Wpedantic", "-Wno-unused-parameter");
+    cmd_append(cmd, "-I", "C:/Users/almag/.local/mupdf/include");
+}
+
+static void appendMupdf(Cmd* cmd) {
+    cmd_append(cmd, "-L", "C:/Users/almag/.local/mupdf/platform/win32/x64/Release");
+    cmd_append(cmd, "-llibmupdf", "-llibthirdparty", "-lmsvcrt");
+}
+#endif
+
+// The CLI and libpdfutils are built from the same sources: the subpdf
+// logic lives in subpdf.h, included by main.c and pdfutils.c alike.
+static bool buildCli(Cmd* cmd) {
+    appendCompiler(cmd);
+    cmd_append(cmd, SRC_DIR"main.c");
+    cmd_append(cmd, "-o", PROG_NAME);
+    appendMupdf(cmd);
+    return cmd_run(cmd);
+}
+
+// links against nothing; users add MuPDF themselves
+static bool buildStaticLib(Cmd* cmd) {
+    appendCompiler(cmd);
+    cmd_append(cmd, "-c", SRC_DIR"pdfutils.c");
+    cmd_append(cmd, "-o", LIB_OBJ);
+    if (!cmd_run(cmd)) return false;
+
+    cmd_append(cmd, "llvm-ar", "rcs", STATIC_LIB_NAME, LIB_OBJ);
+    return cmd_run(cmd);
+}
+
+static bool buildSharedLib(Cmd* cmd) {
+    appendCompiler(cmd);
+    cmd_append(cmd, "-shared", "-DPDFUTILS_SHARED");
+    cmd_append(cmd, SRC_DIR"pdfutils.c");
+    cmd_append(cmd, "-o", SHARED_LIB_NAME);
+    appendMupdf(cmd);
+    return cmd_run(cmd);
+}
+
+static bool build(const Options* opts) {
+    if (opts->pgo || opts->bench || opts->o3 || opts->no_lto)
+        nob_log(WARNING, "optimization options are only implemented on Linux");
+
+    Cmd cmd = {0};
+    bool ok = buildCli(&cmd) && buildStaticLib(&cmd) && buildSharedLib(&cmd);
+    cmd_free(cmd);
+    return ok;
+}
+#else
+#define CORPUS_DIR BUILD_DIR"corpus/"
+#define PGO_DIR BUILD_DIR"pgo/"
+#define PROFDATA PGO_DIR"pdfutils.profdata"
+#define INSTR_PROG BUILD_DIR"pdfutils-instr"
+#define BASE_PROG BUILD_DIR"pdfutils-base"
+
+typedef enum {
+    PROFILE_NONE,
+    PROFILE_GENERATE,
+    PROFILE_USE,
+} Profile;
+
+// split output of `pkg-config ARG mupdf`
+static Cmd mupdf_cflags = {0};
+static Cmd mupdf_libs = {0};
+
+static bool pkgConfig(const char* arg, Cmd* out) {
+    const char* path = temp_sprintf(BUILD_DIR"mupdf%s.txt", arg + 1);
+    Cmd cmd = {0};
+    cmd_append(&cmd, "pkg-config", arg, "mupdf");
+    bool ok = cmd_run(&cmd, .stdout_path = path);
+    cmd_free(cmd);
+    if (!ok) {
+        nob_log(ERROR, "pkg-config cannot find mupdf; set PKG_CONFIG_PATH to its mupdf.pc");
+        return false;
+    }
+
+    String_Builder sb = {0};
+    if (!read_entire_file(path, &sb)) return false;
+    String_View sv = sv_from_parts(sb.items, sb.count);
+    while ((sv = sv_trim(sv)).count > 0) {
+        String_View tok = sv_trim(sv_chop_by_delim(&sv, ' '));
+        if (tok.count > 0) cmd_append(out, strndup(tok.data, tok.count));
+    }
+    sb_free(sb);
+    return true;
+}
+
+static void appendCompiler(Cmd* cmd, const Options* opts, bool lto, Profile profile) {
+    cmd_append(cmd, "clang", "-std=c11");
+    cmd_append(cmd, "-Wall", "-Wextra", "-Wpedantic", "-Wno-unused-parameter");
+    cmd_append(cmd, opts->o3 ? "-O3" : "-O2");
+    if (lto) cmd_append(cmd, "-flto", "-fuse-ld=lld");
+
+    switch (profile) {
+    case PROFILE_NONE:
+        break;
+    case PROFILE_GENERATE:
+        cmd_append(cmd, "-fprofile-generate="PGO_DIR);
+        break;
+    case PROFILE_USE:
+        // the training workload only runs subpdf, so most functions have no counts
+        cmd_append(cmd, "-fprofile-use="PROFDATA, "-Wno-profile-instr-unprofiled");
+        break;
+    }
+    da_append_many(cmd, mupdf_cflags.items, mupdf_cflags.count);
+}
+
+static bool buildCli(Cmd* cmd, const Options* opts, const char* out, bool lto, Profile profile) {
+    appendCompiler(cmd, opts, lto, profile);
+    cmd_append(cmd, SRC_DIR"main.c");
+    cmd_append(cmd, "-o", out);
+    da_append_many(cmd, mupdf_libs.items, mupdf_libs.count);
+    cmd_append(cmd, "-lpthread", "-lm");
+    return cmd_run(cmd);
+}
+
+// Plain objects without LTO, so any linker can consume the archive. Users
+// add MuPDF themselves.
+static bool buildStaticLib(Cmd* cmd, const Options* opts) {
+    appendCompiler(cmd, opts, false, PROFILE_NONE);
+    cmd_append(cmd, "-c", SRC_DIR"pdfutils.c");
+    cmd_append(cmd, "-o", LIB_OBJ);
+    if (!cmd_run(cmd)) return false;
+
+    cmd_append(cmd, "ar", "rcs", STATIC_LIB_NAME, LIB_OBJ);
+    return cmd_run(cmd);
+}
+
+static bool buildSharedLib(Cmd* cmd, const Options* opts) {
+    appendCompiler(cmd, opts, !opts->no_lto, PROFILE_NONE);
+    cmd_append(cmd, "-shared", "-fPIC", "-fvisibility=hidden", "-DPDFUTILS_SHARED");
+    cmd_append(cmd, SRC_DIR"pdfutils.c");
+    cmd_append(cmd, "-o", SHARED_LIB_NAME);
+    da_append_many(cmd, mupdf_libs.items, mupdf_libs.count);
+    return cmd_run(cmd);
+}
+
+/*********************/
+/* Training workload */
+/*********************/
+// Synthetic PDFs, so the workload needs no checked-in corpus. Pages hang
+// off the root in groups of 50 and inherit MediaBox and Resources, which
+// exercises both the page-tree descent and the inheritance in subpdf.h.
+static bool writeSamplePdf(const char* path, int pages) {
+    int groups = (pages + 49) / 50;
+    int first_page = 4 + groups;
+    int n_objs = first_page + 2 * pages;
+
+    FILE* f = fopen(path, "wb");
+    if (!f) {
+        nob_log(ERROR, "cannot write %s", path);
+        return false;
+    }
+    long* ofs = malloc(sizeof(long) * n_objs);
+    if (!ofs) {
+        fclose(f);
+        return false;
+    }
+
+    fprintf(f, "%%PDF-1.4\n");
+    ofs[1] = ftell(f);
+    fprintf(f, "1 0 obj\n<< /Type /Catalog /Pages 2 0 R >>\nendobj\n");
+
+    ofs[2] = ftell(f);
+    fprintf(f, "2 0 obj\n<< /Type /Pages /Count %d /MediaBox [0 0 612 792]"
+               " /Resources << /Font << /F1 3 0 R >> >> /Kids [", pages);
+    for (int g = 0; g < groups; ++g) fprintf(f, " %d 0 R", 4 + g);
+    fprintf(f, " ] >>\nendobj\n");
+
+    ofs[3] = ftell(f);
+    fprintf(f, "3 0 obj\n<< /Type /Font /Subtype /Type1 /BaseFont /Helvetica >>\nendobj\n");
+
+    for (int g = 0; g < groups; ++g) {
+        int count = pages - 50 * g < 50 ? pages - 50 * g : 50;
+        ofs[4 + g] = ftell(f);
+        fprintf(f, "%d 0 obj\n<< /Type /Pages /Parent 2 0 R /Count %d /Kids [", 4 + g, count);
+        for (int i = 0; i < count; ++i) fprintf(f, " %d 0 R", first_page + 2 * (50 * g + i));
+        fprintf(f, " ] >>\nendobj\n");
+    }
+
+    char content[4096];
+    for (int i = 0; i < pages; ++i) {
+        int num = first_page + 2 * i;
+        int len = snprintf(content, sizeof(content), "BT /F1 24 Tf 72 720 Td (Page %d) Tj ET\n", i + 1);
+        for (int line = 0; line < 40; ++line) {
+            len += snprintf(content + len, sizeof(content) - len,
+                            "BT /F1 10 Tf 72 %d Td (line %d of page %d) Tj ET\n",
+                            680 - 15 * line, line + 1, i + 1);
+        }
+
+        ofs[num] = ftell(f);
+        fprintf(f, "%d 0 obj\n<< /Type /Page /Parent %d 0 R /Contents %d 0 R >>\nendobj\n",
+                num, 4 + i / 50, num + 1);
+        ofs[num + 1] = ftell(f);
+        fprintf(f, "%d 0 obj\n<< /Length %d >>\nstream\n%sendstream\nendobj\n", num + 1, len, content);
+    }
+
+    long xref = ftell(f);
+    fprintf(f, "xref\n0 %d\n0000000000 65535 f \n", n_objs);
+    for (int i = 1; i < n_objs; ++i) fprintf(f, "%010ld 00000 n \n", ofs[i]);
+    fprintf(f, "trailer\n<< /Size %d /Root 1 0 R >>\nstartxref\n%ld\n%%%%EOF\n", n_objs, xref);
+
+    free(ofs);
+    bool ok = !ferror(f);
+    fclose(f);
+    return ok;
+}
+
+static const struct {
+    const char* name;
+    int pages;
+    const char* ranges[3]; // one page, a slice, everything
+} corpus[] = {
+    { "small.pdf",  4,    { "1",    "2-3",     "1-4"    } },
+    { "medium.pdf", 200,  { "1",    "50-149",  "1-200"  } },
+    { "large.pdf",  2000, { "1000", "1-500",   "1-2000" } },
+};
+#define CORPUS_LEN (sizeof(corpus) / sizeof(corpus[0]))
+
+static bool writeCorpus(void) {
+    if (!mkdir_if_not_exists(CORPUS_DIR)) return false;
+    for (size_t i = 0; i < CORPUS_LEN; ++i) {
+        const char* path = temp_sprintf(CORPUS_DIR"%s", corpus[i].name);
+        if (file_exists(path) == 1) continue;
+        if (!writeSamplePdf(path, corpus[i].pages)) return false;
+    }
+    return true;
+}
+
+// every corpus range, with and without --sparse
+static bool runTraining(const char* prog, double* secs) {
+    Cmd cmd = {0};
+    uint64_t start = nanos_since_unspecified_epoch();
+    bool ok = true;
+
+    for (size_t i = 0; ok && i < CORPUS_LEN; ++i)
+    for (size_t r = 0; ok && r < 3; ++r)
+    for (int sparse = 0; ok && sparse <= 1; ++sparse) {
+        cmd_append(&cmd, prog, "subpdf", temp_sprintf(CORPUS_DIR"%s", corpus[i].name),
+                   corpus[i].ranges[r], "-o", CORPUS_DIR"out.pdf");
+        if (sparse) cmd_append(&cmd, "--sparse");
+        ok = cmd_run(&cmd, .stdout_path = "/dev/null");
+    }
+
+    cmd_free(cmd);
+    *secs = (double)(nanos_since_unspecified_epoch() - start) / NOB_NANOS_PER_SEC;
+    return ok;
+}
+
+// profraw files from earlier runs would be merged into the new profile
+static bool clearProfiles(void) {
+    File_Paths names = {0};
+    if (!mkdir_if_not_exists(PGO_DIR)) return false;
+    if (!read_entire_dir(PGO_DIR, &names)) return false;
+
+    bool ok = true;
+    for (size_t i = 0; ok && i < names.count; ++i) {
+        if (sv_end_with(sv_from_cstr(names.items[i]), ".profraw"))
+            ok = delete_file(temp_sprintf(PGO_DIR"%s", names.items[i]));
+    }
+    da_free(names);
+    return ok;
+}
+
+static bool mergeProfiles(Cmd* cmd) {
+    File_Paths names = {0};
+    if (!read_entire_dir(PGO_DIR, &names)) return false;
+
+    cmd_append(cmd, "llvm-profdata", "merge", "-o", PROFDATA);
+    size_t inputs = 0;
+    for (size_t i = 0; i < names.count; ++i) {
+        if (!sv_end_with(sv_from_cstr(names.items[i]), ".profraw")) continue;
+        cmd_append(cmd, temp_sprintf(PGO_DIR"%s", names.items[i]));
+        ++inputs;
+    }
+    da_free(names);
+
+    if (inputs == 0) {
+        nob_log(ERROR, "the training run wrote no profile");
+        cmd->count = 0;
+        return false;
+    }
+    return cmd_run(cmd);
+}
+
+// instrumented build, training run, merged profile
+static bool trainProfile(Cmd* cmd, const Options* opts) {
+    double secs;
+    if (!clearProfiles()) return false;
+    if (!buildCli(cmd, opts, INSTR_PROG, false, PROFILE_GENERATE)) return false;
+    nob_log(INFO, "training %s", INSTR_PROG);
+    if (!runTraining(INSTR_PROG, &secs)) return false;
+    return mergeProfiles(cmd);
+}
+
+static bool benchAgainstBase(Cmd* cmd) {
+    static const int rounds = 5;
+    double base = 0, opt = 0;
+
+    if (!buildCli(cmd, &(Options){0}, BASE_PROG, false, PROFILE_NONE)) return false;
+    // one untimed pass each warms the page cache
+    if (!runTraining(BASE_PROG, &base) || !runTraining("./"PROG_NAME, &opt)) return false;
+
+    double base_total = 0, opt_total = 0;
+    for (int i = 0; i < rounds; ++i) {
+        if (!runTraining(BASE_PROG, &base) || !runTraining("./"PROG_NAME, &opt)) return false;
+        base_total += base;
+        opt_total += opt;
+    }
+    nob_log(INFO, "training workload, mean of %d rounds:", rounds);
+    nob_log(INFO, "  -O2 baseline  %8.3f s", base_total / rounds);
+    nob_log(INFO, "  %-13s %8.3f s (%.2fx)", PROG_NAME, opt_total / rounds,
+            opt_total > 0 ? base_total / opt_total : 0.0);
+    return true;
+}
+
+static bool build(const Options* opts) {
+    Cmd cmd = {0};
+    bool lto = !opts->no_lto;
+    bool ok = mkdir_if_not_exists(BUILD_DIR) &&
+              pkgConfig("--cflags", &mupdf_cflags) && pkgConfig("--libs", &mupdf_libs);
+
+    if (ok && (opts->pgo || opts->bench)) ok = writeCorpus();
+    if (ok && opts->pgo) ok = trainProfile(&cmd, opts);
+    if (ok) ok = buildCli(&cmd, opts, PROG_NAME, lto, opts->pgo ? PROFILE_USE : PROFILE_NONE);
+    if (ok) ok = buildStaticLib(&cmd, opts) && buildSharedLib(&cmd, opts);
+    if (ok && opts->bench) ok = benchAgainstBase(&cmd);
+
+    cmd_free(cmd);
+    return ok;
+}
 #endif
+
+static bool runClparseBench(void) {
+    Cmd cmd = {0};
+#ifndef _WIN32
+    if (!mkdir_if_not_exists(BUILD_DIR)) return false;
 #endif
-    if (!cmd_run(&cmd)) return 1;
+    cmd_append(&cmd, "clang", "-std=c11", "-O2");
+    cmd_append(&cmd, "-Wall", "-Wextra", "-Wpedantic", "-Wno-unused-parameter");
+    cmd_append(&cmd, "bench/clparse.c", "-o", CLPARSE_BENCH);
+    bool ok = cmd_run(&cmd);
+    if (ok) {
+        cmd_append(&cmd, CLPARSE_BENCH);
+        ok = cmd_run(&cmd);
+    }
+    cmd_free(cmd);
+    return ok;
+}
+
+int main(int argc, char** argv) {
+    NOB_GO_REBUILD_URSELF(argc, argv);
+
+    Options opts = {0};
+    shift(argv, argc);
+    while (argc > 0) {
+        const char* arg = shift(argv, argc);
+        if (strcmp(arg, "--o3") == 0) opts.o3 = true;
+        else if (strcmp(arg, "--no-lto") == 0) opts.no_lto = true;
+        else if (strcmp(arg, "pgo") == 0) opts.pgo = true;
+        else if (strcmp(arg, "bench") == 0) opts.bench = true;
+        else if (strcmp(arg, "clparse-bench") == 0) opts.clparse_bench = true;
+        else {
+            nob_log(ERROR, "unknown argument `%s`", arg);
+            nob_log(INFO, "usage: ./nob [--o3] [--no-lto] [pgo] [bench] [clparse-bench]");
+            return 1;
+        }
+    }
+
+    if (opts.clparse_bench) return runClparseBench() ? 0 : 1;
+    if (!build(&opts)) return 1;
 
     return 0;
 }
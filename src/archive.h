@@ -0,0 +1,240 @@
+#ifndef _ARCHIVE
+#define _ARCHIVE
+
+// Streamed tar and zip writers over an fz_output, for many small entries
+// without a file per entry. Nothing is seeked, so the output may be a pipe.
+// Each entry is an fz_output whose tell() counts from the entry's start, as
+// the PDF writer needs for its xref. A zip entry goes straight through,
+// stored, with its CRC and sizes in a data descriptor after it; a tar header
+// must carry the size, so a tar entry is held in memory until it ends.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <mupdf/fitz.h>
+
+// CRC-32 and little-endian stores, shared with the PNG encoder
+#include "imgenc.h"
+
+typedef enum {
+    ARCHIVE_TAR,
+    ARCHIVE_ZIP,
+} ArchiveKind;
+
+// what the zip central directory repeats about an entry
+typedef struct {
+    char* name;
+    uint32_t crc;
+    uint32_t size;
+    uint32_t offset;
+} ArchiveEntry;
+
+typedef struct {
+    fz_output* out;
+    ArchiveKind kind;
+    uint64_t pos; // bytes written to out
+    uint32_t mtime;
+    uint16_t dos_time;
+    uint16_t dos_date;
+    ArchiveEntry* entries;
+    size_t len;
+    size_t cap;
+
+    // the open entry
+    fz_output* entry;
+    fz_buffer* buf; // tar only
+    char tar_name[101];
+    uint64_t entry_len;
+    uint32_t crc;
+} Archive;
+
+static void archiveWrite(fz_context* ctx, Archive* ar, const void* data, size_t n) {
+    fz_write_data(ctx, ar->out, data, n);
+    ar->pos += n;
+}
+
+static void archiveEntryWrite(fz_context* ctx, void* state, const void* data, size_t n) {
+    Archive* ar = state;
+    if (ar->kind == ARCHIVE_ZIP) {
+        ar->crc = imgencCrc(ar->crc, data, n);
+        archiveWrite(ctx, ar, data, n);
+    } else {
+        fz_append_data(ctx, ar->buf, data, n);
+    }
+    ar->entry_len += n;
+}
+
+static int64_t archiveEntryTell(fz_context* ctx, void* state) {
+    return (int64_t)((Archive*)state)->entry_len;
+}
+
+static void archiveInit(fz_context* ctx, Archive* ar, fz_output* out, ArchiveKind kind) {
+    memset(ar, 0, sizeof(*ar));
+    ar->out = out;
+    ar->kind = kind;
+
+    time_t now = time(NULL);
+    ar->mtime = (uint32_t)now;
+    struct tm* tm = localtime(&now);
+    if (tm && tm->tm_year >= 80) {
+        ar->dos_time = (uint16_t)(tm->tm_hour << 11 | tm->tm_min << 5 | tm->tm_sec / 2);
+        ar->dos_date = (uint16_t)((tm->tm_year - 80) << 9 | (tm->tm_mon + 1) << 5 | tm->tm_mday);
+    }
+}
+
+static void archiveZipHeader(fz_context* ctx, Archive* ar, const char* name) {
+    size_t name_len = strlen(name);
+    if (ar->pos > UINT32_MAX || ar->len >= UINT16_MAX || name_len > UINT16_MAX)
+        fz_throw(ctx, FZ_ERROR_GENERIC, "zip archive over 4 GiB or 65535 entries, use tar");
+
+    if (ar->len == ar->cap) {
+        size_t cap = ar->cap ? 2 * ar->cap : 256;
+        ArchiveEntry* entries = realloc(ar->entries, cap * sizeof(ArchiveEntry));
+        if (!entries) fz_throw(ctx, FZ_ERROR_GENERIC, "out of memory");
+        ar->entries = entries;
+        ar->cap = cap;
+    }
+    char* copy = malloc(name_len + 1);
+    if (!copy) fz_throw(ctx, FZ_ERROR_GENERIC, "out of memory");
+    memcpy(copy, name, name_len + 1);
+    ar->entries[ar->len++] = (ArchiveEntry){ .name = copy, .offset = (uint32_t)ar->pos };
+
+    // sizes and CRC are left zero; flag bit 3 says they follow the data
+    unsigned char h[30] = {0};
+    imgencPut32le(h, 0x04034b50);
+    imgencPut16le(h + 4, 20);
+    imgencPut16le(h + 6, 0x0008);
+    imgencPut16le(h + 10, ar->dos_time);
+    imgencPut16le(h + 12, ar->dos_date);
+    imgencPut16le(h + 26, (uint16_t)name_len);
+    archiveWrite(ctx, ar, h, sizeof(h));
+    archiveWrite(ctx, ar, name, name_len);
+}
+
+// Starts an entry and returns the output to write it to, which stays owned
+// by the archive and is valid until archiveEnd.
+static fz_output* archiveBegin(fz_context* ctx, Archive* ar, const char* name) {
+    ar->entry_len = 0;
+    ar->crc = 0;
+    if (ar->kind == ARCHIVE_ZIP) {
+        archiveZipHeader(ctx, ar, name);
+    } else {
+        if (strlen(name) >= sizeof(ar->tar_name))
+            fz_throw(ctx, FZ_ERROR_GENERIC, "tar entry name too long: %s", name);
+        // the header goes out at archiveEnd, once the size is known
+        strcpy(ar->tar_name, name);
+        ar->buf = fz_new_buffer(ctx, 64 << 10);
+    }
+
+    ar->entry = fz_new_output(ctx, 64 << 10, ar, archiveEntryWrite, NULL, NULL);
+    ar->entry->tell = archiveEntryTell;
+    return ar->entry;
+}
+
+static void archiveTarEntry(fz_context* ctx, Archive* ar) {
+    unsigned char* data;
+    size_t size = fz_buffer_storage(ctx, ar->buf, &data);
+    if (size > 077777777777) fz_throw(ctx, FZ_ERROR_GENERIC, "tar entry over 8 GiB");
+
+    // ustar: numbers in octal, the checksum computed over spaces in its field
+    unsigned char h[512] = {0};
+    memcpy(h, ar->tar_name, strlen(ar->tar_name));
+    memcpy(h + 100, "0000644", 7);
+    memcpy(h + 108, "0000000", 7);
+    memcpy(h + 116, "0000000", 7);
+    snprintf((char*)h + 124, 12, "%011llo", (unsigned long long)size);
+    snprintf((char*)h + 136, 12, "%011lo", (unsigned long)ar->mtime);
+    memset(h + 148, ' ', 8);
+    h[156] = '0';
+    memcpy(h + 257, "ustar", 6);
+    memcpy(h + 263, "00", 2);
+    unsigned sum = 0;
+    for (size_t i = 0; i < sizeof(h); ++i) sum += h[i];
+    snprintf((char*)h + 148, 8, "%06o", sum);
+
+    static const unsigned char zeros[512] = {0};
+    archiveWrite(ctx, ar, h, sizeof(h));
+    archiveWrite(ctx, ar, data, size);
+    if (size % 512) archiveWrite(ctx, ar, zeros, 512 - size % 512);
+}
+
+// Finishes the entry begun last and drops its output.
+static void archiveEnd(fz_context* ctx, Archive* ar) {
+    fz_close_output(ctx, ar->entry);
+    fz_drop_output(ctx, ar->entry);
+    ar->entry = NULL;
+
+    if (ar->kind == ARCHIVE_TAR) {
+        archiveTarEntry(ctx, ar);
+        fz_drop_buffer(ctx, ar->buf);
+        ar->buf = NULL;
+        return;
+    }
+
+    if (ar->entry_len > UINT32_MAX)
+        fz_throw(ctx, FZ_ERROR_GENERIC, "zip entry over 4 GiB, use tar");
+    ArchiveEntry* e = &ar->entries[ar->len - 1];
+    e->crc = ar->crc;
+    e->size = (uint32_t)ar->entry_len;
+
+    unsigned char d[16];
+    imgencPut32le(d, 0x08074b50);
+    imgencPut32le(d + 4, e->crc);
+    imgencPut32le(d + 8, e->size);
+    imgencPut32le(d + 12, e->size);
+    archiveWrite(ctx, ar, d, sizeof(d));
+}
+
+// Writes the zip central directory or the tar end blocks. The caller still
+// closes the output.
+static void archiveFinish(fz_context* ctx, Archive* ar) {
+    if (ar->kind == ARCHIVE_TAR) {
+        static const unsigned char zeros[1024] = {0};
+        archiveWrite(ctx, ar, zeros, sizeof(zeros));
+        return;
+    }
+
+    uint64_t cd_start = ar->pos;
+    for (size_t i = 0; i < ar->len; ++i) {
+        const ArchiveEntry* e = &ar->entries[i];
+        size_t name_len = strlen(e->name);
+        unsigned char h[46] = {0};
+        imgencPut32le(h, 0x02014b50);
+        imgencPut16le(h + 4, 20);
+        imgencPut16le(h + 6, 20);
+        imgencPut16le(h + 8, 0x0008);
+        imgencPut16le(h + 12, ar->dos_time);
+        imgencPut16le(h + 14, ar->dos_date);
+        imgencPut32le(h + 16, e->crc);
+        imgencPut32le(h + 20, e->size);
+        imgencPut32le(h + 24, e->size);
+        imgencPut16le(h + 28, (uint16_t)name_len);
+        imgencPut32le(h + 42, e->offset);
+        archiveWrite(ctx, ar, h, sizeof(h));
+        archiveWrite(ctx, ar, e->name, name_len);
+    }
+    if (ar->pos > UINT32_MAX)
+        fz_throw(ctx, FZ_ERROR_GENERIC, "zip archive over 4 GiB, use tar");
+
+    unsigned char end[22] = {0};
+    imgencPut32le(end, 0x06054b50);
+    imgencPut16le(end + 8, (uint16_t)ar->len);
+    imgencPut16le(end + 10, (uint16_t)ar->len);
+    imgencPut32le(end + 12, (uint32_t)(ar->pos - cd_start));
+    imgencPut32le(end + 16, (uint32_t)cd_start);
+    archiveWrite(ctx, ar, end, sizeof(end));
+}
+
+// frees the entry list and whatever entry is still open; never closes out
+static void archiveDrop(fz_context* ctx, Archive* ar) {
+    fz_drop_output(ctx, ar->entry);
+    fz_drop_buffer(ctx, ar->buf);
+    for (size_t i = 0; i < ar->len; ++i) free(ar->entries[i].name);
+    free(ar->entries);
+    memset(ar, 0, sizeof(*ar));
+}
+
+#endif // _ARCHIVE
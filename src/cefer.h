@@ -1,6 +1,11 @@
 #ifndef _CEFER
 #define _CEFER
 
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
 #if __STDC_VERSION__ < 202311L // on c23, bool is introduced
 #include <stdbool.h>
 #endif
@@ -17,6 +22,121 @@ static inline void _defer_invoke(struct __Defer* d) {
     if (d && d->fn && (!d->cond || (d->cond && *d->cond))) d->fn(d->arg);
 }
 
+/*********/
+/* Arena */
+/*********/
+// A bump allocator for temporaries. DEFER_ARENA(name, bytes) declares one
+// whose first block is `bytes` of stack; past that, blocks come from malloc
+// and all of them are freed when name goes out of scope. Nothing is freed
+// on its own: ceferRewind drops everything allocated since the matching
+// ceferSave, like nob_temp_save and nob_temp_rewind.
+//
+//     DEFER_ARENA(arena, 16 * 1024);
+//     for (...) {
+//         CeferMark mark = ceferSave(&arena);
+//         int* tmp = ceferAlloc(&arena, n * sizeof(int));
+//         ...
+//         ceferRewind(&arena, mark);
+//     }
+//
+// As with DEFER, a longjmp (fz_throw) out of the scope skips the release;
+// keep the arena outside the fz_try it is used in.
+typedef struct CeferBlock {
+    struct CeferBlock* prev;
+    size_t cap; // bytes after the header
+    size_t used;
+    bool heap;
+} CeferBlock;
+
+typedef struct {
+    CeferBlock* top;
+} CeferArena;
+
+typedef struct {
+    CeferBlock* block;
+    size_t used;
+} CeferMark;
+
+#define CEFER_ALIGN _Alignof(max_align_t)
+#define CEFER_ROUND(_n) (((_n) + CEFER_ALIGN - 1) & ~(size_t)(CEFER_ALIGN - 1))
+#define CEFER_HEADER CEFER_ROUND(sizeof(CeferBlock))
+#define CEFER_MIN_BLOCK (64 * 1024)
+
+static inline CeferArena ceferArenaOn(void* buf, size_t size) {
+    CeferArena arena = { NULL };
+    if (size <= CEFER_HEADER) return arena;
+
+    arena.top = buf;
+    arena.top->prev = NULL;
+    arena.top->cap = size - CEFER_HEADER;
+    arena.top->used = 0;
+    arena.top->heap = false;
+    return arena;
+}
+
+// NULL when out of memory
+static inline void* ceferAlloc(CeferArena* arena, size_t size) {
+    size = CEFER_ROUND(size);
+
+    CeferBlock* top = arena->top;
+    if (!top || top->cap - top->used < size) {
+        size_t cap = top && top->cap >= CEFER_MIN_BLOCK / 2 ? 2 * top->cap : CEFER_MIN_BLOCK;
+        if (cap < size) cap = size;
+
+        CeferBlock* block = malloc(CEFER_HEADER + cap);
+        if (!block) return NULL;
+        block->prev = top;
+        block->cap = cap;
+        block->used = 0;
+        block->heap = true;
+        arena->top = top = block;
+    }
+
+    void* ptr = (char*)top + CEFER_HEADER + top->used;
+    top->used += size;
+    return ptr;
+}
+
+// Resizes ptr, allocated from arena with old_size. The latest allocation
+// grows in place while its block has room; anything else is copied.
+static inline void* ceferRealloc(CeferArena* arena, void* ptr, size_t old_size,
+                                 size_t new_size) {
+    CeferBlock* top = arena->top;
+    if (ptr && top) {
+        uintptr_t data = (uintptr_t)top + CEFER_HEADER;
+        uintptr_t at = (uintptr_t)ptr;
+        if (at >= data && at - data + CEFER_ROUND(old_size) == top->used &&
+            at - data + CEFER_ROUND(new_size) <= top->cap) {
+            top->used = (size_t)(at - data) + CEFER_ROUND(new_size);
+            return ptr;
+        }
+    }
+
+    void* moved = ceferAlloc(arena, new_size);
+    if (moved && ptr) memcpy(moved, ptr, old_size < new_size ? old_size : new_size);
+    return moved;
+}
+
+static inline CeferMark ceferSave(const CeferArena* arena) {
+    CeferMark mark = { arena->top, arena->top ? arena->top->used : 0 };
+    return mark;
+}
+
+// frees the blocks taken since mark
+static inline void ceferRewind(CeferArena* arena, CeferMark mark) {
+    while (arena->top != mark.block) {
+        CeferBlock* prev = arena->top->prev;
+        if (arena->top->heap) free(arena->top);
+        arena->top = prev;
+    }
+    if (arena->top) arena->top->used = mark.used;
+}
+
+static inline void ceferRelease(CeferArena* arena) {
+    CeferMark bottom = { NULL, 0 };
+    ceferRewind(arena, bottom);
+}
+
 #if defined(__GNUC__) || defined(__clang__)
 
 #define __DEFER(_cond, _func, _arg, _count) \
@@ -25,6 +145,14 @@ static inline void _defer_invoke(struct __Defer* d) {
 #define DEFER_IF(_cond, _func, _arg) __DEFER(_cond, _func, _arg, __COUNTER__)
 #define DEFER(_func, _arg)           __DEFER(NULL, _func, _arg, __COUNTER__)
 
+#define __DEFER_ARENA(_name, _bytes, _count) \
+    max_align_t __CONCAT__(_arena_stack_, _count) \
+        [((_bytes) + sizeof(max_align_t) - 1) / sizeof(max_align_t)]; \
+    __attribute__((cleanup(ceferRelease))) CeferArena _name = \
+        ceferArenaOn(__CONCAT__(_arena_stack_, _count), \
+                     sizeof(__CONCAT__(_arena_stack_, _count)))
+#define DEFER_ARENA(_name, _bytes)   __DEFER_ARENA(_name, _bytes, __COUNTER__)
+
 #else
 #error "only gcc, and clang are supported"
 #endif
@@ -20,7 +20,7 @@ THE SOFTWARE.
 
 //////////////////////////////////////////////////////////////////////////////
 
-Clparse Command line parser library v0.5.0
+Clparse Command line parser library v0.10.1
 
 It is a command line parser inspired by go's flag module and tsodings flag.h
 ( tsodings flag.h source code : https://github.com/tsoding/flag.h )
@@ -32,6 +32,13 @@ It is a command line parser inspired by go's flag module and tsodings flag.h
 - v0.3.0:    Supports a long flag and a short flag
 - v0.4.0:    Supports multiple arguments for flags and main
 - v0.5.0:    Supports windows UTF-16 argvs
+- v0.6.0:    Supports a variadic main argument which takes the rest
+- v0.6.1:    `--` ends the flags, everything after it is a main argument
+- v0.7.0:    Reentrant `Clparse` contexts (`clparseCtx*`), reusable across parses
+- v0.8.0:    `@FILE` and `--files-from FILE` feed a variadic main argument
+- v0.9.0:    Hashed flag lookup; flags may be given in any order
+- v0.10.0:   Tables sized to what is declared instead of fixed capacities
+- v0.10.1:   List flags and lists of main args grow their buffers geometrically
 */
 
 #ifndef CLPARSE_LIBRARY_H_
@@ -139,7 +146,30 @@ typedef struct {
 	size_t len;
 } ArrayList;
 
+// Every declaration and every parsed value lives in a Clparse context.
+// The clparseCtx* functions take one explicitly, so each thread can parse
+// with its own and no locks; the functions without a context use a single
+// global one, as every version before v0.7.0 did.
+//
+// A context is declared once and parsed any number of times: each parse
+// first resets every value to its default without allocating, and list
+// buffers are kept for the next parse.
+typedef struct Clparse Clparse;
+
 // Function Signatures
+CLPDEF Clparse* clparseNew(const cchar* name, const cchar* desc);
+CLPDEF void clparseFree(Clparse* cp);
+CLPDEF void clparseCtxReset(Clparse* cp);
+CLPDEF bool clparseCtxParse(Clparse* cp, int argc, cchar** argv);
+CLPDEF const char* clparseCtxGetErr(Clparse* cp);
+CLPDEF bool clparseCtxIsHelp(const Clparse* cp);
+CLPDEF void clparseCtxPrintHelp(Clparse* cp);
+CLPDEF bool* clparseCtxSubcmd(Clparse* cp, const cchar* subcmd_name, const cchar* desc);
+CLPDEF const cchar** clparseCtxMainArg(Clparse* cp, const cchar* name, const cchar* desc,
+                                       const cchar* subcmd);
+CLPDEF const ArrayList* clparseCtxMainArgList(Clparse* cp, const cchar* name,
+                                              const cchar* desc, const cchar* subcmd);
+
 CLPDEF void clparseInit(const cchar* name, const cchar* desc);
 CLPDEF bool clparseParse(int argc, cchar** argv);
 CLPDEF void clparseDeinit(void);
@@ -148,6 +178,12 @@ CLPDEF bool clparseIsHelp(void);
 CLPDEF void clparsePrintHelp(void);
 CLPDEF bool* clparseSubcmd(const cchar* subcmd_name, const cchar* desc);
 CLPDEF const cchar** clparseMainArg(const cchar* name, const cchar* desc, const cchar* subcmd);
+// It must be declared last, and takes every remaining main argument. Its
+// values can also come from a file: `@FILE` or `--files-from FILE` reads
+// FILE in one go and adds one value per line (or per NUL, as written by
+// `find -print0`); empty lines are skipped. The values point into that
+// buffer, which lives until the next parse. After `--`, `@` is literal.
+CLPDEF const ArrayList* clparseMainArgList(const cchar* name, const cchar* desc, const cchar* subcmd);
 
 // windows specific feature
 #if defined(_WIN32) && !defined(NO_USE_WIDE_ARGV)
@@ -171,6 +207,13 @@ CLPDEF void clparseFreeCmdlineW(const LPWSTR* argv);
 
 #define T(_name, _type, _foo1, _foo2, _foo3)                                   \
     CLPDEF _type* clparse##_name(                                              \
+        const cchar* flag_name,                                                \
+        cchar short_name,                                                      \
+        _type dfault,                                                          \
+        const cchar* desc,                                                     \
+        const cchar* subcmd);                                                  \
+    CLPDEF _type* clparseCtx##_name(                                           \
+        Clparse* cp,                                                           \
         const cchar* flag_name,                                                \
         cchar short_name,                                                      \
         _type dfault,                                                          \
@@ -182,6 +225,13 @@ CLPDEF void clparseFreeCmdlineW(const LPWSTR* argv);
 
 #define T(_name, _type, _foo1, _foo2, _foo3)                                   \
     CLPDEF const ArrayList* clparse##_name##List(                              \
+        const cchar* flag_name,                                                \
+        cchar short_name,                                                      \
+        _type dfault,                                                          \
+        const cchar* desc,                                                     \
+        const cchar* subcmd);                                                  \
+    CLPDEF const ArrayList* clparseCtx##_name##List(                           \
+        Clparse* cp,                                                           \
         const cchar* flag_name,                                                \
         cchar short_name,                                                      \
         _type dfault,                                                          \
@@ -203,6 +253,7 @@ CLPDEF void clparseFreeCmdlineW(const LPWSTR* argv);
 #   include <cctype>
 #   include <cerrno>
 #   include <climits>
+#   include <cstdarg>
 #   include <cstdlib>
 #   include <cstring>
 #else
@@ -210,6 +261,7 @@ CLPDEF void clparseFreeCmdlineW(const LPWSTR* argv);
 #   include <ctype.h>
 #   include <errno.h>
 #   include <limits.h>
+#   include <stdarg.h>
 #   include <stdlib.h>
 #   include <string.h>
 #endif // __cplusplus
@@ -249,59 +301,71 @@ typedef union {
     ArrayList lst;
 } FlagKind;
 
-typedef struct {
+typedef struct Flag {
     const cchar* name;
     cchar short_name;
     FlagType type;
     FlagKind kind;
     FlagKind dfault;
     const cchar* desc;
+    size_t lst_cap; // items kind.lst has room for, kept across parses
+    struct Flag* next; // in declaration order
 } Flag;
 
-#ifndef FLAG_CAPACITY
-#define FLAG_CAPACITY 256
-#endif // FLAG_CAPACITY
-
-typedef struct {
+typedef struct MainArg {
     const cchar* name;
     const cchar* value;
     const cchar* desc;
+    bool is_list;
+    ArrayList lst;
+    size_t lst_cap;
+    struct MainArg* next;
 } MainArg;
 
-#ifndef MAIN_ARGS_CAPACITY
-#define MAIN_ARGS_CAPACITY 16
-#endif // MAIN_ARGS_CAPACITY
+// A name table with open addressing over clparseHash. It doubles at half
+// full, so it is only as large as what was declared. Slots keep the hash to
+// be moved without looking at their names.
+typedef struct {
+    size_t hash;
+    void* item; // NULL for an empty slot
+} NameSlot;
+
+typedef struct {
+    NameSlot* slots;
+    size_t cap; // 0 or a power of two
+    size_t len;
+} NameTable;
 
+// the main command is a Subcmd without a name
 typedef struct Subcmd {
     const cchar* name;
     const cchar* desc;
     bool is_activate;
-    MainArg main_args[MAIN_ARGS_CAPACITY];
-    size_t main_args_len;
-    Flag flags[FLAG_CAPACITY];
-    size_t flags_len;
+    bool* help;
+    MainArg *main_args, *main_args_last;
+    Flag *flags, *flags_last;
+    NameTable by_long;  // Flag* by the long name
+    NameTable by_short; // Flag* by the short name
+    struct Subcmd* next;
 } Subcmd;
 
-#ifndef SUBCOMMAND_CAPACITY
-#define SUBCOMMAND_CAPACITY 64
-#endif // SUBCOMMAND_CAPACITY
+// Subcmds, Flags and MainArgs are carved out of chunks which never move, so
+// pointers given by the declaring functions stay valid as more are declared.
+#ifndef CLPARSE_CHUNK_SIZE
+#define CLPARSE_CHUNK_SIZE 4096
+#endif // CLPARSE_CHUNK_SIZE
 
-// static members
-static const cchar* main_prog_name = NULL;
-static const cchar* main_prog_desc = NULL;
-static Subcmd* activated_subcmd = NULL;
+#define CLPARSE_ALIGN 16
 
-static Subcmd subcommands[SUBCOMMAND_CAPACITY];
-static size_t subcommands_len = 0;
-
-static MainArg main_main_args[MAIN_ARGS_CAPACITY];
-static size_t main_args_len = 0;
-
-static Flag main_flags[FLAG_CAPACITY];
-static size_t main_flags_len = 0;
+typedef struct ClparseChunk
+{
+    struct ClparseChunk* next;
+    size_t used;
+    size_t cap;
+} ClparseChunk;
 
-static bool* help_cmd[SUBCOMMAND_CAPACITY + 1];
-static size_t help_cmd_len = 0;
+#define CLPARSE_CHUNK_HEADER \
+    ((sizeof(ClparseChunk) + CLPARSE_ALIGN - 1) & ~(size_t)(CLPARSE_ALIGN - 1))
 
 // Error kinds
 typedef enum ClparseErrKind
@@ -312,25 +376,37 @@ typedef enum ClparseErrKind
     CLPARSE_ERR_KIND_MAIN_ARGS_NUM_OVERFLOWED,
     CLPARSE_ERR_KIND_INAVLID_NUMBER,
     CLPARSE_ERR_KIND_LONG_FLAG_WITH_SHORT_FLAG,
+    CLPARSE_ERR_KIND_FILES_FROM,
     CLPARSE_INTERNAL_ERROR,
 } ClparseErrKind;
 
-static ClparseErrKind clparse_err = CLPARSE_ERR_KIND_OK;
-static char internal_err_msg[201];
-static const char* err_msg_detail = NULL;
+// one buffer per `@FILE`, the file's text follows the struct
+typedef struct FilesFrom
+{
+    struct FilesFrom* next;
+} FilesFrom;
 
-// A container of subcommand names (with a hashmap)
-// This hashmap made of fnv1a hash algorithm
-#define CLPARSE_HASHMAP_CAPACITY 1024
+// what used to be the static members
+struct Clparse {
+    const cchar* main_prog_name;
+    const cchar* main_prog_desc;
+    Subcmd* activated_subcmd;
 
-typedef struct HashBox
-{
-    const cchar* name;
-    size_t where;
-    struct HashBox* next;
-} HashBox;
+    Subcmd main_cmd;
+    Subcmd *subcommands, *subcommands_last;
+    size_t subcommands_len;
+    NameTable subcmd_names; // Subcmd* by name
 
-static HashBox hash_map[CLPARSE_HASHMAP_CAPACITY];
+    ClparseErrKind clparse_err;
+    char internal_err_msg[201];
+    const char* err_msg_detail;
+
+    ClparseChunk* chunks;
+    FilesFrom* files_from;
+};
+
+// the context behind the functions without one
+static Clparse clparse_global;
 
 /******************************/
 /* Static Function Signatures */
@@ -338,145 +414,211 @@ static HashBox hash_map[CLPARSE_HASHMAP_CAPACITY];
 static bool isTruthy(const cchar* string);
 static void deinitFlag(Flag* flag);
 static size_t clparseHash(const cchar* letter);
-static MainArg* clparseGetMainArg(const cchar* subcmd);
-static Flag* clparseGetFlag(const cchar* subcmd);
-static bool findSubcmdPosition(size_t* output, const cchar* subcmd_name);
-static void freeNextHashBox(HashBox* hashbox);
+static void* arenaAlloc(Clparse* cp, size_t size);
+static bool reserveList(ArrayList* lst, size_t* cap, size_t item_size, size_t more);
+static bool nameTableAdd(NameTable* table, size_t hash, void* item);
+static MainArg* clparseGetMainArg(Clparse* cp, const cchar* subcmd);
+static Flag* clparseGetFlag(Clparse* cp, const cchar* subcmd, const cchar* flag_name,
+                            cchar short_name);
+static Flag* findLongFlag(const Subcmd* cmd, const cchar* name);
+static Flag* findShortFlag(const Subcmd* cmd, cchar short_name);
+static Subcmd* findSubcmd(const Clparse* cp, const cchar* subcmd_name);
+static void freeFilesFrom(Clparse* cp);
+static bool readFilesFrom(Clparse* cp, MainArg* list_arg, const cchar* path);
+static void printFilesFromHint(const Subcmd* cmd);
 
 /************************************/
 /* Implementation of Main Functions */
 /************************************/
-void clparseInit(const cchar* name, const cchar* desc) {
-    main_prog_name = name;
-    main_prog_desc = desc;
-    memset(hash_map, 0, sizeof(HashBox) * CLPARSE_HASHMAP_CAPACITY);
-    memset(subcommands, 0, sizeof(Subcmd) * SUBCOMMAND_CAPACITY);
+// cp must be zeroed
+static void initContext(Clparse* cp, const cchar* name, const cchar* desc) {
+    cp->main_prog_name = name;
+    cp->main_prog_desc = desc;
 
-    help_cmd[help_cmd_len++] =
-        clparseBool(CSTR("help"), CSTR('h'), false, CSTR("Print this help message"), NULL);
+    cp->main_cmd.help =
+        clparseCtxBool(cp, CSTR("help"), CSTR('h'), false, CSTR("Print this help message"), NULL);
 }
 
-void clparseDeinit(void) {
-    for (size_t i = 0; i < CLPARSE_HASHMAP_CAPACITY; ++i) {
-        freeNextHashBox(&hash_map[i]);
+static void deinitCmd(Subcmd* cmd) {
+    for (Flag* flag = cmd->flags; flag; flag = flag->next) {
+        deinitFlag(flag);
+    }
+    for (MainArg* main_arg = cmd->main_args; main_arg; main_arg = main_arg->next) {
+        free(main_arg->lst.items);
     }
+    free(cmd->by_long.slots);
+    free(cmd->by_short.slots);
+}
+
+static void deinitContext(Clparse* cp) {
+    freeFilesFrom(cp);
 
-    for (size_t i = 0; i < main_flags_len; ++i) {
-        deinitFlag(&main_flags[i]);
+    deinitCmd(&cp->main_cmd);
+    for (Subcmd* subcmd = cp->subcommands; subcmd; subcmd = subcmd->next) {
+        deinitCmd(subcmd);
     }
+    free(cp->subcmd_names.slots);
+
+    // the Subcmds above live in these
+    ClparseChunk* next;
+    while (cp->chunks) {
+        next = cp->chunks->next;
+        free(cp->chunks);
+        cp->chunks = next;
+    }
+}
 
-    Subcmd* subcmd;
-    for (size_t i = 0; i < subcommands_len; ++i) {
-        subcmd = &subcommands[i];
-        for (size_t j = 0; j < subcmd->flags_len; ++j) {
-            deinitFlag(&subcmd->flags[j]);
-        }
+Clparse* clparseNew(const cchar* name, const cchar* desc) {
+    Clparse* cp = (Clparse*)calloc(1, sizeof(Clparse));
+    if (cp) initContext(cp, name, desc);
+    return cp;
+}
+
+void clparseFree(Clparse* cp) {
+    if (!cp) return;
+    deinitContext(cp);
+    free(cp);
+}
+
+static void resetFlag(Flag* flag) {
+    if (flag->type == FLAG_TYPE_LIST) {
+        flag->kind.lst.len = 0; // the buffer is reused by the next parse
+    } else {
+        flag->kind = flag->dfault;
     }
 }
 
-bool clparseIsHelp(void) {
-    bool output = false;
+static void resetMainArg(MainArg* main_arg) {
+    main_arg->value = NULL;
+    main_arg->lst.len = 0;
+}
 
-    for (size_t i = 0; i < help_cmd_len; ++i) {
-        output |= *help_cmd[i];
+static void resetCmd(Subcmd* cmd) {
+    cmd->is_activate = false;
+    for (Flag* flag = cmd->flags; flag; flag = flag->next) {
+        resetFlag(flag);
+    }
+    for (MainArg* main_arg = cmd->main_args; main_arg; main_arg = main_arg->next) {
+        resetMainArg(main_arg);
+    }
+}
+
+void clparseCtxReset(Clparse* cp) {
+    resetCmd(&cp->main_cmd);
+    for (Subcmd* subcmd = cp->subcommands; subcmd; subcmd = subcmd->next) {
+        resetCmd(subcmd);
+    }
+
+    cp->activated_subcmd = NULL;
+    cp->clparse_err = CLPARSE_ERR_KIND_OK;
+    cp->err_msg_detail = NULL;
+    freeFilesFrom(cp);
+}
+
+bool clparseCtxIsHelp(const Clparse* cp) {
+    bool output = cp->main_cmd.help && *cp->main_cmd.help;
+
+    for (const Subcmd* subcmd = cp->subcommands; subcmd; subcmd = subcmd->next) {
+        output |= subcmd->help && *subcmd->help;
     }
 
     return output;
 }
 
-void clparsePrintHelp(void) {
+void clparseCtxPrintHelp(Clparse* cp) {
     size_t tmp, name_len = 0;
 
-    if (!main_prog_name) main_prog_name = CSTR("(*.*)");
-    if (main_prog_desc) cprintf(CSTR("%s\n\n"), main_prog_desc);
+    if (!cp->main_prog_name) cp->main_prog_name = CSTR("(*.*)");
+    if (cp->main_prog_desc) cprintf(CSTR("%s\n\n"), cp->main_prog_desc);
 
-    if (activated_subcmd) {
+    if (cp->activated_subcmd) {
+        const Subcmd* subcmd = cp->activated_subcmd;
         cprintf(CSTR("Usage: %"CSTR_FMT" %"CSTR_FMT" [ARGS] [FLAGS]\n\n"),
-            main_prog_name, activated_subcmd->name);
+            cp->main_prog_name, subcmd->name);
 
         cprintf(CSTR("Args:\n"));
-        for (size_t i = 0; i < activated_subcmd->main_args_len; ++i) {
-            tmp = cstrlen(activated_subcmd->main_args[i].name);
+        for (const MainArg* main_arg = subcmd->main_args; main_arg; main_arg = main_arg->next) {
+            tmp = cstrlen(main_arg->name);
             name_len = name_len > tmp ? name_len : tmp;
         }
-        for (size_t i = 0; i < activated_subcmd->main_args_len; ++i) {
+        for (const MainArg* main_arg = subcmd->main_args; main_arg; main_arg = main_arg->next) {
             cprintf(CSTR("     %*"CSTR_FMT"%"CSTR_FMT"\n"), -(int)name_len - 4,
-                activated_subcmd->main_args[i].name,
-                activated_subcmd->main_args[i].desc);
+                main_arg->name, main_arg->desc);
         }
+        printFilesFromHint(subcmd);
 
         cprintf(CSTR("Options:\n"));
-        for (size_t i = 0; i < activated_subcmd->flags_len; ++i) {
-            tmp = cstrlen(activated_subcmd->flags[i].name);
+        for (const Flag* flag = subcmd->flags; flag; flag = flag->next) {
+            tmp = cstrlen(flag->name);
             name_len = name_len > tmp ? name_len : tmp;
         }
-        for (size_t i = 0; i < activated_subcmd->flags_len; ++i) {
-            if (cstrcmp(activated_subcmd->flags[i].name, NO_LONG) != 0) {
+        for (const Flag* flag = subcmd->flags; flag; flag = flag->next) {
+            if (cstrcmp(flag->name, NO_LONG) != 0) {
                 cprintf(CSTR("    --%*"CSTR_FMT"%"CSTR_FMT"\n"), -(int)name_len - 4,
-                    activated_subcmd->flags[i].name,
-                    activated_subcmd->flags[i].desc);
-            } else if (activated_subcmd->flags[i].short_name == NO_SHORT) {
+                    flag->name, flag->desc);
+            } else if (flag->short_name == NO_SHORT) {
                 cprintf(CSTR("    -%*"CCHAR_FMT"%"CSTR_FMT"\n"), -(int)name_len - 4,
-                    activated_subcmd->flags[i].short_name,
-                    activated_subcmd->flags[i].desc);
+                    flag->short_name, flag->desc);
             } else {
                 cprintf(CSTR("    -%*"CCHAR_FMT" --%*"CSTR_FMT"%"CSTR_FMT"\n"),
                     -(int)name_len - 4,
-                    activated_subcmd->flags[i].short_name,
-                    activated_subcmd->flags[i].name,
-                    activated_subcmd->flags[i].desc);
+                    flag->short_name,
+                    flag->name,
+                    flag->desc);
             }
         }
     } else {
-        if (subcommands_len > 0) {
+        const Subcmd* main_cmd = &cp->main_cmd;
+        if (cp->subcommands_len > 0) {
             cprintf(CSTR("Usage: %"CSTR_FMT" [SUBCOMMANDS] [ARGS] [FLAGS]\n\n"),
-                main_prog_name);
+                cp->main_prog_name);
         } else {
             cprintf(CSTR("Usage: %"CSTR_FMT" [ARGS] [FLAGS]\n\n"),
-                main_prog_name);
+                cp->main_prog_name);
         }
 
         cprintf(CSTR("Args:\n"));
-        for (size_t i = 0; i < main_args_len; ++i) {
-            tmp = cstrlen(main_main_args[i].name);
+        for (const MainArg* main_arg = main_cmd->main_args; main_arg; main_arg = main_arg->next) {
+            tmp = cstrlen(main_arg->name);
             name_len = name_len > tmp ? name_len : tmp;
         }
-        for (size_t i = 0; i < main_args_len; ++i) {
+        for (const MainArg* main_arg = main_cmd->main_args; main_arg; main_arg = main_arg->next) {
             cprintf(CSTR("    %*"CSTR_FMT"%"CSTR_FMT"\n"), -(int)name_len - 4,
-                main_main_args[i].name, main_main_args[i].desc);
+                main_arg->name, main_arg->desc);
         }
+        printFilesFromHint(main_cmd);
 
         cprintf(CSTR("Options:\n"));
-        for (size_t i = 0; i < main_flags_len; ++i) {
-            tmp = cstrlen(main_flags[i].name);
+        for (const Flag* flag = main_cmd->flags; flag; flag = flag->next) {
+            tmp = cstrlen(flag->name);
             name_len = name_len > tmp ? name_len : tmp;
         }
-        for (size_t i = 0; i < main_flags_len; ++i) {
-            if (cstrcmp(main_flags[i].name, NO_LONG) != 0) {
+        for (const Flag* flag = main_cmd->flags; flag; flag = flag->next) {
+            if (cstrcmp(flag->name, NO_LONG) != 0) {
                 cprintf(CSTR("    --%*"CSTR_FMT"%"CSTR_FMT"\n"), -(int)name_len - 4,
-                    main_flags[i].name, main_flags[i].desc);
-            } else if (main_flags[i].short_name == NO_SHORT) {
+                    flag->name, flag->desc);
+            } else if (flag->short_name == NO_SHORT) {
                 cprintf(CSTR("    -%*"CCHAR_FMT"%"CSTR_FMT"\n"), -(int)name_len - 4,
-                    main_flags[i].short_name, main_flags[i].desc);
+                    flag->short_name, flag->desc);
             } else {
                 cprintf(CSTR("    -%*"CCHAR_FMT" --%*"CSTR_FMT"%"CSTR_FMT"\n"),
                     -(int)name_len - 4,
-                    main_flags[i].short_name,
-                    main_flags[i].name,
-                    main_flags[i].desc);
+                    flag->short_name,
+                    flag->name,
+                    flag->desc);
             }
         }
 
-        if (subcommands_len > 0) {
+        if (cp->subcommands_len > 0) {
             cprintf(CSTR("\nSubcommands:\n"));
 
-            for (size_t i = 0; i < subcommands_len; ++i) {
-                tmp = cstrlen(subcommands[i].name);
+            for (const Subcmd* subcmd = cp->subcommands; subcmd; subcmd = subcmd->next) {
+                tmp = cstrlen(subcmd->name);
                 name_len = name_len > tmp ? name_len : tmp;
             }
-            for (size_t i = 0; i < subcommands_len; ++i) {
+            for (const Subcmd* subcmd = cp->subcommands; subcmd; subcmd = subcmd->next) {
                 cprintf(CSTR("    %*"CSTR_FMT"%"CSTR_FMT"\n"), -(int)name_len - 4,
-                    subcommands[i].name, subcommands[i].desc);
+                    subcmd->name, subcmd->desc);
             }
         }
     }
@@ -485,18 +627,17 @@ void clparsePrintHelp(void) {
 // Helper macros to implement clparseParse
 #define IMPL_PARSE_INTEGER(_field, _type)                                      \
     do {                                                                       \
+        errno = 0;                                                             \
         flag->kind._field = (_type)cstrtoull(argv[arg++], NULL, 0);            \
         if (errno == EINVAL || errno == ERANGE) {                              \
-            clparse_err = CLPARSE_ERR_KIND_INAVLID_NUMBER;                     \
+            cp->clparse_err = CLPARSE_ERR_KIND_INAVLID_NUMBER;                 \
             return false;                                                      \
         }                                                                      \
     } while (0)
 
 #define IMPL_PARSE_INTEGER_LIST(_type)                                         \
     do {                                                                       \
-        size_t prev_lst_len = flag->kind.lst.len;                              \
         size_t lst_len = 0;                                                    \
-        size_t init_arg = arg;                                                 \
                                                                                \
         while (argv[arg + lst_len] != NULL &&                                  \
                 (argv[arg + lst_len][0] != CSTR('-') ||                        \
@@ -504,40 +645,37 @@ void clparsePrintHelp(void) {
             ++lst_len;                                                         \
         }                                                                      \
                                                                                \
-        if (flag->kind.lst.len == 0) {                                         \
-            flag->kind.lst.items = malloc(sizeof(_type) * lst_len);            \
-            flag->kind.lst.len = lst_len;                                      \
-        }                                                                      \
-        else {                                                                 \
-            flag->kind.lst.items =                                             \
-                realloc(flag->kind.lst.items,                                  \
-                        sizeof(_type) * (prev_lst_len + lst_len));             \
-            flag->kind.lst.len += lst_len;                                     \
+        if (!reserveList(&flag->kind.lst, &flag->lst_cap, sizeof(_type),       \
+                         lst_len)) {                                           \
+            cp->clparse_err = CLPARSE_INTERNAL_ERROR;                          \
+            cp->err_msg_detail = "clparseParse";                               \
+            return false;                                                      \
         }                                                                      \
                                                                                \
-        for (size_t i = prev_lst_len; i < flag->kind.lst.len; ++i) {           \
-            ((_type*)flag->kind.lst.items)[i] =                                \
+        for (size_t i = 0; i < lst_len; ++i) {                                 \
+            errno = 0;                                                         \
+            ((_type*)flag->kind.lst.items)[flag->kind.lst.len++] =             \
                 (_type)cstrtoull(argv[arg++], NULL, 0);                        \
             if (errno == EINVAL || errno == ERANGE) {                          \
-                clparse_err = CLPARSE_ERR_KIND_INAVLID_NUMBER;                 \
-                free(flag->kind.lst.items);                                    \
+                cp->clparse_err = CLPARSE_ERR_KIND_INAVLID_NUMBER;             \
+                flag->kind.lst.len = 0;                                        \
                 return false;                                                  \
             }                                                                  \
         }                                                                      \
-        assert((init_arg + lst_len == (size_t)arg) &&                          \
-               "argument parsing failed");                                     \
     } while (0)
 
-bool clparseParse(int argc, cchar** argv) {
-    MainArg* main_args;
-    Flag *flags, *flag;
-    size_t total_args_count, total_flags_count;
-    size_t args_count = 0, flags_count = 0;
+bool clparseCtxParse(Clparse* cp, int argc, cchar** argv) {
+    Subcmd* cmd = &cp->main_cmd;
+    MainArg *next_arg, *list_arg = NULL;
+    Flag* flag;
+    bool only_args = false;
     int arg = 1;
 
+    clparseCtxReset(cp);
+
     if (argc < 2) {
 #ifdef NOT_ALLOW_EMPTY_ARGUMENT
-        clparsePrintHelp();
+        clparseCtxPrintHelp(cp);
         return false;
 #else
         return true;
@@ -545,62 +683,75 @@ bool clparseParse(int argc, cchar** argv) {
     }
 
     // check whether has a subcommand
-    if (subcommands_len > 0 && argv[arg][0] != CSTR('-')) {
-        size_t pos;
-        if (!findSubcmdPosition(&pos, argv[arg++])) {
-            clparse_err = CLPARSE_ERR_KIND_SUBCOMMAND_FIND;
+    if (cp->subcommands_len > 0 && argv[arg][0] != CSTR('-')) {
+        cmd = findSubcmd(cp, argv[arg++]);
+        if (!cmd) {
+            cp->clparse_err = CLPARSE_ERR_KIND_SUBCOMMAND_FIND;
             return false;
         }
-        activated_subcmd = &subcommands[pos];
-        activated_subcmd->is_activate = true;
-
-        main_args = activated_subcmd->main_args;
-        main_args_len = activated_subcmd->main_args_len;
-        flags = activated_subcmd->flags;
-        total_flags_count = activated_subcmd->flags_len;
-    } else {
-        main_args = main_main_args;
-        total_args_count = main_args_len;
-        flags = main_flags;
-        total_flags_count = main_flags_len;
+        cp->activated_subcmd = cmd;
+        cmd->is_activate = true;
+    }
+    next_arg = cmd->main_args;
+    if (cmd->main_args_last && cmd->main_args_last->is_list) {
+        list_arg = cmd->main_args_last;
     }
 
     while (arg < argc) {
-        if (cstrcmp(argv[arg], CSTR("--")) == 0) {
+        if (!only_args && cstrcmp(argv[arg], CSTR("--")) == 0) {
+            only_args = true;
             ++arg;
             continue;
         }
 
-        if (argv[arg][0] != CSTR('-')) {
-            if (args_count >= total_args_count) {
-                clparse_err = CLPARSE_ERR_KIND_MAIN_ARGS_NUM_OVERFLOWED;
+        if (!only_args && list_arg && argv[arg][0] == CSTR('@')) {
+            if (!readFilesFrom(cp, list_arg, argv[arg++] + 1)) return false;
+            continue;
+        }
+        if (!only_args && list_arg && cstrcmp(argv[arg], CSTR("--files-from")) == 0) {
+            if (arg + 1 >= argc) {
+                cp->clparse_err = CLPARSE_ERR_KIND_FILES_FROM;
                 return false;
             }
-            main_args[args_count++].value = argv[arg++];
+            if (!readFilesFrom(cp, list_arg, argv[arg + 1])) return false;
+            arg += 2;
             continue;
-        } else {
-            if (argv[arg][1] == CSTR('-')) {
-                if (!flags[flags_count].name) {
-                    clparse_err = CLPARSE_ERR_KIND_FLAG_FIND;
+        }
+
+        if (only_args || argv[arg][0] != CSTR('-')) {
+            if (!next_arg) {
+                cp->clparse_err = CLPARSE_ERR_KIND_MAIN_ARGS_NUM_OVERFLOWED;
+                return false;
+            }
+            if (next_arg->is_list) {
+                ArrayList* lst = &next_arg->lst;
+                if (!reserveList(lst, &next_arg->lst_cap, sizeof(const cchar*), 1)) {
+                    cp->clparse_err = CLPARSE_INTERNAL_ERROR;
+                    cp->err_msg_detail = "clparseParse";
                     return false;
                 }
-                for (; flags_count < total_flags_count &&
-                    cstrcmp(&argv[arg][2], flags[flags_count].name) != 0; ++flags_count);
+                ((const cchar**)lst->items)[lst->len++] = argv[arg++];
+                continue;
+            }
+            next_arg->value = argv[arg++];
+            next_arg = next_arg->next;
+            continue;
+        } else {
+            if (argv[arg][1] == CSTR('-')) {
+                flag = findLongFlag(cmd, &argv[arg][2]);
             } else {
                 if (cstrlen(&argv[arg][1]) > 1) {
-                    clparse_err = CLPARSE_ERR_KIND_LONG_FLAG_WITH_SHORT_FLAG;
+                    cp->clparse_err = CLPARSE_ERR_KIND_LONG_FLAG_WITH_SHORT_FLAG;
                     return false;
                 }
-                for (; flags_count < total_flags_count && argv[arg][1] != flags[flags_count].short_name; ++flags_count);
+                flag = findShortFlag(cmd, argv[arg][1]);
             }
         }
 
-        if (flags_count >= total_flags_count) {
-            clparse_err = CLPARSE_ERR_KIND_FLAG_FIND;
+        if (!flag) {
+            cp->clparse_err = CLPARSE_ERR_KIND_FLAG_FIND;
             return false;
         }
-
-        flag = &flags[flags_count];
         ++arg;
 
         switch (flag->type) {
@@ -647,32 +798,22 @@ bool clparseParse(int argc, cchar** argv) {
             case FLAG_TYPE_LIST:
                 switch (flag->kind.lst.kind) {
                 case ARRAY_LIST_BOOL: {
-                    size_t prev_lst_len = flag->kind.lst.len;
                     size_t lst_len = 0;
-                    size_t init_arg = arg;
 
                     while (argv[arg + lst_len] != NULL &&
                            argv[arg + lst_len][0] != CSTR('-')) {
                         ++lst_len;
                     }
 
-                    if (flag->kind.lst.len == 0) {
-                        flag->kind.lst.items = malloc(sizeof(bool) * lst_len);
-                        flag->kind.lst.len = lst_len;
-                    }
-                    else {
-                        flag->kind.lst.items =
-                            realloc(flag->kind.lst.items,
-                                    sizeof(bool) * (prev_lst_len + lst_len));
-                        flag->kind.lst.len += lst_len;
+                    if (!reserveList(&flag->kind.lst, &flag->lst_cap, sizeof(bool), lst_len)) {
+                        cp->clparse_err = CLPARSE_INTERNAL_ERROR;
+                        cp->err_msg_detail = "clparseParse";
+                        return false;
                     }
-
-                    for (size_t i = prev_lst_len; i < flag->kind.lst.len; ++i) {
-                        ((bool*)flag->kind.lst.items)[i] =
+                    for (size_t i = 0; i < lst_len; ++i) {
+                        ((bool*)flag->kind.lst.items)[flag->kind.lst.len++] =
                             isTruthy(argv[arg++]);
                     }
-                    assert((init_arg + lst_len == (size_t)arg) &&
-                           "argument parsing failed");
                 }
                 break;
 
@@ -709,32 +850,23 @@ bool clparseParse(int argc, cchar** argv) {
                     break;
 
                 case ARRAY_LIST_STRING: {
-                    size_t prev_lst_len = flag->kind.lst.len;
                     size_t lst_len = 0;
-                    size_t init_arg = arg;
 
                     while (argv[arg + lst_len] != NULL &&
                            argv[arg + lst_len][0] != CSTR('-')) {
                         ++lst_len;
                     }
 
-                    if (flag->kind.lst.len == 0) {
-                        flag->kind.lst.items =
-                            malloc(sizeof(const cchar*) * lst_len);
-                        flag->kind.lst.len = lst_len;
+                    if (!reserveList(&flag->kind.lst, &flag->lst_cap, sizeof(const cchar*),
+                                     lst_len)) {
+                        cp->clparse_err = CLPARSE_INTERNAL_ERROR;
+                        cp->err_msg_detail = "clparseParse";
+                        return false;
                     }
-                    else {
-                        flag->kind.lst.items = realloc(
-                            flag->kind.lst.items,
-                            sizeof(const cchar*) * (prev_lst_len + lst_len));
-                        flag->kind.lst.len += lst_len;
+                    for (size_t i = 0; i < lst_len; ++i) {
+                        ((const cchar**)flag->kind.lst.items)[flag->kind.lst.len++] =
+                            argv[arg++];
                     }
-
-                    for (size_t i = prev_lst_len; i < flag->kind.lst.len; ++i) {
-                        ((const cchar**)flag->kind.lst.items)[i] = argv[arg++];
-                    }
-                    assert((init_arg + lst_len == (size_t)arg) &&
-                           "argument parsing failed");
                 }
                 break;
             }
@@ -752,48 +884,38 @@ bool clparseParse(int argc, cchar** argv) {
 #undef IMPL_PARSE_INTEGER
 #undef IMPL_PARSE_INTEGER_LIST
 
-bool* clparseSubcmd(const cchar* subcmd_name, const cchar* desc) {
-    assert(subcommands_len < SUBCOMMAND_CAPACITY);
-
-    HashBox* hash_box;
-    Subcmd* subcmd;
-    size_t hash = clparseHash(subcmd_name);
-
-    if (hash_map[hash].next) {
-        hash_box = hash_map[hash].next;
-        while (hash_box->next) hash_box = hash_box->next;
-    } else {
-        hash_box = &hash_map[hash];
+bool* clparseCtxSubcmd(Clparse* cp, const cchar* subcmd_name, const cchar* desc) {
+    Subcmd* subcmd = (Subcmd*)arenaAlloc(cp, sizeof(Subcmd));
+    if (!subcmd || !nameTableAdd(&cp->subcmd_names, clparseHash(subcmd_name), subcmd)) {
+        cp->clparse_err = CLPARSE_INTERNAL_ERROR;
+        cp->err_msg_detail = "clparseSubcmd";
+        return NULL;
     }
 
-    hash_box->name = subcmd_name;
-    hash_box->where = subcommands_len;
-    hash_box->next = (HashBox*)malloc(sizeof(HashBox));
-    hash_box->next->next = NULL;
-
-    subcmd = &subcommands[subcommands_len++];
-
     subcmd->name = subcmd_name;
     subcmd->desc = desc;
-    subcmd->is_activate = false;
-    subcmd->main_args_len = 0;
-    subcmd->flags_len = 0;
 
-    help_cmd[help_cmd_len++] =
-        clparseBool(CSTR("help"), CSTR('h'), false,
+    if (cp->subcommands_last) cp->subcommands_last->next = subcmd;
+    else cp->subcommands = subcmd;
+    cp->subcommands_last = subcmd;
+    ++cp->subcommands_len;
+
+    subcmd->help =
+        clparseCtxBool(cp, CSTR("help"), CSTR('h'), false,
             CSTR("Print this help message"), subcmd_name);
 
     return &subcmd->is_activate;
 }
 
-const cchar** clparseMainArg(
+const cchar** clparseCtxMainArg(
+    Clparse* cp,
     const cchar* name,
     const cchar* desc,
     const cchar* subcmd
 ) {
-    MainArg* main_arg = clparseGetMainArg(subcmd);
+    MainArg* main_arg = clparseGetMainArg(cp, subcmd);
     if (!main_arg) {
-        if (!err_msg_detail) clparse_err = CLPARSE_ERR_KIND_SUBCOMMAND_FIND;
+        if (!cp->err_msg_detail) cp->clparse_err = CLPARSE_ERR_KIND_SUBCOMMAND_FIND;
         return NULL;
     }
 
@@ -804,24 +926,46 @@ const cchar** clparseMainArg(
     return &main_arg->value;
 }
 
+const ArrayList* clparseCtxMainArgList(
+    Clparse* cp,
+    const cchar* name,
+    const cchar* desc,
+    const cchar* subcmd
+) {
+    MainArg* main_arg = clparseGetMainArg(cp, subcmd);
+    if (!main_arg) {
+        if (!cp->err_msg_detail) cp->clparse_err = CLPARSE_ERR_KIND_SUBCOMMAND_FIND;
+        return NULL;
+    }
+
+    main_arg->name = name;
+    main_arg->value = NULL;
+    main_arg->desc = desc;
+    main_arg->is_list = true;
+    main_arg->lst.items = NULL;
+    main_arg->lst.kind = ARRAY_LIST_STRING;
+    main_arg->lst.len = 0;
+
+    return &main_arg->lst;
+}
+
 #define T(_name, _type, _arg, _flag_type, _foo)                                \
-    _type* clparse##_name(                                                     \
+    _type* clparseCtx##_name(                                                  \
+        Clparse* cp,                                                           \
         const cchar* flag_name,                                                \
         cchar short_name,                                                      \
         _type dfault,                                                          \
         const cchar* desc,                                                     \
         const cchar* subcmd                                                    \
     ) {                                                                        \
-        Flag* flag = clparseGetFlag(subcmd);                                   \
+        Flag* flag = clparseGetFlag(cp, subcmd, flag_name, short_name);        \
         if (!flag) {                                                           \
-            if (!err_msg_detail) {                                             \
-                clparse_err = CLPARSE_ERR_KIND_SUBCOMMAND_FIND;                \
+            if (!cp->err_msg_detail) {                                         \
+                cp->clparse_err = CLPARSE_ERR_KIND_SUBCOMMAND_FIND;            \
             }                                                                  \
             return NULL;                                                       \
         }                                                                      \
                                                                                \
-        flag->name = flag_name;                                                \
-        flag->short_name = short_name;                                         \
         flag->type = _flag_type;                                               \
         flag->kind._arg = dfault;                                              \
         flag->dfault._arg = dfault;                                            \
@@ -835,7 +979,8 @@ CLPARSE_TYPES(T)
 #undef T
 
 #define T(_name, _type, _foo1, _foo2, _array_list_type)                        \
-    const ArrayList* clparse##_name##List(                                     \
+    const ArrayList* clparseCtx##_name##List(                                  \
+        Clparse* cp,                                                           \
         const cchar* flag_name,                                                \
         cchar short_name,                                                      \
         _type dfault,                                                          \
@@ -843,16 +988,14 @@ CLPARSE_TYPES(T)
         const cchar* subcmd                                                    \
     ) {                                                                        \
         (void)dfault;                                                          \
-        Flag* flag = clparseGetFlag(subcmd);                                   \
+        Flag* flag = clparseGetFlag(cp, subcmd, flag_name, short_name);        \
         if (!flag) {                                                           \
-            if (!err_msg_detail) {                                             \
-                clparse_err = CLPARSE_ERR_KIND_SUBCOMMAND_FIND;                \
+            if (!cp->err_msg_detail) {                                         \
+                cp->clparse_err = CLPARSE_ERR_KIND_SUBCOMMAND_FIND;            \
             }                                                                  \
             return NULL;                                                       \
         }                                                                      \
                                                                                \
-        flag->name = flag_name;                                                \
-        flag->short_name = short_name;                                         \
         flag->type = FLAG_TYPE_LIST;                                           \
         flag->kind.lst.items = NULL;                                           \
         flag->kind.lst.kind = _array_list_type;                                \
@@ -867,8 +1010,8 @@ CLPARSE_TYPES(T)
 #undef T
 
 // TODO: implement better and clean error printing message
-const char* clparseGetErr(void) {
-    switch (clparse_err) {
+const char* clparseCtxGetErr(Clparse* cp) {
+    switch (cp->clparse_err) {
     case CLPARSE_ERR_KIND_OK:
         return NULL;
 
@@ -887,11 +1030,14 @@ const char* clparseGetErr(void) {
     case CLPARSE_ERR_KIND_LONG_FLAG_WITH_SHORT_FLAG:
         return "Long flags must start with `--`, not `-`";
 
+    case CLPARSE_ERR_KIND_FILES_FROM:
+        return "Cannot read the file given with `@` or `--files-from`";
+
     case CLPARSE_INTERNAL_ERROR:
-        snprintf(internal_err_msg, 200, "Internal error was found at %s",
-                 err_msg_detail);
-        internal_err_msg[200] = '\0';
-        return internal_err_msg;
+        snprintf(cp->internal_err_msg, 200, "Internal error was found at %s",
+                 cp->err_msg_detail);
+        cp->internal_err_msg[200] = '\0';
+        return cp->internal_err_msg;
 
     default:
         assert(false && "Unreatchable (clparseGetErr)");
@@ -899,6 +1045,71 @@ const char* clparseGetErr(void) {
     }
 }
 
+/*****************************************/
+/* Functions on the global Clparse context */
+/*****************************************/
+void clparseInit(const cchar* name, const cchar* desc) {
+    memset(&clparse_global, 0, sizeof(clparse_global));
+    initContext(&clparse_global, name, desc);
+}
+
+void clparseDeinit(void) {
+    deinitContext(&clparse_global);
+}
+
+bool clparseParse(int argc, cchar** argv) {
+    return clparseCtxParse(&clparse_global, argc, argv);
+}
+
+const char* clparseGetErr(void) {
+    return clparseCtxGetErr(&clparse_global);
+}
+
+bool clparseIsHelp(void) {
+    return clparseCtxIsHelp(&clparse_global);
+}
+
+void clparsePrintHelp(void) {
+    clparseCtxPrintHelp(&clparse_global);
+}
+
+bool* clparseSubcmd(const cchar* subcmd_name, const cchar* desc) {
+    return clparseCtxSubcmd(&clparse_global, subcmd_name, desc);
+}
+
+const cchar** clparseMainArg(const cchar* name, const cchar* desc, const cchar* subcmd) {
+    return clparseCtxMainArg(&clparse_global, name, desc, subcmd);
+}
+
+const ArrayList* clparseMainArgList(const cchar* name, const cchar* desc, const cchar* subcmd) {
+    return clparseCtxMainArgList(&clparse_global, name, desc, subcmd);
+}
+
+#define T(_name, _type, _foo1, _foo2, _foo3)                                   \
+    _type* clparse##_name(                                                     \
+        const cchar* flag_name,                                                \
+        cchar short_name,                                                      \
+        _type dfault,                                                          \
+        const cchar* desc,                                                     \
+        const cchar* subcmd                                                    \
+    ) {                                                                        \
+        return clparseCtx##_name(&clparse_global, flag_name, short_name,       \
+                                 dfault, desc, subcmd);                        \
+    }                                                                          \
+    const ArrayList* clparse##_name##List(                                     \
+        const cchar* flag_name,                                                \
+        cchar short_name,                                                      \
+        _type dfault,                                                          \
+        const cchar* desc,                                                     \
+        const cchar* subcmd                                                    \
+    ) {                                                                        \
+        return clparseCtx##_name##List(&clparse_global, flag_name, short_name, \
+                                       dfault, desc, subcmd);                  \
+    }
+
+CLPARSE_TYPES(T)
+#undef T
+
 #if defined(_WIN32) && !defined(NO_USE_WIDE_ARGV)
 bool clparseGetCmdlineW(int* argc, LPWSTR** argv) {
     LPWSTR args = GetCommandLineW();
@@ -914,27 +1125,77 @@ void clparseFreeCmdlineW(const LPWSTR* argv) {
 /************************************/
 /* Static Functions Implementations */
 /************************************/
-static MainArg* clparseGetMainArg(const cchar* subcmd) {
-    MainArg* main_arg;
-
-    if (subcmd) {
-        size_t pos;
-        if (!findSubcmdPosition(&pos, subcmd)) return NULL;
-        Subcmd* subcmd = &subcommands[pos];
-        if (subcmd->main_args_len >= MAIN_ARGS_CAPACITY) {
-            clparse_err = CLPARSE_ERR_KIND_MAIN_ARGS_NUM_OVERFLOWED;
-            return NULL;
-        }
-        main_arg = &subcmd->main_args[subcmd->main_args_len++];
+static void* arenaAlloc(Clparse* cp, size_t size) {
+    size = (size + CLPARSE_ALIGN - 1) & ~(size_t)(CLPARSE_ALIGN - 1);
+
+    ClparseChunk* chunk = cp->chunks;
+    if (!chunk || chunk->cap - chunk->used < size) {
+        size_t cap = size > CLPARSE_CHUNK_SIZE ? size : CLPARSE_CHUNK_SIZE;
+        chunk = (ClparseChunk*)malloc(CLPARSE_CHUNK_HEADER + cap);
+        if (!chunk) return NULL;
+        chunk->next = cp->chunks;
+        chunk->used = 0;
+        chunk->cap = cap;
+        cp->chunks = chunk;
     }
-    else {
-        if (main_args_len >= MAIN_ARGS_CAPACITY) {
-            clparse_err = CLPARSE_ERR_KIND_MAIN_ARGS_NUM_OVERFLOWED;
-            return NULL;
+
+    void* ptr = (char*)chunk + CLPARSE_CHUNK_HEADER + chunk->used;
+    chunk->used += size;
+    memset(ptr, 0, size);
+    return ptr;
+}
+
+// stores item at the first free slot from hash
+static void placeName(NameSlot* slots, size_t cap, size_t hash, void* item) {
+    size_t slot = hash & (cap - 1);
+    while (slots[slot].item) slot = (slot + 1) & (cap - 1);
+    slots[slot].hash = hash;
+    slots[slot].item = item;
+}
+
+// A name given twice keeps resolving to its first declaration, since a
+// probe meets the earlier slot first.
+static bool nameTableAdd(NameTable* table, size_t hash, void* item) {
+    if (2 * (table->len + 1) > table->cap) {
+        size_t cap = table->cap ? 2 * table->cap : 8;
+        NameSlot* slots = (NameSlot*)calloc(cap, sizeof(NameSlot));
+        if (!slots) return false;
+
+        for (size_t i = 0; i < table->cap; ++i) {
+            if (table->slots[i].item) {
+                placeName(slots, cap, table->slots[i].hash, table->slots[i].item);
+            }
         }
-        main_arg = &main_main_args[main_args_len++];
+        free(table->slots);
+        table->slots = slots;
+        table->cap = cap;
+    }
+
+    placeName(table->slots, table->cap, hash, item);
+    ++table->len;
+    return true;
+}
+
+// NULL when subcmd names no declared subcommand
+static Subcmd* getCmd(Clparse* cp, const cchar* subcmd) {
+    return subcmd != NO_SUBCMD ? findSubcmd(cp, subcmd) : &cp->main_cmd;
+}
+
+static MainArg* clparseGetMainArg(Clparse* cp, const cchar* subcmd) {
+    Subcmd* cmd = getCmd(cp, subcmd);
+    if (!cmd) return NULL;
+
+    MainArg* main_arg = (MainArg*)arenaAlloc(cp, sizeof(MainArg));
+    if (!main_arg) {
+        cp->clparse_err = CLPARSE_INTERNAL_ERROR;
+        cp->err_msg_detail = "clparseGetMainArg";
+        return NULL;
     }
 
+    if (cmd->main_args_last) cmd->main_args_last->next = main_arg;
+    else cmd->main_args = main_arg;
+    cmd->main_args_last = main_arg;
+
     return main_arg;
 }
 
@@ -943,29 +1204,83 @@ static void deinitFlag(Flag* flag) {
         free(flag->kind.lst.items);
         flag->kind.lst.items = NULL;
         flag->kind.lst.len = 0;
+        flag->lst_cap = 0;
     }
 }
 
-static Flag* clparseGetFlag(const cchar* subcmd) {
-    Flag* flag;
+// Makes room for more items after lst->len. The buffer at least doubles
+// each time it grows, so a list flag given many times, or a long @FILE,
+// costs linear time in its values.
+static bool reserveList(ArrayList* lst, size_t* cap, size_t item_size, size_t more) {
+    if (more <= *cap - lst->len) return true;
 
-    if (subcmd != NO_SUBCMD) {
-        size_t pos;
-        if (!findSubcmdPosition(&pos, subcmd)) return NULL;
+    size_t new_cap = *cap ? *cap : 8;
+    while (new_cap - lst->len < more) new_cap *= 2;
 
-        size_t* idx = &subcommands[pos].flags_len;
-        assert(*idx < FLAG_CAPACITY);
+    void* items = realloc(lst->items, item_size * new_cap);
+    if (!items) return false;
+    lst->items = items;
+    *cap = new_cap;
+    return true;
+}
 
-        flag = &subcommands[pos].flags[(*idx)++];
-    }
-    else {
-        assert(main_flags_len < FLAG_CAPACITY);
-        flag = &main_flags[main_flags_len++];
+static size_t shortFlagHash(cchar short_name) {
+    cchar key[2] = { short_name, CSTR('\0') };
+    return clparseHash(key);
+}
+
+// Also enters the names into the (sub)command's name tables.
+static Flag* clparseGetFlag(Clparse* cp, const cchar* subcmd, const cchar* flag_name,
+                            cchar short_name) {
+    Subcmd* cmd = getCmd(cp, subcmd);
+    if (!cmd) return NULL;
+
+    Flag* flag = (Flag*)arenaAlloc(cp, sizeof(Flag));
+    if (!flag ||
+        (cstrcmp(flag_name, NO_LONG) != 0 &&
+         !nameTableAdd(&cmd->by_long, clparseHash(flag_name), flag)) ||
+        (short_name != NO_SHORT &&
+         !nameTableAdd(&cmd->by_short, shortFlagHash(short_name), flag))) {
+        cp->clparse_err = CLPARSE_INTERNAL_ERROR;
+        cp->err_msg_detail = "clparseGetFlag";
+        return NULL;
     }
+    flag->name = flag_name;
+    flag->short_name = short_name;
+
+    if (cmd->flags_last) cmd->flags_last->next = flag;
+    else cmd->flags = flag;
+    cmd->flags_last = flag;
 
     return flag;
 }
 
+static Flag* findLongFlag(const Subcmd* cmd, const cchar* name) {
+    const NameTable* table = &cmd->by_long;
+    if (!table->cap) return NULL;
+
+    size_t hash = clparseHash(name);
+    for (size_t slot = hash & (table->cap - 1); table->slots[slot].item;
+         slot = (slot + 1) & (table->cap - 1)) {
+        Flag* flag = (Flag*)table->slots[slot].item;
+        if (table->slots[slot].hash == hash && cstrcmp(flag->name, name) == 0) return flag;
+    }
+    return NULL;
+}
+
+static Flag* findShortFlag(const Subcmd* cmd, cchar short_name) {
+    const NameTable* table = &cmd->by_short;
+    if (!table->cap || short_name == NO_SHORT) return NULL;
+
+    size_t hash = shortFlagHash(short_name);
+    for (size_t slot = hash & (table->cap - 1); table->slots[slot].item;
+         slot = (slot + 1) & (table->cap - 1)) {
+        Flag* flag = (Flag*)table->slots[slot].item;
+        if (flag->short_name == short_name) return flag;
+    }
+    return NULL;
+}
+
 static size_t clparseHash(const cchar* letter) {
     uint32_t hash = 0x811c9dc5;
     const uint32_t prime = 16777619;
@@ -975,31 +1290,141 @@ static size_t clparseHash(const cchar* letter) {
     return hash ^ (hash >> 10) << 10;
 }
 
-static bool findSubcmdPosition(size_t* output, const cchar* subcmd_name) {
+static Subcmd* findSubcmd(const Clparse* cp, const cchar* subcmd_name) {
+    const NameTable* table = &cp->subcmd_names;
+    if (!table->cap) return NULL;
+
     size_t hash = clparseHash(subcmd_name);
-    HashBox* hashbox = &hash_map[hash];
+    for (size_t slot = hash & (table->cap - 1); table->slots[slot].item;
+         slot = (slot + 1) & (table->cap - 1)) {
+        Subcmd* subcmd = (Subcmd*)table->slots[slot].item;
+        if (table->slots[slot].hash == hash && cstrcmp(subcmd->name, subcmd_name) == 0) {
+            return subcmd;
+        }
+    }
+    return NULL;
+}
 
-    if (!hashbox->name) return false;
+static void freeFilesFrom(Clparse* cp) {
+    FilesFrom* next;
+    while (cp->files_from) {
+        next = cp->files_from->next;
+        free(cp->files_from);
+        cp->files_from = next;
+    }
+}
 
-    while (hashbox && cstrcmp(subcmd_name, hashbox->name) != 0) {
-        hashbox = hashbox->next;
+// The whole file in one buffer after a FilesFrom header, so every value is
+// a pointer into it and no path gets its own allocation.
+static FilesFrom* loadFilesFrom(const cchar* path, size_t* out_len) {
+#ifdef USE_WIDE_ARGV
+    FILE* file = _wfopen(path, L"rb");
+#else
+    FILE* file = fopen(path, "rb");
+#endif
+    if (!file) return NULL;
+
+    // The size is only a hint; pipes and /dev/stdin report none. One byte
+    // past it is asked for, so a file of the hinted size reads short and
+    // the buffer only grows when the hint was wrong.
+    size_t cap = 64 * 1024;
+    if (fseek(file, 0, SEEK_END) == 0) {
+        long size = ftell(file);
+        if (size >= 0) cap = (size_t)size + 2;
+        rewind(file);
     }
 
-    if (!hashbox) return false;
+    size_t len = 0, want, n;
+    char* buf = (char*)malloc(sizeof(FilesFrom) + cap);
+    while (buf) {
+        want = cap - len - 1;
+        n = fread(buf + sizeof(FilesFrom) + len, 1, want, file);
+        len += n;
+        if (n < want) break;
+        char* grown = (char*)realloc(buf, sizeof(FilesFrom) + (cap *= 2));
+        if (!grown) free(buf);
+        buf = grown;
+    }
+    bool failed = ferror(file) != 0;
+    fclose(file);
+    if (!buf || failed) {
+        free(buf);
+        return NULL;
+    }
 
-    *output = hashbox->where;
-    return true;
+#ifdef USE_WIDE_ARGV
+    // values are UTF-16 like the rest of argv; still a single allocation
+    const char* text = buf + sizeof(FilesFrom);
+    int wlen = len ? MultiByteToWideChar(CP_UTF8, 0, text, (int)len, NULL, 0) : 0;
+    char* wbuf = (char*)malloc(sizeof(FilesFrom) + sizeof(wchar_t) * (wlen + 1));
+    if (wbuf && wlen) {
+        MultiByteToWideChar(CP_UTF8, 0, text, (int)len,
+                            (wchar_t*)(wbuf + sizeof(FilesFrom)), wlen);
+    }
+    free(buf);
+    buf = wbuf;
+    len = (size_t)wlen;
+    if (!buf) return NULL;
+#endif
+
+    *out_len = len;
+    return (FilesFrom*)buf;
 }
 
-static void freeNextHashBox(HashBox* hashbox) {
-    if (!hashbox) return;
+static bool readFilesFrom(Clparse* cp, MainArg* list_arg, const cchar* path) {
+    size_t len = 0;
+    FilesFrom* files = loadFilesFrom(path, &len);
+    if (!files) {
+        cp->clparse_err = CLPARSE_ERR_KIND_FILES_FROM;
+        return false;
+    }
+    files->next = cp->files_from;
+    cp->files_from = files;
+
+    cchar* text = (cchar*)(files + 1);
+    cchar* end = text + len;
+    *end = CSTR('\0');
+
+    // NUL-separated when the file holds any NUL, else one value per line
+    cchar sep = CSTR('\n');
+    for (cchar* c = text; c < end; ++c) {
+        if (*c == CSTR('\0')) {
+            sep = CSTR('\0');
+            break;
+        }
+    }
 
-    HashBox* next = hashbox->next;
-    while (next) {
-        hashbox = next;
-        next = next->next;
-        free(hashbox);
+    // one resize of the list for the whole file
+    size_t count = 0;
+    for (cchar* c = text; c < end; ++c) count += *c == sep;
+    ++count;
+    ArrayList* lst = &list_arg->lst;
+    if (!reserveList(lst, &list_arg->lst_cap, sizeof(const cchar*), count)) {
+        cp->clparse_err = CLPARSE_INTERNAL_ERROR;
+        cp->err_msg_detail = "readFilesFrom";
+        return false;
     }
+    const cchar** items = (const cchar**)lst->items;
+
+    cchar* item = text;
+    for (cchar* c = text; c <= end; ++c) {
+        if (c < end && *c != sep) continue;
+
+        cchar* item_end = c;
+        if (sep == CSTR('\n') && item_end > item && item_end[-1] == CSTR('\r')) --item_end;
+        if (item_end > item) {
+            *item_end = CSTR('\0');
+            items[lst->len++] = item;
+        }
+        item = c + 1;
+    }
+    return true;
+}
+
+static void printFilesFromHint(const Subcmd* cmd) {
+    if (!cmd->main_args_last || !cmd->main_args_last->is_list) return;
+    cprintf(CSTR("    (@FILE or --files-from FILE reads %"CSTR_FMT" from FILE, one per line)\n"),
+        cmd->main_args_last->name);
 }
 
 static bool isTruthy(const cchar* string) {
@@ -0,0 +1,478 @@
+#ifndef _FSUTIL
+#define _FSUTIL
+
+// Small portable filesystem helpers: recursive file listing, a parallel
+// tree walker, stat, read-only memory maps and atomic replacement.
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if __STDC_VERSION__ < 202311L // on c23, bool is introduced
+#include <stdbool.h>
+#endif
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// mutexes and threads for the walker
+#include "workers.h"
+
+typedef struct {
+    char** items;
+    size_t len;
+    size_t cap;
+} FsutilList;
+
+static void fsutilListFree(FsutilList* list) {
+    for (size_t i = 0; i < list->len; ++i) free(list->items[i]);
+    free(list->items);
+    memset(list, 0, sizeof(*list));
+}
+
+// dir/name, malloc'ed
+static char* fsutilJoin(const char* dir, const char* name) {
+    size_t dir_len = strlen(dir);
+    size_t name_len = strlen(name);
+    char* path = malloc(dir_len + name_len + 2);
+    if (!path) return NULL;
+    memcpy(path, dir, dir_len);
+    path[dir_len] = '/';
+    memcpy(path + dir_len + 1, name, name_len + 1);
+    return path;
+}
+
+// takes path, a malloc'ed string, and frees it when the list cannot grow
+static bool fsutilListAdd(FsutilList* list, char* path) {
+    if (!path) return false;
+    if (list->len == list->cap) {
+        size_t cap = list->cap ? 2 * list->cap : 64;
+        char** items = realloc(list->items, cap * sizeof(char*));
+        if (!items) {
+            free(path);
+            return false;
+        }
+        list->items = items;
+        list->cap = cap;
+    }
+    list->items[list->len++] = path;
+    return true;
+}
+
+static bool fsutilListPush(FsutilList* list, const char* dir, const char* name) {
+    return fsutilListAdd(list, fsutilJoin(dir, name));
+}
+
+// case-insensitive suffix match, so `.PDF` counts as `.pdf`
+static bool fsutilHasExt(const char* name, const char* ext) {
+    size_t n = strlen(name);
+    size_t m = strlen(ext);
+    if (n < m) return false;
+    for (size_t i = 0; i < m; ++i) {
+        char c = name[n - m + i];
+        if (c >= 'A' && c <= 'Z') c = (char)(c - 'A' + 'a');
+        if (c != ext[i]) return false;
+    }
+    return true;
+}
+
+/**********/
+/* Walker */
+/**********/
+// Reports each matching file from whichever walker thread listed its
+// directory, while the other threads keep walking. It may block, which
+// holds that thread's part of the walk back.
+typedef void (*FsutilFoundFn)(const char* path, void* user);
+
+typedef struct {
+    const char* ext;   // matched against file names, unless magic is set
+    const char* magic; // looked for in the first KiB of every file
+    FsutilFoundFn found;
+    void* user;
+    WorkersMutex mutex;
+    WorkersCond has_dir;
+    char** dirs; // directories not listed yet, taken from the top
+    size_t len;
+    size_t cap;
+    int listing; // threads inside a directory, which may push more
+    bool failed;
+} FsutilWalk;
+
+// PDF readers accept junk before %PDF-, so the magic may sit past offset 0
+static bool fsutilHasMagic(const char* path, const char* magic) {
+    FILE* file = fopen(path, "rb");
+    if (!file) return false;
+    char head[1024];
+    size_t n = fread(head, 1, sizeof(head), file);
+    fclose(file);
+
+    size_t m = strlen(magic);
+    for (size_t i = 0; i + m <= n; ++i) {
+        if (memcmp(head + i, magic, m) == 0) return true;
+    }
+    return false;
+}
+
+static bool fsutilWalkFile(FsutilWalk* walk, const char* dir, const char* name) {
+    if (!walk->magic && !fsutilHasExt(name, walk->ext)) return true;
+    char* path = fsutilJoin(dir, name);
+    if (!path) return false;
+    if (!walk->magic || fsutilHasMagic(path, walk->magic)) walk->found(path, walk->user);
+    free(path);
+    return true;
+}
+
+// Lists one directory: subdirectories go to subdirs, files are matched.
+static bool fsutilWalkOne(FsutilWalk* walk, const char* dir, FsutilList* subdirs) {
+#ifdef _WIN32
+    char* pattern = fsutilJoin(dir, "*");
+    if (!pattern) return false;
+    WIN32_FIND_DATAA data;
+    HANDLE find = FindFirstFileExA(pattern, FindExInfoBasic, &data, FindExSearchNameMatch,
+                                   NULL, FIND_FIRST_EX_LARGE_FETCH);
+    free(pattern);
+    if (find == INVALID_HANDLE_VALUE) return false;
+
+    bool ok = true;
+    do {
+        const char* name = data.cFileName;
+        if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0) continue;
+        DWORD attrs = data.dwFileAttributes;
+        // junctions and directory links are not descended; one may point back up
+        if (attrs & FILE_ATTRIBUTE_DIRECTORY) {
+            if (!(attrs & FILE_ATTRIBUTE_REPARSE_POINT)) ok = fsutilListPush(subdirs, dir, name);
+        } else {
+            ok = fsutilWalkFile(walk, dir, name);
+        }
+    } while (ok && FindNextFileA(find, &data));
+    FindClose(find);
+    return ok;
+#else
+    DIR* d = opendir(dir);
+    if (!d) return false;
+
+    bool ok = true;
+    struct dirent* ent;
+    while (ok && (ent = readdir(d))) {
+        const char* name = ent->d_name;
+        if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0) continue;
+
+#ifdef DT_DIR
+        // most filesystems fill in d_type, which saves a stat per entry
+        if (ent->d_type == DT_DIR) {
+            ok = fsutilListPush(subdirs, dir, name);
+            continue;
+        }
+        if (ent->d_type == DT_REG) {
+            ok = fsutilWalkFile(walk, dir, name);
+            continue;
+        }
+#endif
+        // Links are followed to files only: a directory link may point back
+        // up the tree, and the walk would loop until ELOOP.
+        struct stat st;
+        if (fstatat(dirfd(d), name, &st, AT_SYMLINK_NOFOLLOW) != 0) {
+            // a race with a delete; skip it
+        } else if (S_ISDIR(st.st_mode)) {
+            ok = fsutilListPush(subdirs, dir, name);
+        } else if (S_ISREG(st.st_mode) ||
+                   (S_ISLNK(st.st_mode) && fstatat(dirfd(d), name, &st, 0) == 0 &&
+                    S_ISREG(st.st_mode))) {
+            ok = fsutilWalkFile(walk, dir, name);
+        }
+    }
+    closedir(d);
+    return ok;
+#endif
+}
+
+static void fsutilWalkLoop(FsutilWalk* walk) {
+    FsutilList subdirs = {0};
+
+    for (;;) {
+        workersLock(&walk->mutex);
+        while (walk->len == 0 && walk->listing > 0)
+            workersCondWait(&walk->has_dir, &walk->mutex);
+        if (walk->len == 0) {
+            workersUnlock(&walk->mutex);
+            break;
+        }
+        char* dir = walk->dirs[--walk->len];
+        ++walk->listing;
+        workersUnlock(&walk->mutex);
+
+        bool ok = fsutilWalkOne(walk, dir, &subdirs);
+        free(dir);
+
+        workersLock(&walk->mutex);
+        if (walk->len + subdirs.len > walk->cap) {
+            size_t cap = walk->cap ? 2 * walk->cap : 64;
+            while (cap < walk->len + subdirs.len) cap *= 2;
+            char** dirs = realloc(walk->dirs, cap * sizeof(char*));
+            if (dirs) {
+                walk->dirs = dirs;
+                walk->cap = cap;
+            }
+        }
+        if (subdirs.len == 0) {
+            // a leaf
+        } else if (walk->len + subdirs.len <= walk->cap) {
+            memcpy(walk->dirs + walk->len, subdirs.items, subdirs.len * sizeof(char*));
+            walk->len += subdirs.len;
+            subdirs.len = 0;
+        } else {
+            ok = false;
+        }
+        if (!ok) walk->failed = true;
+        --walk->listing;
+        workersCondBroadcast(&walk->has_dir);
+        workersUnlock(&walk->mutex);
+
+        // left over only when the stack could not grow
+        for (size_t i = 0; i < subdirs.len; ++i) free(subdirs.items[i]);
+        subdirs.len = 0;
+    }
+
+    fsutilListFree(&subdirs);
+}
+
+#ifdef _WIN32
+static DWORD WINAPI fsutilWalkMain(LPVOID arg) {
+    fsutilWalkLoop(arg);
+    return 0;
+}
+#else
+static void* fsutilWalkMain(void* arg) {
+    fsutilWalkLoop(arg);
+    return NULL;
+}
+#endif
+
+// Calls found for every file under dir ending in ext, or holding magic when
+// that is not NULL, in no particular order. The calling thread walks along
+// with threads - 1 others. Links to directories are not followed. False if
+// some directory could not be read; the rest of the tree is still walked.
+static bool fsutilWalk(const char* dir, const char* ext, const char* magic, int threads,
+                       FsutilFoundFn found, void* user) {
+    FsutilWalk walk = { .ext = ext, .magic = magic, .found = found, .user = user };
+    size_t dir_len = strlen(dir);
+    char* top = malloc(dir_len + 1);
+    walk.dirs = malloc(64 * sizeof(char*));
+    if (!top || !walk.dirs) {
+        free(top);
+        free(walk.dirs);
+        return false;
+    }
+    memcpy(top, dir, dir_len + 1);
+    walk.dirs[walk.len++] = top;
+    walk.cap = 64;
+
+    workersMutexInit(&walk.mutex);
+    workersCondInit(&walk.has_dir);
+
+    if (threads < 1) threads = 1;
+    WorkersThread* helpers = calloc((size_t)threads, sizeof(WorkersThread));
+    int started = 0;
+    for (; helpers && started < threads - 1; ++started) {
+#ifdef _WIN32
+        helpers[started] = CreateThread(NULL, 0, fsutilWalkMain, &walk, 0, NULL);
+        if (!helpers[started]) break;
+#else
+        if (pthread_create(&helpers[started], NULL, fsutilWalkMain, &walk) != 0) break;
+#endif
+    }
+
+    fsutilWalkLoop(&walk);
+    for (int i = 0; i < started; ++i) {
+#ifdef _WIN32
+        WaitForSingleObject(helpers[i], INFINITE);
+        CloseHandle(helpers[i]);
+#else
+        pthread_join(helpers[i], NULL);
+#endif
+    }
+
+    free(helpers);
+    free(walk.dirs);
+    workersCondDeinit(&walk.has_dir);
+    workersMutexDeinit(&walk.mutex);
+    return !walk.failed;
+}
+
+typedef struct {
+    FsutilList* list;
+    bool failed;
+} FsutilCollect;
+
+static void fsutilCollect(const char* path, void* user) {
+    FsutilCollect* collect = user;
+    size_t len = strlen(path);
+    char* copy = malloc(len + 1);
+    if (copy) memcpy(copy, path, len + 1);
+    if (!fsutilListAdd(collect->list, copy)) collect->failed = true;
+}
+
+static int fsutilCompare(const void* a, const void* b) {
+    return strcmp(*(char* const*)a, *(char* const*)b);
+}
+
+// every file under dir ending in ext, sorted by path; the same walk as
+// fsutilWalk on one thread, so links to directories are not followed either
+static bool fsutilListFiles(const char* dir, const char* ext, FsutilList* out) {
+    memset(out, 0, sizeof(*out));
+    FsutilCollect collect = { .list = out };
+    if (!fsutilWalk(dir, ext, NULL, 1, fsutilCollect, &collect) || collect.failed) {
+        fsutilListFree(out);
+        return false;
+    }
+    if (out->len) qsort(out->items, out->len, sizeof(char*), fsutilCompare);
+    return true;
+}
+
+// Creates the directories leading up to path, like mkdir -p on its dirname.
+// Errors are left to whoever opens path.
+static void fsutilMakeParents(char* path) {
+    for (char* p = path + 1; *p; ++p) {
+#ifdef _WIN32
+        if ((*p != '/' && *p != '\\') || p[-1] == ':') continue;
+        char c = *p;
+        *p = '\0';
+        CreateDirectoryA(path, NULL);
+#else
+        if (*p != '/') continue;
+        char c = *p;
+        *p = '\0';
+        mkdir(path, 0777);
+#endif
+        *p = c;
+    }
+}
+
+// creates dir and its parents, like mkdir -p; true if dir is a directory then
+static bool fsutilMakeDirs(const char* dir) {
+    // the trailing separator makes dir itself one of the parents
+    char* path = fsutilJoin(dir, "");
+    if (!path) return false;
+    fsutilMakeParents(path);
+    free(path);
+#ifdef _WIN32
+    DWORD attrs = GetFileAttributesA(dir);
+    return attrs != INVALID_FILE_ATTRIBUTES && (attrs & FILE_ATTRIBUTE_DIRECTORY);
+#else
+    struct stat st;
+    return stat(dir, &st) == 0 && S_ISDIR(st.st_mode);
+#endif
+}
+
+// absolute, with `.`, `..` and (outside Windows) links resolved; malloc'ed,
+// NULL if path does not exist
+static char* fsutilRealPath(const char* path) {
+#ifdef _WIN32
+    return _fullpath(NULL, path, 0);
+#else
+    return realpath(path, NULL);
+#endif
+}
+
+static bool fsutilStat(const char* path, uint64_t* mtime, uint64_t* size) {
+#ifdef _WIN32
+    WIN32_FILE_ATTRIBUTE_DATA data;
+    if (!GetFileAttributesExA(path, GetFileExInfoStandard, &data)) return false;
+    *mtime = ((uint64_t)data.ftLastWriteTime.dwHighDateTime << 32) |
+             data.ftLastWriteTime.dwLowDateTime;
+    *size = ((uint64_t)data.nFileSizeHigh << 32) | data.nFileSizeLow;
+#else
+    struct stat st;
+    if (stat(path, &st) != 0) return false;
+    *mtime = (uint64_t)st.st_mtime;
+    *size = (uint64_t)st.st_size;
+#endif
+    return true;
+}
+
+/************/
+/* File map */
+/************/
+typedef struct {
+    const unsigned char* data;
+    size_t size;
+#ifdef _WIN32
+    HANDLE file;
+    HANDLE mapping;
+#endif
+} FsutilMap;
+
+static bool fsutilMapFile(const char* path, FsutilMap* map) {
+    memset(map, 0, sizeof(*map));
+#ifdef _WIN32
+    map->file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                            FILE_ATTRIBUTE_NORMAL, NULL);
+    if (map->file == INVALID_HANDLE_VALUE) return false;
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(map->file, &size) || size.QuadPart == 0) {
+        CloseHandle(map->file);
+        return false;
+    }
+    map->mapping = CreateFileMappingA(map->file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (!map->mapping) {
+        CloseHandle(map->file);
+        return false;
+    }
+    map->data = MapViewOfFile(map->mapping, FILE_MAP_READ, 0, 0, 0);
+    if (!map->data) {
+        CloseHandle(map->mapping);
+        CloseHandle(map->file);
+        return false;
+    }
+    map->size = (size_t)size.QuadPart;
+#else
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        close(fd);
+        return false;
+    }
+    void* data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) return false;
+    map->data = data;
+    map->size = (size_t)st.st_size;
+#endif
+    return true;
+}
+
+static void fsutilUnmap(FsutilMap* map) {
+    if (!map->data) return;
+#ifdef _WIN32
+    UnmapViewOfFile(map->data);
+    CloseHandle(map->mapping);
+    CloseHandle(map->file);
+#else
+    munmap((void*)map->data, map->size);
+#endif
+    memset(map, 0, sizeof(*map));
+}
+
+// moves from over to, replacing it in one step
+static bool fsutilReplace(const char* from, const char* to) {
+#ifdef _WIN32
+    return MoveFileExA(from, to, MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+    return rename(from, to) == 0;
+#endif
+}
+
+#endif // _FSUTIL
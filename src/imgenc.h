@@ -0,0 +1,424 @@
+#ifndef _IMGENC
+#define _IMGENC
+
+// Page image encoders tuned for speed over size: PNG with a caller-chosen
+// deflate level and row filter, uncompressed baseline TIFF, and QOI.
+// They take 8-bit gray or RGB pixmaps without alpha. A non-negative
+// `bilevel_cut` packs gray samples to 1 bit per pixel where the format allows.
+
+#include <stdint.h>
+#include <string.h>
+
+#include <mupdf/fitz.h>
+
+#include "pixops.h"
+
+typedef enum {
+    IMGENC_FILTER_NONE,
+    IMGENC_FILTER_SUB,
+    IMGENC_FILTER_UP,
+    IMGENC_FILTER_AUTO, // per row, the smallest sum of absolute residuals
+} ImgencFilter;
+
+static inline void imgencPut16le(unsigned char* p, uint16_t v) {
+    p[0] = v & 0xff;
+    p[1] = v >> 8;
+}
+
+static inline void imgencPut32le(unsigned char* p, uint32_t v) {
+    p[0] = v & 0xff;
+    p[1] = (v >> 8) & 0xff;
+    p[2] = (v >> 16) & 0xff;
+    p[3] = v >> 24;
+}
+
+static inline void imgencPut32be(unsigned char* p, uint32_t v) {
+    p[0] = v >> 24;
+    p[1] = (v >> 16) & 0xff;
+    p[2] = (v >> 8) & 0xff;
+    p[3] = v & 0xff;
+}
+
+/*******/
+/* PNG */
+/*******/
+static const uint32_t imgenc_crc_table[256] = {
+    0x00000000, 0x77073096, 0xee0e612c, 0x990951ba, 0x076dc419, 0x706af48f,
+    0xe963a535, 0x9e6495a3, 0x0edb8832, 0x79dcb8a4, 0xe0d5e91e, 0x97d2d988,
+    0x09b64c2b, 0x7eb17cbd, 0xe7b82d07, 0x90bf1d91, 0x1db71064, 0x6ab020f2,
+    0xf3b97148, 0x84be41de, 0x1adad47d, 0x6ddde4eb, 0xf4d4b551, 0x83d385c7,
+    0x136c9856, 0x646ba8c0, 0xfd62f97a, 0x8a65c9ec, 0x14015c4f, 0x63066cd9,
+    0xfa0f3d63, 0x8d080df5, 0x3b6e20c8, 0x4c69105e, 0xd56041e4, 0xa2677172,
+    0x3c03e4d1, 0x4b04d447, 0xd20d85fd, 0xa50ab56b, 0x35b5a8fa, 0x42b2986c,
+    0xdbbbc9d6, 0xacbcf940, 0x32d86ce3, 0x45df5c75, 0xdcd60dcf, 0xabd13d59,
+    0x26d930ac, 0x51de003a, 0xc8d75180, 0xbfd06116, 0x21b4f4b5, 0x56b3c423,
+    0xcfba9599, 0xb8bda50f, 0x2802b89e, 0x5f058808, 0xc60cd9b2, 0xb10be924,
+    0x2f6f7c87, 0x58684c11, 0xc1611dab, 0xb6662d3d, 0x76dc4190, 0x01db7106,
+    0x98d220bc, 0xefd5102a, 0x71b18589, 0x06b6b51f, 0x9fbfe4a5, 0xe8b8d433,
+    0x7807c9a2, 0x0f00f934, 0x9609a88e, 0xe10e9818, 0x7f6a0dbb, 0x086d3d2d,
+    0x91646c97, 0xe6635c01, 0x6b6b51f4, 0x1c6c6162, 0x856530d8, 0xf262004e,
+    0x6c0695ed, 0x1b01a57b, 0x8208f4c1, 0xf50fc457, 0x65b0d9c6, 0x12b7e950,
+    0x8bbeb8ea, 0xfcb9887c, 0x62dd1ddf, 0x15da2d49, 0x8cd37cf3, 0xfbd44c65,
+    0x4db26158, 0x3ab551ce, 0xa3bc0074, 0xd4bb30e2, 0x4adfa541, 0x3dd895d7,
+    0xa4d1c46d, 0xd3d6f4fb, 0x4369e96a, 0x346ed9fc, 0xad678846, 0xda60b8d0,
+    0x44042d73, 0x33031de5, 0xaa0a4c5f, 0xdd0d7cc9, 0x5005713c, 0x270241aa,
+    0xbe0b1010, 0xc90c2086, 0x5768b525, 0x206f85b3, 0xb966d409, 0xce61e49f,
+    0x5edef90e, 0x29d9c998, 0xb0d09822, 0xc7d7a8b4, 0x59b33d17, 0x2eb40d81,
+    0xb7bd5c3b, 0xc0ba6cad, 0xedb88320, 0x9abfb3b6, 0x03b6e20c, 0x74b1d29a,
+    0xead54739, 0x9dd277af, 0x04db2615, 0x73dc1683, 0xe3630b12, 0x94643b84,
+    0x0d6d6a3e, 0x7a6a5aa8, 0xe40ecf0b, 0x9309ff9d, 0x0a00ae27, 0x7d079eb1,
+    0xf00f9344, 0x8708a3d2, 0x1e01f268, 0x6906c2fe, 0xf762575d, 0x806567cb,
+    0x196c3671, 0x6e6b06e7, 0xfed41b76, 0x89d32be0, 0x10da7a5a, 0x67dd4acc,
+    0xf9b9df6f, 0x8ebeeff9, 0x17b7be43, 0x60b08ed5, 0xd6d6a3e8, 0xa1d1937e,
+    0x38d8c2c4, 0x4fdff252, 0xd1bb67f1, 0xa6bc5767, 0x3fb506dd, 0x48b2364b,
+    0xd80d2bda, 0xaf0a1b4c, 0x36034af6, 0x41047a60, 0xdf60efc3, 0xa867df55,
+    0x316e8eef, 0x4669be79, 0xcb61b38c, 0xbc66831a, 0x256fd2a0, 0x5268e236,
+    0xcc0c7795, 0xbb0b4703, 0x220216b9, 0x5505262f, 0xc5ba3bbe, 0xb2bd0b28,
+    0x2bb45a92, 0x5cb36a04, 0xc2d7ffa7, 0xb5d0cf31, 0x2cd99e8b, 0x5bdeae1d,
+    0x9b64c2b0, 0xec63f226, 0x756aa39c, 0x026d930a, 0x9c0906a9, 0xeb0e363f,
+    0x72076785, 0x05005713, 0x95bf4a82, 0xe2b87a14, 0x7bb12bae, 0x0cb61b38,
+    0x92d28e9b, 0xe5d5be0d, 0x7cdcefb7, 0x0bdbdf21, 0x86d3d2d4, 0xf1d4e242,
+    0x68ddb3f8, 0x1fda836e, 0x81be16cd, 0xf6b9265b, 0x6fb077e1, 0x18b74777,
+    0x88085ae6, 0xff0f6a70, 0x66063bca, 0x11010b5c, 0x8f659eff, 0xf862ae69,
+    0x616bffd3, 0x166ccf45, 0xa00ae278, 0xd70dd2ee, 0x4e048354, 0x3903b3c2,
+    0xa7672661, 0xd06016f7, 0x4969474d, 0x3e6e77db, 0xaed16a4a, 0xd9d65adc,
+    0x40df0b66, 0x37d83bf0, 0xa9bcae53, 0xdebb9ec5, 0x47b2cf7f, 0x30b5ffe9,
+    0xbdbdf21c, 0xcabac28a, 0x53b39330, 0x24b4a3a6, 0xbad03605, 0xcdd70693,
+    0x54de5729, 0x23d967bf, 0xb3667a2e, 0xc4614ab8, 0x5d681b02, 0x2a6f2b94,
+    0xb40bbe37, 0xc30c8ea1, 0x5a05df1b, 0x2d02ef8d,
+};
+
+static uint32_t imgencCrc(uint32_t crc, const unsigned char* data, size_t len) {
+    crc = ~crc;
+    for (size_t i = 0; i < len; ++i)
+        crc = imgenc_crc_table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+    return ~crc;
+}
+
+static void imgencPngChunk(fz_context* ctx, fz_output* out, const char* type,
+                           const unsigned char* data, size_t len) {
+    unsigned char head[8], tail[4];
+    imgencPut32be(head, (uint32_t)len);
+    memcpy(head + 4, type, 4);
+    uint32_t crc = imgencCrc(imgencCrc(0, head + 4, 4), data, len);
+    imgencPut32be(tail, crc);
+
+    fz_write_data(ctx, out, head, 8);
+    if (len) fz_write_data(ctx, out, data, len);
+    fz_write_data(ctx, out, tail, 4);
+}
+
+static size_t imgencResidual(const unsigned char* row, size_t len) {
+    size_t sum = 0;
+    for (size_t i = 0; i < len; ++i) sum += row[i] < 128 ? row[i] : 256 - row[i];
+    return sum;
+}
+
+// writes filter type + filtered bytes of one row into dst (len + 1 bytes)
+static void imgencPngFilter(unsigned char* dst, const unsigned char* row,
+                            const unsigned char* prior, size_t len, size_t bpp,
+                            ImgencFilter filter) {
+    if (filter == IMGENC_FILTER_AUTO) {
+        // try sub and up in place, keep the smaller one (or none)
+        size_t best_sum = imgencResidual(row, len);
+        ImgencFilter best = IMGENC_FILTER_NONE;
+
+        imgencPngFilter(dst, row, prior, len, bpp, IMGENC_FILTER_SUB);
+        size_t sum = imgencResidual(dst + 1, len);
+        if (sum < best_sum) best_sum = sum, best = IMGENC_FILTER_SUB;
+
+        if (prior) {
+            imgencPngFilter(dst, row, prior, len, bpp, IMGENC_FILTER_UP);
+            sum = imgencResidual(dst + 1, len);
+            if (sum < best_sum) best_sum = sum, best = IMGENC_FILTER_UP;
+        }
+
+        if (best != IMGENC_FILTER_UP)
+            imgencPngFilter(dst, row, prior, len, bpp, best);
+        return;
+    }
+
+    if (filter == IMGENC_FILTER_UP && !prior) filter = IMGENC_FILTER_NONE;
+
+    switch (filter) {
+    case IMGENC_FILTER_SUB:
+        dst[0] = 1;
+        for (size_t i = 0; i < len; ++i)
+            dst[i + 1] = row[i] - (i >= bpp ? row[i - bpp] : 0);
+        break;
+
+    case IMGENC_FILTER_UP:
+        dst[0] = 2;
+        for (size_t i = 0; i < len; ++i) dst[i + 1] = row[i] - prior[i];
+        break;
+
+    default:
+        dst[0] = 0;
+        memcpy(dst + 1, row, len);
+        break;
+    }
+}
+
+// `level` is the deflate level, 0 (stored) to 9
+static void imgencPng(fz_context* ctx, fz_output* out, fz_pixmap* pix, int dpi,
+                      int level, ImgencFilter filter, int bilevel_cut) {
+    int w = fz_pixmap_width(ctx, pix);
+    int h = fz_pixmap_height(ctx, pix);
+    int n = fz_pixmap_components(ctx, pix);
+    ptrdiff_t stride = fz_pixmap_stride(ctx, pix);
+    const unsigned char* samples = fz_pixmap_samples(ctx, pix);
+    bool bilevel = bilevel_cut >= 0 && n == 1;
+
+    size_t row_len = bilevel ? ((size_t)w + 7) / 8 : (size_t)w * n;
+    size_t bpp = bilevel ? 1 : (size_t)n;
+    size_t raw_len = (row_len + 1) * h;
+
+    unsigned char* raw = NULL;
+    unsigned char* packed = NULL;
+    unsigned char* zdata = NULL;
+
+    fz_var(raw);
+    fz_var(packed);
+    fz_var(zdata);
+
+    fz_try(ctx) {
+        raw = fz_malloc(ctx, raw_len);
+        if (bilevel) packed = fz_malloc(ctx, row_len * 2);
+
+        const unsigned char* prior = NULL;
+        for (int y = 0; y < h; ++y) {
+            const unsigned char* row = samples + y * stride;
+            if (bilevel) {
+                // PNG gray 1-bit has 1 = white, pixopsPack has 1 = black
+                unsigned char* bits = packed + (y & 1) * row_len;
+                pixopsPack(row, bits, w, (uint8_t)bilevel_cut);
+                for (size_t i = 0; i < row_len; ++i) bits[i] = ~bits[i];
+                row = bits;
+            }
+            imgencPngFilter(raw + (row_len + 1) * y, row, prior, row_len, bpp, filter);
+            prior = row;
+        }
+
+        size_t zlen = fz_deflate_bound(ctx, raw_len);
+        zdata = fz_malloc(ctx, zlen);
+        fz_deflate(ctx, zdata, &zlen, raw, raw_len, (fz_deflate_level)level);
+
+        static const unsigned char signature[8] = {
+            0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n',
+        };
+        unsigned char ihdr[13], phys[9];
+        imgencPut32be(ihdr, w);
+        imgencPut32be(ihdr + 4, h);
+        ihdr[8] = bilevel ? 1 : 8;
+        ihdr[9] = n == 1 ? 0 : 2;
+        ihdr[10] = ihdr[11] = ihdr[12] = 0;
+        uint32_t ppm = (uint32_t)(dpi / 0.0254 + 0.5);
+        imgencPut32be(phys, ppm);
+        imgencPut32be(phys + 4, ppm);
+        phys[8] = 1;
+
+        fz_write_data(ctx, out, signature, 8);
+        imgencPngChunk(ctx, out, "IHDR", ihdr, sizeof(ihdr));
+        imgencPngChunk(ctx, out, "pHYs", phys, sizeof(phys));
+        imgencPngChunk(ctx, out, "IDAT", zdata, zlen);
+        imgencPngChunk(ctx, out, "IEND", NULL, 0);
+    }
+    fz_always(ctx) {
+        fz_free(ctx, zdata);
+        fz_free(ctx, packed);
+        fz_free(ctx, raw);
+    }
+    fz_catch(ctx) {
+        fz_rethrow(ctx);
+    }
+}
+
+/********/
+/* TIFF */
+/********/
+// Baseline little-endian TIFF, one uncompressed strip. Bilevel pages use
+// WhiteIsZero so the packed rows from pixopsPack go out unchanged.
+static void imgencTiff(fz_context* ctx, fz_output* out, fz_pixmap* pix, int dpi,
+                       int bilevel_cut) {
+    enum { SHORT = 3, LONG = 4, RATIONAL = 5, ENTRIES = 12 };
+    enum {
+        IFD_OFS = 8,
+        BPS_OFS = IFD_OFS + 2 + ENTRIES * 12 + 4,
+        XRES_OFS = BPS_OFS + 6,
+        YRES_OFS = XRES_OFS + 8,
+        DATA_OFS = YRES_OFS + 8,
+    };
+
+    int w = fz_pixmap_width(ctx, pix);
+    int h = fz_pixmap_height(ctx, pix);
+    int n = fz_pixmap_components(ctx, pix);
+    ptrdiff_t stride = fz_pixmap_stride(ctx, pix);
+    const unsigned char* samples = fz_pixmap_samples(ctx, pix);
+    bool bilevel = bilevel_cut >= 0 && n == 1;
+    size_t row_len = bilevel ? ((size_t)w + 7) / 8 : (size_t)w * n;
+
+    unsigned char head[DATA_OFS];
+    memset(head, 0, sizeof(head));
+    memcpy(head, "II*\0", 4);
+    imgencPut32le(head + 4, IFD_OFS);
+
+    unsigned char* e = head + IFD_OFS;
+    imgencPut16le(e, ENTRIES);
+    e += 2;
+#define TIFF_ENTRY(_tag, _type, _count, _value)                                \
+    do {                                                                       \
+        imgencPut16le(e, _tag);                                                \
+        imgencPut16le(e + 2, _type);                                           \
+        imgencPut32le(e + 4, _count);                                          \
+        if ((_type) == SHORT && (_count) == 1) imgencPut16le(e + 8, _value);   \
+        else imgencPut32le(e + 8, _value);                                     \
+        e += 12;                                                               \
+    } while (0)
+
+    TIFF_ENTRY(256, LONG, 1, w);
+    TIFF_ENTRY(257, LONG, 1, h);
+    if (n == 3) TIFF_ENTRY(258, SHORT, 3, BPS_OFS);
+    else TIFF_ENTRY(258, SHORT, 1, bilevel ? 1 : 8);
+    TIFF_ENTRY(259, SHORT, 1, 1);
+    TIFF_ENTRY(262, SHORT, 1, bilevel ? 0 : n == 3 ? 2 : 1);
+    TIFF_ENTRY(273, LONG, 1, DATA_OFS);
+    TIFF_ENTRY(277, SHORT, 1, n);
+    TIFF_ENTRY(278, LONG, 1, h);
+    TIFF_ENTRY(279, LONG, 1, (uint32_t)(row_len * h));
+    TIFF_ENTRY(282, RATIONAL, 1, XRES_OFS);
+    TIFF_ENTRY(283, RATIONAL, 1, YRES_OFS);
+    TIFF_ENTRY(296, SHORT, 1, 2);
+#undef TIFF_ENTRY
+    imgencPut32le(e, 0); // no next IFD
+
+    for (int i = 0; i < 3; ++i) imgencPut16le(head + BPS_OFS + 2 * i, 8);
+    imgencPut32le(head + XRES_OFS, dpi);
+    imgencPut32le(head + XRES_OFS + 4, 1);
+    imgencPut32le(head + YRES_OFS, dpi);
+    imgencPut32le(head + YRES_OFS + 4, 1);
+
+    fz_write_data(ctx, out, head, sizeof(head));
+
+    if (!bilevel && stride == (ptrdiff_t)row_len) {
+        fz_write_data(ctx, out, samples, row_len * h);
+        return;
+    }
+
+    unsigned char* row = bilevel ? fz_malloc(ctx, row_len) : NULL;
+    fz_try(ctx) {
+        for (int y = 0; y < h; ++y) {
+            if (bilevel) {
+                pixopsPack(samples + y * stride, row, w, (uint8_t)bilevel_cut);
+                fz_write_data(ctx, out, row, row_len);
+            } else {
+                fz_write_data(ctx, out, samples + y * stride, row_len);
+            }
+        }
+    }
+    fz_always(ctx) {
+        fz_free(ctx, row);
+    }
+    fz_catch(ctx) {
+        fz_rethrow(ctx);
+    }
+}
+
+/*******/
+/* QOI */
+/*******/
+// https://qoiformat.org/qoi-specification.pdf; gray pages are widened to RGB
+// since QOI only knows 3 and 4 channels.
+static void imgencQoi(fz_context* ctx, fz_output* out, fz_pixmap* pix) {
+    enum { CHUNK = 64 << 10 };
+
+    int w = fz_pixmap_width(ctx, pix);
+    int h = fz_pixmap_height(ctx, pix);
+    int n = fz_pixmap_components(ctx, pix);
+    ptrdiff_t stride = fz_pixmap_stride(ctx, pix);
+    const unsigned char* samples = fz_pixmap_samples(ctx, pix);
+
+    unsigned char head[14];
+    memcpy(head, "qoif", 4);
+    imgencPut32be(head + 4, w);
+    imgencPut32be(head + 8, h);
+    head[12] = 3;
+    head[13] = 0;
+    fz_write_data(ctx, out, head, sizeof(head));
+
+    unsigned char* buf = fz_malloc(ctx, CHUNK);
+    size_t len = 0;
+
+    fz_try(ctx) {
+        uint32_t index[64] = {0};
+        unsigned char pr = 0, pg = 0, pb = 0;
+        int run = 0;
+
+        for (int y = 0; y < h; ++y) {
+            const unsigned char* p = samples + y * stride;
+            for (int x = 0; x < w; ++x, p += n) {
+                unsigned char r = p[0];
+                unsigned char g = n == 3 ? p[1] : r;
+                unsigned char b = n == 3 ? p[2] : r;
+
+                // worst case op is 4 bytes, plus a pending run
+                if (len > CHUNK - 8) {
+                    fz_write_data(ctx, out, buf, len);
+                    len = 0;
+                }
+
+                if (r == pr && g == pg && b == pb) {
+                    if (++run == 62) {
+                        buf[len++] = 0xc0 | (run - 1);
+                        run = 0;
+                    }
+                    continue;
+                }
+                if (run > 0) {
+                    buf[len++] = 0xc0 | (run - 1);
+                    run = 0;
+                }
+
+                uint32_t px = (uint32_t)r << 24 | (uint32_t)g << 16 | (uint32_t)b << 8 | 0xff;
+                int hash = (r * 3 + g * 5 + b * 7 + 255 * 11) % 64;
+                if (index[hash] == px) {
+                    buf[len++] = (unsigned char)hash;
+                } else {
+                    index[hash] = px;
+                    signed char vr = (signed char)(r - pr);
+                    signed char vg = (signed char)(g - pg);
+                    signed char vb = (signed char)(b - pb);
+                    signed char vg_r = vr - vg;
+                    signed char vg_b = vb - vg;
+
+                    if (vr > -3 && vr < 2 && vg > -3 && vg < 2 && vb > -3 && vb < 2) {
+                        buf[len++] = 0x40 | (vr + 2) << 4 | (vg + 2) << 2 | (vb + 2);
+                    } else if (vg_r > -9 && vg_r < 8 && vg > -33 && vg < 32 &&
+                               vg_b > -9 && vg_b < 8) {
+                        buf[len++] = 0x80 | (vg + 32);
+                        buf[len++] = (vg_r + 8) << 4 | (vg_b + 8);
+                    } else {
+                        buf[len++] = 0xfe;
+                        buf[len++] = r;
+                        buf[len++] = g;
+                        buf[len++] = b;
+                    }
+                }
+
+                pr = r, pg = g, pb = b;
+            }
+        }
+        if (run > 0) buf[len++] = 0xc0 | (run - 1);
+
+        static const unsigned char end[8] = { 0, 0, 0, 0, 0, 0, 0, 1 };
+        fz_write_data(ctx, out, buf, len);
+        fz_write_data(ctx, out, end, sizeof(end));
+    }
+    fz_always(ctx) {
+        fz_free(ctx, buf);
+    }
+    fz_catch(ctx) {
+        fz_rethrow(ctx);
+    }
+}
+
+#endif // _IMGENC
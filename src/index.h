@@ -0,0 +1,527 @@
+#ifndef _INDEX
+#define _INDEX
+
+// On-disk inverted index from terms to (document, page) postings.
+//
+// Layout, all integers little-endian:
+//   header   magic[8] n_docs:u32 n_terms:u32 docs_off:u64 terms_off:u64
+//   strings  document paths and terms, back to back
+//   postings per term, varint(doc delta) then varint(page), where the page
+//            is itself a delta when the doc delta is 0
+//   docs     n_docs  x { path_off:u64 path_len:u32 pages:u32 mtime:u64 size:u64 }
+//   terms    n_terms x { str_off:u64 post_off:u64 str_len:u32 n_postings:u32 },
+//            sorted by term bytes for binary search
+// The reader works directly on a read-only map of the file.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if __STDC_VERSION__ < 202311L // on c23, bool is introduced
+#include <stdbool.h>
+#endif
+
+#include "cefer.h"
+#include "fsutil.h"
+
+#define INDEX_MAGIC "PDUIDX01"
+#define INDEX_HEADER_SIZE 32
+#define INDEX_DOC_SIZE 32
+#define INDEX_TERM_SIZE 24
+#define INDEX_MAX_TERM 64 // longer tokens are not indexed
+
+static inline uint32_t indexGet32(const unsigned char* p) {
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static inline uint64_t indexGet64(const unsigned char* p) {
+    return (uint64_t)indexGet32(p) | (uint64_t)indexGet32(p + 4) << 32;
+}
+
+static inline void indexPut32(unsigned char* p, uint32_t v) {
+    p[0] = (unsigned char)v;
+    p[1] = (unsigned char)(v >> 8);
+    p[2] = (unsigned char)(v >> 16);
+    p[3] = (unsigned char)(v >> 24);
+}
+
+static inline void indexPut64(unsigned char* p, uint64_t v) {
+    indexPut32(p, (uint32_t)v);
+    indexPut32(p + 4, (uint32_t)(v >> 32));
+}
+
+/************/
+/* Tokenize */
+/************/
+// A term is a run of ASCII letters and digits or non-ASCII UTF-8 bytes;
+// ASCII is folded to lower case, everything else is kept as is.
+static inline bool indexIsTermByte(unsigned char c) {
+    return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+           c >= 0x80;
+}
+
+// finds the next term at or after *p; out must hold INDEX_MAX_TERM bytes
+static bool indexNextTerm(const char** p, const char* end, char* out, size_t* len) {
+    const unsigned char* s = (const unsigned char*)*p;
+    const unsigned char* e = (const unsigned char*)end;
+    for (;;) {
+        while (s < e && !indexIsTermByte(*s)) ++s;
+        if (s == e) {
+            *p = end;
+            return false;
+        }
+
+        size_t n = 0;
+        for (; s < e && indexIsTermByte(*s); ++s, ++n) {
+            if (n < INDEX_MAX_TERM)
+                out[n] = (char)((*s >= 'A' && *s <= 'Z') ? *s - 'A' + 'a' : *s);
+        }
+        if (n <= INDEX_MAX_TERM) {
+            *p = (const char*)s;
+            *len = n;
+            return true;
+        }
+    }
+}
+
+typedef struct {
+    char s[INDEX_MAX_TERM];
+    uint8_t len;
+} IndexToken;
+
+static int indexCompareToken(const void* a, const void* b) {
+    const IndexToken* x = a;
+    const IndexToken* y = b;
+    int c = memcmp(x->s, y->s, x->len < y->len ? x->len : y->len);
+    return c ? c : (int)x->len - (int)y->len;
+}
+
+// The distinct terms of text, sorted, allocated from arena; *count is
+// SIZE_MAX when out of memory.
+static IndexToken* indexPageTerms(CeferArena* arena, const char* text, size_t n,
+                                  size_t* count) {
+    IndexToken* toks = NULL;
+    size_t len = 0, cap = 0;
+    const char* p = text;
+    const char* end = text + n;
+    IndexToken tok;
+    size_t tok_len;
+
+    while (indexNextTerm(&p, end, tok.s, &tok_len)) {
+        if (len == cap) {
+            size_t grown_cap = cap ? 2 * cap : 256;
+            IndexToken* grown = ceferRealloc(arena, toks, cap * sizeof(IndexToken),
+                                             grown_cap * sizeof(IndexToken));
+            if (!grown) {
+                *count = SIZE_MAX;
+                return NULL;
+            }
+            toks = grown;
+            cap = grown_cap;
+        }
+        tok.len = (uint8_t)tok_len;
+        toks[len++] = tok;
+    }
+
+    if (len) qsort(toks, len, sizeof(IndexToken), indexCompareToken);
+    size_t unique = 0;
+    for (size_t i = 0; i < len; ++i) {
+        if (unique == 0 || indexCompareToken(&toks[unique - 1], &toks[i]) != 0)
+            toks[unique++] = toks[i];
+    }
+    *count = unique;
+    return toks;
+}
+
+/***********/
+/* Builder */
+/***********/
+typedef struct {
+    char* path;
+    uint32_t pages;
+    uint64_t mtime;
+    uint64_t size;
+} IndexDoc;
+
+typedef struct {
+    char* term;
+    uint32_t len;
+    uint64_t* keys; // doc << 32 | page
+    size_t n;
+    size_t cap;
+} IndexTerm;
+
+typedef struct {
+    IndexDoc* docs;
+    size_t n_docs;
+    IndexTerm* terms;
+    size_t n_terms;
+    size_t cap_terms;
+    uint32_t* slots; // open addressing, term index + 1
+    size_t n_slots;
+} IndexBuilder;
+
+static uint64_t indexHash(const char* s, size_t n) {
+    uint64_t h = 0xcbf29ce484222325ull;
+    for (size_t i = 0; i < n; ++i) {
+        h ^= (unsigned char)s[i];
+        h *= 0x100000001b3ull;
+    }
+    return h;
+}
+
+// n_docs documents are registered up front; their ids are their positions
+static bool indexBuilderInit(IndexBuilder* b, size_t n_docs) {
+    memset(b, 0, sizeof(*b));
+    b->docs = calloc(n_docs ? n_docs : 1, sizeof(IndexDoc));
+    b->n_docs = n_docs;
+    b->n_slots = 1 << 16;
+    b->slots = calloc(b->n_slots, sizeof(uint32_t));
+    return b->docs && b->slots;
+}
+
+static void indexBuilderDeinit(IndexBuilder* b) {
+    if (b->docs) {
+        for (size_t i = 0; i < b->n_docs; ++i) free(b->docs[i].path);
+    }
+    for (size_t i = 0; i < b->n_terms; ++i) {
+        free(b->terms[i].term);
+        free(b->terms[i].keys);
+    }
+    free(b->docs);
+    free(b->terms);
+    free(b->slots);
+    memset(b, 0, sizeof(*b));
+}
+
+static bool indexBuilderSetDoc(IndexBuilder* b, uint32_t doc, const char* path,
+                               uint32_t pages, uint64_t mtime, uint64_t size) {
+    IndexDoc* d = &b->docs[doc];
+    free(d->path);
+    d->path = strdup(path);
+    d->pages = pages;
+    d->mtime = mtime;
+    d->size = size;
+    return d->path != NULL;
+}
+
+static bool indexBuilderGrow(IndexBuilder* b) {
+    size_t n_slots = 2 * b->n_slots;
+    uint32_t* slots = calloc(n_slots, sizeof(uint32_t));
+    if (!slots) return false;
+    for (size_t i = 0; i < b->n_terms; ++i) {
+        size_t h = indexHash(b->terms[i].term, b->terms[i].len) & (n_slots - 1);
+        while (slots[h]) h = (h + 1) & (n_slots - 1);
+        slots[h] = (uint32_t)i + 1;
+    }
+    free(b->slots);
+    b->slots = slots;
+    b->n_slots = n_slots;
+    return true;
+}
+
+static bool indexBuilderAdd(IndexBuilder* b, const char* term, size_t len,
+                            uint32_t doc, uint32_t page) {
+    if (2 * (b->n_terms + 1) > b->n_slots && !indexBuilderGrow(b)) return false;
+
+    size_t h = indexHash(term, len) & (b->n_slots - 1);
+    IndexTerm* t = NULL;
+    for (; b->slots[h]; h = (h + 1) & (b->n_slots - 1)) {
+        IndexTerm* cand = &b->terms[b->slots[h] - 1];
+        if (cand->len == len && memcmp(cand->term, term, len) == 0) {
+            t = cand;
+            break;
+        }
+    }
+
+    if (!t) {
+        if (b->n_terms == b->cap_terms) {
+            size_t cap = b->cap_terms ? 2 * b->cap_terms : 4096;
+            IndexTerm* terms = realloc(b->terms, cap * sizeof(IndexTerm));
+            if (!terms) return false;
+            b->terms = terms;
+            b->cap_terms = cap;
+        }
+        t = &b->terms[b->n_terms];
+        memset(t, 0, sizeof(*t));
+        t->term = malloc(len ? len : 1);
+        if (!t->term) return false;
+        memcpy(t->term, term, len);
+        t->len = (uint32_t)len;
+        b->slots[h] = (uint32_t)++b->n_terms;
+    }
+
+    uint64_t key = (uint64_t)doc << 32 | page;
+    if (t->n && t->keys[t->n - 1] == key) return true;
+    if (t->n == t->cap) {
+        size_t cap = t->cap ? 2 * t->cap : 4;
+        uint64_t* keys = realloc(t->keys, cap * sizeof(uint64_t));
+        if (!keys) return false;
+        t->keys = keys;
+        t->cap = cap;
+    }
+    t->keys[t->n++] = key;
+    return true;
+}
+
+static int indexCompareKey(const void* a, const void* b) {
+    uint64_t x = *(const uint64_t*)a;
+    uint64_t y = *(const uint64_t*)b;
+    return (x > y) - (x < y);
+}
+
+static const IndexTerm* index_sort_terms;
+
+static int indexCompareTermIdx(const void* a, const void* b) {
+    const IndexTerm* x = &index_sort_terms[*(const uint32_t*)a];
+    const IndexTerm* y = &index_sort_terms[*(const uint32_t*)b];
+    int c = memcmp(x->term, y->term, x->len < y->len ? x->len : y->len);
+    return c ? c : (x->len > y->len) - (x->len < y->len);
+}
+
+static size_t indexPutVarint(unsigned char* p, uint64_t v) {
+    size_t n = 0;
+    while (v >= 0x80) {
+        p[n++] = (unsigned char)(v | 0x80);
+        v >>= 7;
+    }
+    p[n++] = (unsigned char)v;
+    return n;
+}
+
+// writes to path; the caller renames it into place
+static bool indexBuilderWrite(IndexBuilder* b, const char* path) {
+    FILE* f = fopen(path, "wb");
+    if (!f) return false;
+
+    uint32_t* order = malloc((b->n_terms ? b->n_terms : 1) * sizeof(uint32_t));
+    uint64_t* str_offs = malloc((b->n_docs + b->n_terms + 1) * sizeof(uint64_t));
+    uint64_t* post_offs = malloc((b->n_terms ? b->n_terms : 1) * sizeof(uint64_t));
+    unsigned char* chunk = malloc(1 << 16);
+    bool ok = order && str_offs && post_offs && chunk;
+
+    unsigned char header[INDEX_HEADER_SIZE] = {0};
+    uint64_t off = INDEX_HEADER_SIZE;
+    ok = ok && fwrite(header, 1, sizeof(header), f) == sizeof(header);
+
+    if (ok) {
+        for (size_t i = 0; i < b->n_terms; ++i) {
+            order[i] = (uint32_t)i;
+            IndexTerm* t = &b->terms[i];
+            qsort(t->keys, t->n, sizeof(uint64_t), indexCompareKey);
+        }
+        index_sort_terms = b->terms;
+        if (b->n_terms) qsort(order, b->n_terms, sizeof(uint32_t), indexCompareTermIdx);
+    }
+
+    // strings
+    for (size_t i = 0; ok && i < b->n_docs; ++i) {
+        const char* p = b->docs[i].path ? b->docs[i].path : "";
+        size_t n = strlen(p);
+        str_offs[i] = off;
+        ok = fwrite(p, 1, n, f) == n;
+        off += n;
+    }
+    for (size_t i = 0; ok && i < b->n_terms; ++i) {
+        const IndexTerm* t = &b->terms[order[i]];
+        str_offs[b->n_docs + i] = off;
+        ok = fwrite(t->term, 1, t->len, f) == t->len;
+        off += t->len;
+    }
+
+    // postings, through a chunk that is flushed before it could overflow
+    for (size_t i = 0; ok && i < b->n_terms; ++i) {
+        const IndexTerm* t = &b->terms[order[i]];
+        uint32_t prev_doc = 0, prev_page = 0;
+        size_t used = 0;
+        post_offs[i] = off;
+        for (size_t k = 0; ok && k < t->n; ++k) {
+            uint32_t doc = (uint32_t)(t->keys[k] >> 32);
+            uint32_t page = (uint32_t)t->keys[k];
+            used += indexPutVarint(chunk + used, doc - prev_doc);
+            used += indexPutVarint(chunk + used, doc == prev_doc ? page - prev_page : page);
+            prev_doc = doc;
+            prev_page = page;
+            if (used > (1 << 16) - 32) {
+                ok = fwrite(chunk, 1, used, f) == used;
+                off += used;
+                used = 0;
+            }
+        }
+        ok = ok && fwrite(chunk, 1, used, f) == used;
+        off += used;
+    }
+
+    // tables
+    uint64_t docs_off = off;
+    for (size_t i = 0; ok && i < b->n_docs; ++i) {
+        unsigned char e[INDEX_DOC_SIZE];
+        const IndexDoc* d = &b->docs[i];
+        indexPut64(e, str_offs[i]);
+        indexPut32(e + 8, (uint32_t)(d->path ? strlen(d->path) : 0));
+        indexPut32(e + 12, d->pages);
+        indexPut64(e + 16, d->mtime);
+        indexPut64(e + 24, d->size);
+        ok = fwrite(e, 1, sizeof(e), f) == sizeof(e);
+        off += sizeof(e);
+    }
+    uint64_t terms_off = off;
+    for (size_t i = 0; ok && i < b->n_terms; ++i) {
+        unsigned char e[INDEX_TERM_SIZE];
+        const IndexTerm* t = &b->terms[order[i]];
+        indexPut64(e, str_offs[b->n_docs + i]);
+        indexPut64(e + 8, post_offs[i]);
+        indexPut32(e + 16, t->len);
+        indexPut32(e + 20, (uint32_t)t->n);
+        ok = fwrite(e, 1, sizeof(e), f) == sizeof(e);
+    }
+
+    if (ok) {
+        memcpy(header, INDEX_MAGIC, 8);
+        indexPut32(header + 8, (uint32_t)b->n_docs);
+        indexPut32(header + 12, (uint32_t)b->n_terms);
+        indexPut64(header + 16, docs_off);
+        indexPut64(header + 24, terms_off);
+        ok = fseek(f, 0, SEEK_SET) == 0 && fwrite(header, 1, sizeof(header), f) == sizeof(header);
+    }
+
+    free(chunk);
+    free(post_offs);
+    free(str_offs);
+    free(order);
+    if (fclose(f) != 0) ok = false;
+    return ok;
+}
+
+/**********/
+/* Reader */
+/**********/
+typedef struct {
+    FsutilMap map;
+    uint32_t n_docs;
+    uint32_t n_terms;
+    const unsigned char* docs;
+    const unsigned char* terms;
+} IndexReader;
+
+typedef struct {
+    const unsigned char* p;
+    const unsigned char* end;
+    uint32_t left;
+    uint32_t doc;
+    uint32_t page;
+} IndexCursor;
+
+static bool indexOpen(IndexReader* r, const char* path) {
+    memset(r, 0, sizeof(*r));
+    if (!fsutilMapFile(path, &r->map)) return false;
+
+    const unsigned char* d = r->map.data;
+    size_t size = r->map.size;
+    if (size < INDEX_HEADER_SIZE || memcmp(d, INDEX_MAGIC, 8) != 0) goto bad;
+
+    r->n_docs = indexGet32(d + 8);
+    r->n_terms = indexGet32(d + 12);
+    uint64_t docs_off = indexGet64(d + 16);
+    uint64_t terms_off = indexGet64(d + 24);
+    if (docs_off > size || (size - docs_off) / INDEX_DOC_SIZE < r->n_docs) goto bad;
+    if (terms_off > size || (size - terms_off) / INDEX_TERM_SIZE < r->n_terms) goto bad;
+    r->docs = d + docs_off;
+    r->terms = d + terms_off;
+    return true;
+
+bad:
+    fsutilUnmap(&r->map);
+    return false;
+}
+
+static void indexClose(IndexReader* r) {
+    fsutilUnmap(&r->map);
+    memset(r, 0, sizeof(*r));
+}
+
+// the bytes [off, off + len) of the file, or NULL if out of bounds
+static const unsigned char* indexSlice(const IndexReader* r, uint64_t off, uint64_t len) {
+    if (off > r->map.size || len > r->map.size - off) return NULL;
+    return r->map.data + off;
+}
+
+static const char* indexDocPath(const IndexReader* r, uint32_t doc, size_t* len) {
+    const unsigned char* e = r->docs + (size_t)doc * INDEX_DOC_SIZE;
+    *len = indexGet32(e + 8);
+    return (const char*)indexSlice(r, indexGet64(e), *len);
+}
+
+static void indexDocInfo(const IndexReader* r, uint32_t doc,
+                         uint32_t* pages, uint64_t* mtime, uint64_t* size) {
+    const unsigned char* e = r->docs + (size_t)doc * INDEX_DOC_SIZE;
+    *pages = indexGet32(e + 12);
+    *mtime = indexGet64(e + 16);
+    *size = indexGet64(e + 24);
+}
+
+static const char* indexTermString(const IndexReader* r, uint32_t term, size_t* len) {
+    const unsigned char* e = r->terms + (size_t)term * INDEX_TERM_SIZE;
+    *len = indexGet32(e + 16);
+    return (const char*)indexSlice(r, indexGet64(e), *len);
+}
+
+// binary search over the sorted term table
+static bool indexFind(const IndexReader* r, const char* term, size_t len, uint32_t* out) {
+    uint32_t lo = 0, hi = r->n_terms;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        size_t n;
+        const char* s = indexTermString(r, mid, &n);
+        if (!s) return false;
+        int c = memcmp(s, term, n < len ? n : len);
+        if (c == 0) c = (n > len) - (n < len);
+        if (c == 0) {
+            *out = mid;
+            return true;
+        }
+        if (c < 0) lo = mid + 1;
+        else hi = mid;
+    }
+    return false;
+}
+
+static void indexPostings(const IndexReader* r, uint32_t term, IndexCursor* cur) {
+    const unsigned char* e = r->terms + (size_t)term * INDEX_TERM_SIZE;
+    uint64_t off = indexGet64(e + 8);
+    memset(cur, 0, sizeof(*cur));
+    if (off > r->map.size) return;
+    cur->p = r->map.data + off;
+    cur->end = r->map.data + r->map.size;
+    cur->left = indexGet32(e + 20);
+}
+
+static bool indexGetVarint(IndexCursor* cur, uint32_t* v) {
+    uint64_t x = 0;
+    for (unsigned shift = 0; cur->p < cur->end && shift < 35; shift += 7) {
+        unsigned char c = *cur->p++;
+        x |= (uint64_t)(c & 0x7f) << shift;
+        if (!(c & 0x80)) {
+            *v = (uint32_t)x;
+            return true;
+        }
+    }
+    return false;
+}
+
+// advances to the next (doc, page); false at the end or on corrupt data
+static bool indexNext(IndexCursor* cur) {
+    if (cur->left == 0) return false;
+    uint32_t dd, dp;
+    if (!indexGetVarint(cur, &dd) || !indexGetVarint(cur, &dp)) {
+        cur->left = 0;
+        return false;
+    }
+    cur->page = dd ? dp : cur->page + dp;
+    cur->doc += dd;
+    --cur->left;
+    return true;
+}
+
+#endif // _INDEX
@@ -1,6 +1,28 @@
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200809L
+#define _XOPEN_SOURCE 700 // realpath
+#endif
+
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#endif
 
 #include <mupdf/fitz.h>
 #include <mupdf/pdf.h>
@@ -12,6 +34,38 @@
 // defer in C
 #include "cefer.h"
 
+// SIMD pixmap post-processing
+#include "pixops.h"
+
+// PNG, TIFF and QOI encoders
+#include "imgenc.h"
+
+// thread pool over cloned fz_contexts
+#include "workers.h"
+
+// literal and regex search for grep
+#include "search.h"
+
+// on-disk inverted index
+#include "index.h"
+
+// direct reads from classic xref tables
+#include "xref.h"
+
+// saved xref and page list next to a PDF
+#include "sidecar.h"
+
+// page ranges and page copying, shared with libpdfutils
+#include "subpdf.h"
+
+// streamed tar and zip output
+#include "archive.h"
+
+// child processes for pool
+#define NOBDEF static inline
+#define NOB_IMPLEMENTATION
+#include "../nob.h"
+
 #define UNUSED(_val) (void)(_val)
 
 // cleanups
@@ -25,124 +79,3191 @@ static void cleanCtx(void* ctx_p) {
     if (ctx) fz_drop_context(ctx);
 }
 
-// ex: 3-5,8,10-12
-const int* parseRange(const char* range_str, int page_count, int* count) {
-    int cap = 32, n = 0;
-    int* output = malloc(sizeof(int) * cap);
-    bool cleanup = false;
-    DEFER_IF(&cleanup, free, output);
+// render: rasterize pages and encode them on a worker pool
+typedef enum {
+    RENDER_FORMAT_PAM,
+    RENDER_FORMAT_PGM,
+    RENDER_FORMAT_PPM,
+    RENDER_FORMAT_PBM,
+    RENDER_FORMAT_PNG,
+    RENDER_FORMAT_TIFF,
+    RENDER_FORMAT_QOI,
+} RenderFormat;
 
-    const char* ptr = range_str;
+typedef enum {
+    RENDER_COLOR_AUTO,
+    RENDER_COLOR_RGB,
+    RENDER_COLOR_GRAY,
+    RENDER_COLOR_MONO,
+} RenderColor;
 
-    while (*ptr) {
-        while (isspace(*ptr) || *ptr == ',') ++ptr;
-        if (!*ptr) break;
+typedef struct {
+    RenderFormat format;
+    RenderColor color;
+    uint32_t dpi;
+    int aa_level;   // negative keeps the MuPDF default
+    bool no_icc;
+    bool no_annots;
+    bool luma;      // render RGB, then convert to gray with pixopsRgbToGray
+    int threshold;  // bitonal cut, negative picks one per page with Otsu
+    bool tone;
+    uint8_t tone_lut[256];
+    int png_level;
+    ImgencFilter png_filter;
+} RenderOpts;
 
-        char* end_ptr;
-        long start = strtol(ptr, &end_ptr, 10);
-        if (end_ptr == ptr || start <= 0 || start > page_count) {
-            cleanup = true;
-            return NULL;
-        }
+static bool parseRenderFormat(const char* name, RenderFormat* format) {
+    if (strcmp(name, "pam") == 0)      *format = RENDER_FORMAT_PAM;
+    else if (strcmp(name, "pgm") == 0) *format = RENDER_FORMAT_PGM;
+    else if (strcmp(name, "ppm") == 0) *format = RENDER_FORMAT_PPM;
+    else if (strcmp(name, "pbm") == 0) *format = RENDER_FORMAT_PBM;
+    else if (strcmp(name, "png") == 0) *format = RENDER_FORMAT_PNG;
+    else if (strcmp(name, "tiff") == 0) *format = RENDER_FORMAT_TIFF;
+    else if (strcmp(name, "qoi") == 0) *format = RENDER_FORMAT_QOI;
+    else return false;
+    return true;
+}
 
-        ptr = end_ptr;
-        int end = start;
-        if (*ptr == '-') {
-            end = strtol(++ptr, &end_ptr, 10);
-            if (end_ptr == ptr || end <= 0 || end < start) {
-                cleanup = true;
-                return NULL;
-            }
-            ptr = end_ptr;
+static bool parsePngFilter(const char* name, ImgencFilter* filter) {
+    if (strcmp(name, "none") == 0)      *filter = IMGENC_FILTER_NONE;
+    else if (strcmp(name, "sub") == 0)  *filter = IMGENC_FILTER_SUB;
+    else if (strcmp(name, "up") == 0)   *filter = IMGENC_FILTER_UP;
+    else if (strcmp(name, "auto") == 0) *filter = IMGENC_FILTER_AUTO;
+    else return false;
+    return true;
+}
+
+// mono pages in these formats are packed to 1 bit instead of cut in place
+static bool formatPacksBits(RenderFormat format) {
+    return format == RENDER_FORMAT_PBM || format == RENDER_FORMAT_PNG ||
+           format == RENDER_FORMAT_TIFF;
+}
+
+// netpbm images can be read back one by one from a single stream
+static bool formatConcatenates(RenderFormat format) {
+    return format == RENDER_FORMAT_PAM || format == RENDER_FORMAT_PGM ||
+           format == RENDER_FORMAT_PPM || format == RENDER_FORMAT_PBM;
+}
+
+// Returns true if `pattern` has exactly one %d conversion (flags and width
+// allowed) and otherwise only `%%`, so it is safe to hand to snprintf.
+static bool isPagePattern(const char* pattern) {
+    int conversions = 0;
+    for (const char* p = pattern; *p; ++p) {
+        if (*p != '%') continue;
+        if (*++p == '%') continue;
+        while (*p == '0' || *p == '-') ++p;
+        while (isdigit((unsigned char)*p)) ++p;
+        if (*p != 'd') return false;
+        ++conversions;
+    }
+    return conversions == 1;
+}
+
+static bool parseRenderColor(const char* name, RenderColor* color) {
+    if (strcmp(name, "auto") == 0)      *color = RENDER_COLOR_AUTO;
+    else if (strcmp(name, "rgb") == 0)  *color = RENDER_COLOR_RGB;
+    else if (strcmp(name, "gray") == 0) *color = RENDER_COLOR_GRAY;
+    else if (strcmp(name, "mono") == 0) *color = RENDER_COLOR_MONO;
+    else return false;
+    return true;
+}
+
+// resolves RENDER_COLOR_AUTO and rejects pixels the format cannot hold
+static bool resolveRenderColor(RenderOpts* opts) {
+    if (opts->color == RENDER_COLOR_AUTO) {
+        switch (opts->format) {
+        case RENDER_FORMAT_PAM: opts->color = RENDER_COLOR_RGB; break;
+        case RENDER_FORMAT_PGM: opts->color = RENDER_COLOR_GRAY; break;
+        case RENDER_FORMAT_PPM: opts->color = RENDER_COLOR_RGB; break;
+        case RENDER_FORMAT_PBM: opts->color = RENDER_COLOR_MONO; break;
+        case RENDER_FORMAT_PNG:
+        case RENDER_FORMAT_TIFF:
+        case RENDER_FORMAT_QOI: opts->color = RENDER_COLOR_RGB; break;
         }
+        return true;
+    }
+
+    switch (opts->format) {
+    case RENDER_FORMAT_PAM: return true;
+    case RENDER_FORMAT_PGM: return opts->color != RENDER_COLOR_RGB;
+    case RENDER_FORMAT_PPM: return opts->color == RENDER_COLOR_RGB;
+    case RENDER_FORMAT_PBM: return opts->color != RENDER_COLOR_RGB;
+    case RENDER_FORMAT_PNG:
+    case RENDER_FORMAT_TIFF:
+    case RENDER_FORMAT_QOI: return true;
+    }
+    return false;
+}
+
+static void applyRenderSettings(fz_context* ctx, const RenderOpts* opts) {
+    if (opts->aa_level >= 0) fz_set_aa_level(ctx, opts->aa_level);
+    if (opts->no_icc) fz_disable_icc(ctx);
+    else fz_enable_icc(ctx);
+}
 
-        for (int k = start; k <= end; ++k) {
-            if (n == cap)
-                output = realloc(output, sizeof(int) * (cap <<= 1));
-            output[n++] = k - 1;
+// --threshold: a number from 0 to 255 or `otsu`
+static bool parseThreshold(const char* arg, int* threshold) {
+    if (strcmp(arg, "otsu") == 0) {
+        *threshold = -1;
+        return true;
+    }
+
+    char* end;
+    long value = strtol(arg, &end, 10);
+    if (end == arg || *end || value < 0 || value > 255) return false;
+    *threshold = (int)value;
+    return true;
+}
+
+// --levels BLACK:WHITE and --gamma G fold into one lookup table
+static bool parseTone(const char* levels, const char* gamma, RenderOpts* opts) {
+    char* end;
+    long black = 0, white = 255;
+    double g = strtod(gamma, &end);
+    if (end == gamma || *end || g <= 0) return false;
+
+    if (*levels) {
+        black = strtol(levels, &end, 10);
+        if (end == levels || *end != ':') return false;
+        const char* ptr = end + 1;
+        white = strtol(ptr, &end, 10);
+        if (end == ptr || *end) return false;
+        if (black < 0 || white > 255 || black >= white) return false;
+    }
+
+    opts->tone = g != 1.0 || black != 0 || white != 255;
+    if (opts->tone) pixopsToneLut(opts->tone_lut, (uint8_t)black, (uint8_t)white, g);
+    return true;
+}
+
+// Bitonal output is a hard cut of the gray render rather than a halftone,
+// which is what OCR and barcode decoders want to see.
+static uint8_t bitonalCut(fz_context* ctx, fz_pixmap* pix, const RenderOpts* opts) {
+    if (opts->threshold >= 0) return (uint8_t)opts->threshold;
+
+    uint64_t hist[256] = {0};
+    unsigned char* samples = fz_pixmap_samples(ctx, pix);
+    ptrdiff_t stride = fz_pixmap_stride(ctx, pix);
+    int w = fz_pixmap_width(ctx, pix);
+    int h = fz_pixmap_height(ctx, pix);
+    for (int y = 0; y < h; ++y) pixopsHistogram(samples + y * stride, w, hist);
+
+    return pixopsOtsu(hist);
+}
+
+// The post-processing stage works on the samples in place, one row at a
+// time, before anything is encoded.
+static fz_pixmap* postProcessPixmap(fz_context* ctx, fz_pixmap* pix,
+                                    const RenderOpts* opts) {
+    if (opts->luma && opts->color != RENDER_COLOR_RGB) {
+        fz_pixmap* gray = NULL;
+        fz_try(ctx) {
+            gray = fz_new_pixmap_with_bbox(ctx, fz_device_gray(ctx),
+                                           fz_pixmap_bbox(ctx, pix), NULL, 0);
+            const unsigned char* src = fz_pixmap_samples(ctx, pix);
+            unsigned char* dst = fz_pixmap_samples(ctx, gray);
+            ptrdiff_t src_stride = fz_pixmap_stride(ctx, pix);
+            ptrdiff_t dst_stride = fz_pixmap_stride(ctx, gray);
+            int w = fz_pixmap_width(ctx, pix);
+            int h = fz_pixmap_height(ctx, pix);
+            for (int y = 0; y < h; ++y)
+                pixopsRgbToGray(src + y * src_stride, dst + y * dst_stride, w);
+        }
+        fz_always(ctx) {
+            fz_drop_pixmap(ctx, pix);
         }
+        fz_catch(ctx) {
+            fz_rethrow(ctx);
+        }
+        pix = gray;
     }
 
-    *count = n;
-    return output;
+    unsigned char* samples = fz_pixmap_samples(ctx, pix);
+    ptrdiff_t stride = fz_pixmap_stride(ctx, pix);
+    int row_len = fz_pixmap_width(ctx, pix) * fz_pixmap_components(ctx, pix);
+    int h = fz_pixmap_height(ctx, pix);
+
+    if (opts->tone) {
+        for (int y = 0; y < h; ++y)
+            pixopsApplyLut(samples + y * stride, row_len, opts->tone_lut);
+    }
+
+    // packing formats cut while packing, so only cut when bytes are kept
+    if (opts->color == RENDER_COLOR_MONO && !formatPacksBits(opts->format)) {
+        uint8_t cut = bitonalCut(ctx, pix, opts);
+        for (int y = 0; y < h; ++y)
+            pixopsThreshold(samples + y * stride, row_len, cut);
+    }
+
+    return pix;
 }
 
-int main(int argc, char** argv) {
-    clparseInit("pdfutils", "PDF utilities");
-    DEFER(cleanClparse, NULL);
+static fz_pixmap* renderPage(fz_context* ctx, fz_document* doc, int page_no,
+                             const RenderOpts* opts) {
+    fz_page* page = fz_load_page(ctx, doc, page_no);
+    fz_pixmap* pix = NULL;
+    fz_matrix ctm = fz_scale(opts->dpi / 72.0f, opts->dpi / 72.0f);
+    fz_colorspace* cs = opts->color == RENDER_COLOR_RGB || opts->luma
+        ? fz_device_rgb(ctx)
+        : fz_device_gray(ctx);
 
-    bool* subpdf = clparseSubcmd("subpdf", "Extract sub-PDF");
-    const char** in_path = clparseMainArg("IN_PATH", "asdasd", "subpdf");
-    const char** range = clparseMainArg("RANGE", "asdasd", "subpdf");
-    const char** out_path = clparseStr("output", 'o', "output.pdf",
-        "output filename", "subpdf");
+    fz_try(ctx) {
+        pix = opts->no_annots
+            ? fz_new_pixmap_from_page_contents(ctx, page, ctm, cs, 0)
+            : fz_new_pixmap_from_page(ctx, page, ctm, cs, 0);
+        pix = postProcessPixmap(ctx, pix, opts);
+    }
+    fz_always(ctx) {
+        fz_drop_page(ctx, page);
+    }
+    fz_catch(ctx) {
+        fz_rethrow(ctx);
+    }
 
-    if (!clparseParse(argc, argv)) {
-        fprintf(stderr, "ERROR: parsing commandline failed\n");
-        return 1;
+    return pix;
+}
+
+// P4 rows are packed with pixopsPack at the page's cut, skipping both the
+// in-place threshold and MuPDF's halftoner.
+static void writeBitonalPbm(fz_context* ctx, fz_output* out, fz_pixmap* pix,
+                            const RenderOpts* opts) {
+    int w = fz_pixmap_width(ctx, pix);
+    int h = fz_pixmap_height(ctx, pix);
+    const unsigned char* samples = fz_pixmap_samples(ctx, pix);
+    ptrdiff_t stride = fz_pixmap_stride(ctx, pix);
+    size_t row_bytes = ((size_t)w + 7) / 8;
+    uint8_t cut = bitonalCut(ctx, pix, opts);
+
+    unsigned char* row = fz_malloc(ctx, row_bytes);
+    fz_try(ctx) {
+        fz_write_printf(ctx, out, "P4\n%d %d\n", w, h);
+        for (int y = 0; y < h; ++y) {
+            pixopsPack(samples + y * stride, row, w, cut);
+            fz_write_data(ctx, out, row, row_bytes);
+        }
+    }
+    fz_always(ctx) {
+        fz_free(ctx, row);
+    }
+    fz_catch(ctx) {
+        fz_rethrow(ctx);
     }
+}
 
-    if (clparseIsHelp()) {
-        clparsePrintHelp();
-        return 0;
+// Every netpbm image carries its own header, so pages can simply be
+// concatenated into the stream and read back one by one by the consumer.
+static void writePageImage(fz_context* ctx, fz_output* out, fz_pixmap* pix,
+                           const RenderOpts* opts) {
+    switch (opts->format) {
+    case RENDER_FORMAT_PAM:
+        fz_write_pixmap_as_pam(ctx, out, pix);
+        break;
+
+    case RENDER_FORMAT_PGM:
+    case RENDER_FORMAT_PPM:
+        fz_write_pixmap_as_pnm(ctx, out, pix);
+        break;
+
+    case RENDER_FORMAT_PBM: {
+        if (opts->color == RENDER_COLOR_MONO) {
+            writeBitonalPbm(ctx, out, pix, opts);
+            break;
+        }
+
+        fz_bitmap* bit = fz_new_bitmap_from_pixmap(ctx, pix, NULL);
+        fz_try(ctx) fz_write_bitmap_as_pbm(ctx, out, bit);
+        fz_always(ctx) fz_drop_bitmap(ctx, bit);
+        fz_catch(ctx) fz_rethrow(ctx);
+    } break;
+
+    case RENDER_FORMAT_PNG:
+        imgencPng(ctx, out, pix, opts->dpi, opts->png_level, opts->png_filter,
+                  opts->color == RENDER_COLOR_MONO ? bitonalCut(ctx, pix, opts) : -1);
+        break;
+
+    case RENDER_FORMAT_TIFF:
+        imgencTiff(ctx, out, pix, opts->dpi,
+                   opts->color == RENDER_COLOR_MONO ? bitonalCut(ctx, pix, opts) : -1);
+        break;
+
+    case RENDER_FORMAT_QOI:
+        imgencQoi(ctx, out, pix);
+        break;
     }
+}
 
-    if (!*subpdf) {
-        fprintf(stderr, "ERROR: %s\n", clparseGetErr());
-        clparsePrintHelp();
-        return 1;
+// One rendered page on its way through the encoder pool. With a page
+// pattern the worker writes the file itself; otherwise it fills `buf` and
+// the main thread appends it to the stream in page order.
+typedef struct {
+    const RenderOpts* opts;
+    fz_pixmap* pix;
+    int page_no;
+    char path[1024];
+    fz_buffer* buf;
+    bool busy;
+    bool done;
+    bool failed;
+    char err[256];
+} EncodeJob;
+
+static void encodePage(fz_context* ctx, void** local, void* arg) {
+    EncodeJob* job = arg;
+    UNUSED(local);
+    fz_output* out = NULL;
+
+    fz_var(out);
+
+    fz_try(ctx) {
+        if (job->path[0]) {
+            out = fz_new_output_with_path(ctx, job->path, 0);
+        } else {
+            job->buf = fz_new_buffer(ctx, 64 << 10);
+            out = fz_new_output_with_buffer(ctx, job->buf);
+        }
+        writePageImage(ctx, out, job->pix, job->opts);
+        fz_close_output(ctx, out);
+    }
+    fz_always(ctx) {
+        fz_drop_output(ctx, out);
+        fz_drop_pixmap(ctx, job->pix);
+        job->pix = NULL;
+    }
+    fz_catch(ctx) {
+        const char* msg = fz_caught_message(ctx);
+        snprintf(job->err, sizeof(job->err), "%s", msg ? msg : "(unknown)");
+        job->failed = true;
     }
+}
 
-    fz_context* ctx = fz_new_context(NULL, NULL, FZ_STORE_UNLIMITED);
-    if (!ctx) {
-        fprintf(stderr, "ERROR: failed initializing fz_context\n");
-        return 1;
+// waits for the job and, when streaming, appends its bytes to out
+static void finishEncodeJob(fz_context* ctx, Workers* pool, EncodeJob* job,
+                            fz_output* out) {
+    workersWait(pool, &job->done);
+    job->busy = false;
+
+    fz_buffer* buf = job->buf;
+    job->buf = NULL;
+
+    fz_try(ctx) {
+        if (job->failed)
+            fz_throw(ctx, FZ_ERROR_GENERIC, "page %d: %s", job->page_no + 1, job->err);
+        if (buf) {
+            fz_write_buffer(ctx, out, buf);
+            // hand every page to the consumer as soon as it is ready
+            fz_flush_output(ctx, out);
+        }
     }
-    DEFER(cleanCtx, ctx);
+    fz_always(ctx) {
+        fz_drop_buffer(ctx, buf);
+    }
+    fz_catch(ctx) {
+        fz_rethrow(ctx);
+    }
+}
 
-    fz_document* doc = NULL;
+static double nowSeconds(void) {
+#ifdef _WIN32
+    LARGE_INTEGER count, freq;
+    QueryPerformanceCounter(&count);
+    QueryPerformanceFrequency(&freq);
+    return (double)count.QuadPart / (double)freq.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+#endif
+}
+
+static int runSubpdf(fz_context* ctx, const char* in_path, const char* range,
+                     const char* out_path, bool sparse) {
+    Sidecar car = {0};
     pdf_document* src = NULL;
     pdf_document* dst = NULL;
+    const int* idx = NULL;
 
-    fz_try(ctx) {
-        fz_register_document_handlers(ctx);
-
-        doc = fz_open_document(ctx, *in_path);
-        if (!doc) fz_throw(ctx, FZ_ERROR_GENERIC, "cannot open document %s", *in_path);
+    fz_var(src);
+    fz_var(dst);
+    fz_var(idx);
 
-        src = pdf_specifics(ctx, doc);
-        if (!src) fz_throw(ctx, FZ_ERROR_GENERIC, "%s is not a PDF", *in_path);
+    fz_try(ctx) {
+        // with an up to date sidecar, neither the xref nor the page tree is read
+        if (sidecarOpen(ctx, in_path, &car)) {
+            src = car.doc;
+        } else {
+            // straight to the PDF opener, no other handler is registered
+            src = pdf_open_document(ctx, in_path);
+        }
 
-        int page_count = pdf_count_pages(ctx, src);
+        int page_count = car.doc ? car.page_count : pdf_count_pages(ctx, src);
         int n_idx  = 0;
-        const int* idx = parseRange(*range, page_count, &n_idx);
+        idx = subpdfParseRange(range, page_count, &n_idx);
         if (!idx || n_idx == 0) {
-            free((void*)idx);
             fz_throw(ctx, FZ_ERROR_GENERIC, "bad page range or empty");
         }
 
-        dst = pdf_create_document(ctx);
-        if (!dst) {
-            free((void*)idx);
-            fz_throw(ctx, FZ_ERROR_GENERIC, "cannot create empty PDF");
+        dst = subpdfExtract(ctx, src, car.doc ? car.pages : NULL, idx, n_idx, sparse);
+        pdf_save_document(ctx, dst, out_path, NULL);
+    }
+    fz_always(ctx) {
+        if (dst) pdf_drop_document(ctx, dst);
+        if (car.doc) sidecarClose(ctx, &car);
+        else if (src) pdf_drop_document(ctx, src);
+        free((void*)idx);
+    }
+    fz_catch(ctx) {
+        const char* msg = fz_caught_message(ctx);
+        fprintf(stderr, "ERROR: %s\n", msg ? msg : "(unknown)");
+        return 1;
+    }
+
+    printf("Wrote sub-PDF: %s\n", out_path);
+    return 0;
+}
+
+// subpdf --each-page: every page of the range as its own PDF, written as an
+// entry of one tar or zip stream instead of a file per page. The source is
+// opened once and the PDF writer feeds the entry directly.
+static int runSubpdfArchive(fz_context* ctx, const char* in_path, const char* range,
+                            const char* archive_path, bool sparse) {
+    Sidecar car = {0};
+    pdf_document* src = NULL;
+    pdf_document* dst = NULL;
+    const int* idx = NULL;
+    fz_output* out = NULL;
+    Archive ar = {0};
+    bool to_stdout = strcmp(archive_path, "-") == 0;
+    int n_idx = 0;
+    int result = 0;
+
+    fz_var(src);
+    fz_var(dst);
+    fz_var(idx);
+    fz_var(out);
+    fz_var(n_idx);
+
+#ifdef _WIN32
+    if (to_stdout) _setmode(_fileno(stdout), _O_BINARY);
+#endif
+
+    fz_try(ctx) {
+        if (sidecarOpen(ctx, in_path, &car)) {
+            src = car.doc;
+        } else {
+            src = pdf_open_document(ctx, in_path);
+        }
+
+        int page_count = car.doc ? car.page_count : pdf_count_pages(ctx, src);
+        idx = subpdfParseRange(range, page_count, &n_idx);
+        if (!idx || n_idx == 0) {
+            fz_throw(ctx, FZ_ERROR_GENERIC, "bad page range or empty");
         }
 
+        out = to_stdout ? fz_stdout(ctx) : fz_new_output_with_path(ctx, archive_path, 0);
+        archiveInit(ctx, &ar, out, fsutilHasExt(archive_path, ".zip") ? ARCHIVE_ZIP : ARCHIVE_TAR);
+
         for (int i = 0; i < n_idx; ++i) {
-            pdf_graft_page(ctx, dst, i, src, idx[i]);
+            // the position leads, so a page the range repeats still gets
+            // its own entry and the entries list in range order
+            char name[48];
+            snprintf(name, sizeof(name), "%05d-page-%05d.pdf", i + 1, idx[i] + 1);
+            dst = subpdfExtract(ctx, src, car.doc ? car.pages : NULL, &idx[i], 1, sparse);
+            pdf_write_document(ctx, dst, archiveBegin(ctx, &ar, name), NULL);
+            archiveEnd(ctx, &ar);
+            pdf_drop_document(ctx, dst);
+            dst = NULL;
         }
+        archiveFinish(ctx, &ar);
 
-        pdf_save_document(ctx, dst, *out_path, NULL);
+        if (to_stdout) fz_flush_output(ctx, out);
+        else fz_close_output(ctx, out);
     }
     fz_always(ctx) {
+        archiveDrop(ctx, &ar);
+        if (out && !to_stdout) fz_drop_output(ctx, out);
         if (dst) pdf_drop_document(ctx, dst);
-        if (src) pdf_drop_document(ctx, src);
-        if (doc) fz_drop_document(ctx, doc);
+        if (car.doc) sidecarClose(ctx, &car);
+        else if (src) pdf_drop_document(ctx, src);
+        free((void*)idx);
     }
     fz_catch(ctx) {
         const char* msg = fz_caught_message(ctx);
         fprintf(stderr, "ERROR: %s\n", msg ? msg : "(unknown)");
+        result = 1;
     }
 
-    printf("Wrote sub-PDF: %s\n", *out_path);
-    return 0;
+    // stdout carries the archive itself
+    if (result == 0 && !to_stdout) printf("Wrote %d pages to %s\n", n_idx, archive_path);
+    return result;
+}
+
+// subpdf -R: the range applied to every PDF under a directory, each written
+// to the same relative path under the output directory. Files go to the pool
+// as the walk finds them, so extraction starts while the tree is still read.
+typedef struct {
+    Workers* pool;
+    const char* range;
+    const char* out_dir;
+    size_t root_len; // cut from found paths to make them relative
+    bool sparse;
+    WorkersMutex mutex;
+    size_t found;
+    size_t failed;
+} SubpdfTree;
+
+typedef struct {
+    SubpdfTree* tree;
+    char* in_path;
+    char* out_path;
+} SubpdfTreeJob;
+
+static void extractTreeFile(fz_context* ctx, void** local, void* arg) {
+    SubpdfTreeJob* job = arg;
+    SubpdfTree* tree = job->tree;
+    UNUSED(local);
+
+    fsutilMakeParents(job->out_path);
+    bool ok = runSubpdf(ctx, job->in_path, tree->range, job->out_path, tree->sparse) == 0;
+    if (!ok) fprintf(stderr, "ERROR: in %s\n", job->in_path);
+
+    workersLock(&tree->mutex);
+    tree->failed += !ok;
+    workersUnlock(&tree->mutex);
+    free(job);
+}
+
+// called on the walker threads; blocks while the pool's queue is full
+static void submitTreeFile(const char* path, void* user) {
+    SubpdfTree* tree = user;
+    const char* rel = path + tree->root_len;
+    while (*rel == '/' || *rel == '\\') ++rel;
+
+    size_t in_len = strlen(path) + 1;
+    size_t out_len = strlen(tree->out_dir) + strlen(rel) + 2;
+    SubpdfTreeJob* job = malloc(sizeof(SubpdfTreeJob) + in_len + out_len);
+
+    workersLock(&tree->mutex);
+    ++tree->found;
+    if (!job) ++tree->failed;
+    workersUnlock(&tree->mutex);
+    if (!job) {
+        fprintf(stderr, "ERROR: out of memory for %s\n", path);
+        return;
+    }
+
+    job->tree = tree;
+    job->in_path = (char*)(job + 1);
+    job->out_path = job->in_path + in_len;
+    memcpy(job->in_path, path, in_len);
+    snprintf(job->out_path, out_len, "%s/%s", tree->out_dir, rel);
+    workersSubmit(tree->pool, extractTreeFile, job, NULL);
+}
+
+// true when path names dir or something inside it; both come from
+// fsutilRealPath, so textual prefixes are real ones
+static bool pathWithin(const char* path, const char* dir) {
+    size_t n = strlen(dir);
+#ifdef _WIN32
+    if (_strnicmp(path, dir, n) != 0) return false;
+#else
+    if (strncmp(path, dir, n) != 0) return false;
+#endif
+    // a root like `/` or `C:\` already ends in a separator
+    if (n > 0 && (dir[n - 1] == '/' || dir[n - 1] == '\\')) return true;
+    return path[n] == '\0' || path[n] == '/' || path[n] == '\\';
+}
+
+static int runSubpdfTree(fz_context* ctx, const char* dir, const char* range,
+                         const char* out_dir, bool sparse, bool sniff, int jobs) {
+    // Outputs must not be found by the walk that is writing them. The output
+    // directory is created first so that both paths can be resolved.
+    if (!fsutilMakeDirs(out_dir)) {
+        fprintf(stderr, "ERROR: cannot create directory %s\n", out_dir);
+        return 1;
+    }
+    char* real_dir = fsutilRealPath(dir);
+    char* real_out = fsutilRealPath(out_dir);
+    const char* unresolved = !real_dir ? dir : !real_out ? out_dir : NULL;
+    bool inside = !unresolved && pathWithin(real_out, real_dir);
+    free(real_dir);
+    free(real_out);
+    if (unresolved) {
+        fprintf(stderr, "ERROR: cannot resolve %s\n", unresolved);
+        return 1;
+    }
+    if (inside) {
+        fprintf(stderr, "ERROR: output directory %s is inside %s\n", out_dir, dir);
+        return 1;
+    }
+
+    if (jobs <= 0) jobs = workersDefaultCount();
+    Workers pool;
+    if (!workersInit(&pool, ctx, jobs, 2 * (size_t)jobs, NULL)) {
+        fprintf(stderr, "ERROR: failed starting worker threads\n");
+        return 1;
+    }
+
+    SubpdfTree tree = {
+        .pool = &pool,
+        .range = range,
+        .out_dir = out_dir,
+        .root_len = strlen(dir),
+        .sparse = sparse,
+    };
+    workersMutexInit(&tree.mutex);
+
+    bool walked = fsutilWalk(dir, ".pdf", sniff ? "%PDF-" : NULL, jobs, submitTreeFile, &tree);
+    workersDeinit(&pool);
+    workersMutexDeinit(&tree.mutex);
+
+    if (!walked) fprintf(stderr, "ERROR: cannot read every directory under %s\n", dir);
+    printf("%zu PDFs: %zu written, %zu failed\n", tree.found, tree.found - tree.failed,
+           tree.failed);
+    return walked && tree.failed == 0 ? 0 : 1;
+}
+
+// burst: one output per page, or per `every` pages, from a single open of
+// the source. Chunks are grafted on the main thread, which owns the source;
+// saving runs on the pool, with at most `window` chunks in flight.
+typedef struct {
+    pdf_document* doc;
+    char path[1024];
+    bool busy;
+    bool done;
+    bool failed;
+    char err[256];
+} BurstJob;
+
+static void saveBurstChunk(fz_context* ctx, void** local, void* arg) {
+    BurstJob* job = arg;
+    UNUSED(local);
+
+    fz_try(ctx) {
+        fsutilMakeParents(job->path);
+        pdf_save_document(ctx, job->doc, job->path, NULL);
+    }
+    fz_always(ctx) {
+        pdf_drop_document(ctx, job->doc);
+        job->doc = NULL;
+    }
+    fz_catch(ctx) {
+        const char* msg = fz_caught_message(ctx);
+        snprintf(job->err, sizeof(job->err), "%s", msg ? msg : "(unknown)");
+        job->failed = true;
+    }
+}
+
+static void finishBurstJob(fz_context* ctx, Workers* pool, BurstJob* job) {
+    workersWait(pool, &job->done);
+    job->busy = false;
+    if (job->failed) fz_throw(ctx, FZ_ERROR_GENERIC, "%s: %s", job->path, job->err);
+}
+
+static int runBurst(fz_context* ctx, const char* in_path, const char* pattern, int every,
+                    bool sparse, int jobs) {
+    Sidecar car = {0};
+    pdf_document* src = NULL;
+    int* idx = NULL;
+    BurstJob* slots = NULL;
+    Workers pool = {0};
+    int n_chunks = 0;
+    int window = 0;
+    int result = 0;
+
+    fz_var(src);
+    fz_var(idx);
+    fz_var(slots);
+    fz_var(n_chunks);
+
+    if (jobs <= 0) jobs = workersDefaultCount();
+    window = 2 * jobs;
+
+    fz_try(ctx) {
+        if (sidecarOpen(ctx, in_path, &car)) {
+            src = car.doc;
+        } else {
+            src = pdf_open_document(ctx, in_path);
+        }
+
+        int page_count = car.doc ? car.page_count : pdf_count_pages(ctx, src);
+        if (page_count == 0) fz_throw(ctx, FZ_ERROR_GENERIC, "document has no pages");
+        if (every > page_count) every = page_count;
+        n_chunks = (page_count + every - 1) / every;
+
+        idx = malloc(every * sizeof(int));
+        slots = calloc(window, sizeof(BurstJob));
+        if (!idx || !slots) fz_throw(ctx, FZ_ERROR_GENERIC, "out of memory");
+        if (!workersInit(&pool, ctx, jobs, window, NULL))
+            fz_throw(ctx, FZ_ERROR_GENERIC, "cannot start %d threads", jobs);
+
+        for (int c = 0; c < n_chunks; ++c) {
+            BurstJob* job = &slots[c % window];
+            if (job->busy) finishBurstJob(ctx, &pool, job);
+
+            int first = c * every;
+            int n = page_count - first < every ? page_count - first : every;
+            for (int i = 0; i < n; ++i) idx[i] = first + i;
+
+            job->failed = false;
+            snprintf(job->path, sizeof(job->path), pattern, c + 1);
+            job->doc = subpdfExtract(ctx, src, car.doc ? car.pages : NULL, idx, n, sparse);
+            job->busy = true;
+            workersSubmit(&pool, saveBurstChunk, job, &job->done);
+        }
+
+        for (int i = 0; i < window; ++i) {
+            BurstJob* job = &slots[(n_chunks + i) % window];
+            if (job->busy) finishBurstJob(ctx, &pool, job);
+        }
+    }
+    fz_always(ctx) {
+        // on failure, let whatever is still in flight finish before cleanup
+        for (int i = 0; slots && i < window; ++i) {
+            if (slots[i].busy) workersWait(&pool, &slots[i].done);
+        }
+        workersDeinit(&pool);
+        free(slots);
+        if (car.doc) sidecarClose(ctx, &car);
+        else if (src) pdf_drop_document(ctx, src);
+        free(idx);
+    }
+    fz_catch(ctx) {
+        const char* msg = fz_caught_message(ctx);
+        fprintf(stderr, "ERROR: %s\n", msg ? msg : "(unknown)");
+        result = 1;
+    }
+
+    if (result == 0) printf("Wrote %d PDFs: %s\n", n_chunks, pattern);
+    return result;
+}
+
+// split-size: consecutive pages packed into outputs of at most max_bytes.
+// Each page is charged for the objects it would add to the current output:
+// the indirect objects grafting it copies, sized as they are written, less
+// those an earlier page of the same output already brought in.
+typedef struct {
+    pdf_document* src;
+    const char* pattern;
+    size_t max_bytes;
+    int* stamp; // per object number, the last output it was charged to
+    int stamp_len;
+    int chunk;  // stamp of the output being planned
+    int out_no;
+    int written;
+    pdf_obj** stack;
+    int stack_len;
+    int stack_cap;
+} SplitSize;
+
+// header, catalog, page tree, xref and trailer of every output
+#define SPLIT_SKELETON 1024
+// "N 0 obj", "endobj" and the xref entry around each object
+#define SPLIT_OBJ_OVERHEAD 40
+
+static size_t splitObjCost(fz_context* ctx, pdf_obj* ref) {
+    pdf_obj* obj = pdf_resolve_indirect(ctx, ref);
+    char buf[256];
+    size_t len = 0;
+    char* s = pdf_sprint_obj(ctx, buf, sizeof(buf), &len, obj, 1, 0);
+    if (s != buf) fz_free(ctx, s);
+
+    // streams are copied raw, at their encoded length
+    if (pdf_is_stream(ctx, ref)) {
+        int raw = pdf_dict_get_int(ctx, obj, PDF_NAME(Length));
+        len += (raw > 0 ? (size_t)raw : 0) + sizeof("stream\nendstream\n");
+    }
+    return len + SPLIT_OBJ_OVERHEAD;
+}
+
+static void splitPush(fz_context* ctx, SplitSize* ss, pdf_obj* obj) {
+    if (!obj || (!pdf_is_indirect(ctx, obj) && !pdf_is_dict(ctx, obj) && !pdf_is_array(ctx, obj)))
+        return;
+    if (ss->stack_len == ss->stack_cap) {
+        int cap = ss->stack_cap ? 2 * ss->stack_cap : 256;
+        ss->stack = fz_realloc_array(ctx, ss->stack, cap, pdf_obj*);
+        ss->stack_cap = cap;
+    }
+    // kept: loading an object may repair the xref, which drops borrowed ones
+    ss->stack[ss->stack_len++] = pdf_keep_obj(ctx, obj);
+}
+
+// bytes page page_no adds to the output stamped ss->chunk
+static size_t splitPageCost(fz_context* ctx, SplitSize* ss, int page_no) {
+    pdf_obj* page = NULL;
+    pdf_obj* cur = NULL;
+    size_t cost = 0;
+
+    fz_var(page);
+    fz_var(cur);
+    fz_var(cost);
+
+    fz_try(ctx) {
+        page = pdf_load_object(ctx, ss->src, subpdfFindPage(ctx, ss->src, page_no));
+        cost = splitObjCost(ctx, page);
+
+        pdf_obj* keys[SUBPDF_PAGE_KEYS];
+        subpdfPageKeys(keys);
+        for (int i = 0; i < SUBPDF_PAGE_KEYS; ++i) {
+            splitPush(ctx, ss, i < SUBPDF_INHERITED ? pdf_dict_get_inheritable(ctx, page, keys[i])
+                                                    : pdf_dict_get(ctx, page, keys[i]));
+        }
+
+        while (ss->stack_len > 0) {
+            cur = ss->stack[--ss->stack_len];
+            if (pdf_is_indirect(ctx, cur)) {
+                int num = pdf_to_num(ctx, cur);
+                bool counted = num > 0 && num < ss->stamp_len && ss->stamp[num] == ss->chunk;
+                if (counted) {
+                    pdf_drop_obj(ctx, cur);
+                    cur = NULL;
+                    continue;
+                }
+                if (num > 0 && num < ss->stamp_len) ss->stamp[num] = ss->chunk;
+                cost += splitObjCost(ctx, cur);
+            }
+
+            pdf_obj* obj = pdf_resolve_indirect(ctx, cur);
+            if (pdf_is_dict(ctx, obj)) {
+                for (int i = 0, n = pdf_dict_len(ctx, obj); i < n; ++i)
+                    splitPush(ctx, ss, pdf_dict_get_val(ctx, obj, i));
+            } else if (pdf_is_array(ctx, obj)) {
+                for (int i = 0, n = pdf_array_len(ctx, obj); i < n; ++i)
+                    splitPush(ctx, ss, pdf_array_get(ctx, obj, i));
+            }
+            pdf_drop_obj(ctx, cur);
+            cur = NULL;
+        }
+    }
+    fz_always(ctx) {
+        pdf_drop_obj(ctx, cur);
+        pdf_drop_obj(ctx, page);
+    }
+    fz_catch(ctx) {
+        while (ss->stack_len > 0) pdf_drop_obj(ctx, ss->stack[--ss->stack_len]);
+        fz_rethrow(ctx);
+    }
+    return cost;
+}
+
+static void splitPlan(fz_context* ctx, SplitSize* ss, int first, int end, size_t budget,
+                      bool correct);
+
+// Writes pages [first, end) as the next output. When the real size beats the
+// estimate and `correct` is set, these pages are planned once more with the
+// budget scaled down by the miss; that second pass is written as it comes.
+static void splitWrite(fz_context* ctx, SplitSize* ss, int first, int end, size_t budget,
+                       bool correct) {
+    int* idx = NULL;
+    pdf_document* dst = NULL;
+    fz_buffer* buf = NULL;
+    fz_output* out = NULL;
+    char path[1024];
+
+    fz_var(idx);
+    fz_var(dst);
+    fz_var(buf);
+    fz_var(out);
+
+    fz_try(ctx) {
+        idx = fz_malloc_array(ctx, end - first, int);
+        for (int i = first; i < end; ++i) idx[i - first] = i;
+        // one graft map per output, as the estimate counts shared objects once
+        dst = subpdfExtract(ctx, ss->src, NULL, idx, end - first, true);
+
+        buf = fz_new_buffer(ctx, 64 << 10);
+        out = fz_new_output_with_buffer(ctx, buf);
+        pdf_write_document(ctx, dst, out, NULL);
+        fz_close_output(ctx, out);
+
+        size_t size = fz_buffer_storage(ctx, buf, NULL);
+        if (size > ss->max_bytes && end - first > 1 && correct) {
+            size_t scaled = (size_t)((double)budget * ((double)ss->max_bytes / (double)size));
+            splitPlan(ctx, ss, first, end, scaled, false);
+        } else {
+            snprintf(path, sizeof(path), ss->pattern, ss->out_no++);
+            if (size > ss->max_bytes)
+                fprintf(stderr, "WARNING: %s is %zu bytes, over the limit (pages %d-%d)\n",
+                        path, size, first + 1, end);
+            fsutilMakeParents(path);
+            fz_save_buffer(ctx, buf, path);
+            ++ss->written;
+        }
+    }
+    fz_always(ctx) {
+        fz_drop_output(ctx, out);
+        fz_drop_buffer(ctx, buf);
+        if (dst) pdf_drop_document(ctx, dst);
+        fz_free(ctx, idx);
+    }
+    fz_catch(ctx) {
+        fz_rethrow(ctx);
+    }
+}
+
+// Packs pages [first, end) greedily: a page that would take the current
+// output over budget starts the next one.
+static void splitPlan(fz_context* ctx, SplitSize* ss, int first, int end, size_t budget,
+                      bool correct) {
+    int start = first;
+    size_t bytes = 0;
+
+    ++ss->chunk;
+    for (int p = first; p < end; ++p) {
+        size_t cost = splitPageCost(ctx, ss, p);
+        if (p > start && bytes + cost > budget) {
+            splitWrite(ctx, ss, start, p, budget, correct);
+            start = p;
+            bytes = 0;
+            // charged again, now against the new output
+            ++ss->chunk;
+            cost = splitPageCost(ctx, ss, p);
+        }
+        bytes += cost;
+    }
+    splitWrite(ctx, ss, start, end, budget, correct);
+}
+
+static int runSplitSize(fz_context* ctx, const char* in_path, const char* pattern,
+                        size_t max_bytes) {
+    SplitSize ss = { .pattern = pattern, .max_bytes = max_bytes, .out_no = 1 };
+    int result = 0;
+
+    fz_var(ss.src);
+    fz_var(ss.stamp);
+    fz_var(ss.stack);
+
+    fz_try(ctx) {
+        ss.src = pdf_open_document(ctx, in_path);
+        int page_count = pdf_count_pages(ctx, ss.src);
+        if (page_count == 0) fz_throw(ctx, FZ_ERROR_GENERIC, "document has no pages");
+
+        ss.stamp_len = pdf_xref_len(ctx, ss.src);
+        ss.stamp = fz_calloc(ctx, ss.stamp_len, sizeof(int));
+        size_t budget = max_bytes > SPLIT_SKELETON ? max_bytes - SPLIT_SKELETON : 0;
+        splitPlan(ctx, &ss, 0, page_count, budget, true);
+    }
+    fz_always(ctx) {
+        fz_free(ctx, ss.stack);
+        fz_free(ctx, ss.stamp);
+        if (ss.src) pdf_drop_document(ctx, ss.src);
+    }
+    fz_catch(ctx) {
+        const char* msg = fz_caught_message(ctx);
+        fprintf(stderr, "ERROR: %s\n", msg ? msg : "(unknown)");
+        result = 1;
+    }
+
+    if (result == 0) printf("Wrote %d PDFs: %s\n", ss.written, pattern);
+    return result;
+}
+
+// Pages are rendered on the main thread in order; encoding runs on the pool
+// so it overlaps with rasterizing the next pages. At most `window` encoded
+// pages are held at once.
+static int runRender(fz_context* ctx, const char* in_path, const char* range,
+                     const char* out_path, const RenderOpts* opts, int jobs) {
+    fz_document* doc = NULL;
+    fz_output* out = NULL;
+    const int* idx = NULL;
+    EncodeJob* slots = NULL;
+    Workers pool = {0};
+    bool to_stdout = strcmp(out_path, "-") == 0;
+    bool per_page = !to_stdout && isPagePattern(out_path);
+    int n_idx = 0;
+    int window = 0;
+    int result = 0;
+
+    fz_var(doc);
+    fz_var(out);
+    fz_var(idx);
+    fz_var(slots);
+
+#ifdef _WIN32
+    if (to_stdout) _setmode(_fileno(stdout), _O_BINARY);
+#endif
+
+    if (jobs <= 0) jobs = workersDefaultCount();
+    window = 2 * jobs;
+
+    fz_try(ctx) {
+        applyRenderSettings(ctx, opts);
+
+        doc = fz_open_document(ctx, in_path);
+        if (!doc) fz_throw(ctx, FZ_ERROR_GENERIC, "cannot open document %s", in_path);
+
+        idx = subpdfParseRange(range, fz_count_pages(ctx, doc), &n_idx);
+        if (!idx || n_idx == 0)
+            fz_throw(ctx, FZ_ERROR_GENERIC, "bad page range or empty");
+        if (!per_page && n_idx > 1 && !formatConcatenates(opts->format))
+            fz_throw(ctx, FZ_ERROR_GENERIC,
+                     "one file per page needed, use an output pattern like page-%%03d");
+
+        slots = calloc(window, sizeof(EncodeJob));
+        if (!slots) fz_throw(ctx, FZ_ERROR_GENERIC, "out of memory");
+        if (!workersInit(&pool, ctx, jobs, window, NULL))
+            fz_throw(ctx, FZ_ERROR_GENERIC, "cannot start %d encoder threads", jobs);
+
+        if (!per_page)
+            out = to_stdout ? fz_stdout(ctx) : fz_new_output_with_path(ctx, out_path, 0);
+
+        for (int i = 0; i < n_idx; ++i) {
+            EncodeJob* job = &slots[i % window];
+            if (job->busy) finishEncodeJob(ctx, &pool, job, out);
+
+            job->opts = opts;
+            job->page_no = idx[i];
+            job->failed = false;
+            job->path[0] = '\0';
+            if (per_page) snprintf(job->path, sizeof(job->path), out_path, idx[i] + 1);
+            job->pix = renderPage(ctx, doc, idx[i], opts);
+            job->busy = true;
+            workersSubmit(&pool, encodePage, job, &job->done);
+        }
+
+        for (int i = 0; i < window; ++i) {
+            EncodeJob* job = &slots[(n_idx + i) % window];
+            if (job->busy) finishEncodeJob(ctx, &pool, job, out);
+        }
+
+        if (out && !to_stdout) fz_close_output(ctx, out);
+    }
+    fz_always(ctx) {
+        // on failure, let whatever is still in flight finish before cleanup
+        for (int i = 0; slots && i < window; ++i) {
+            if (slots[i].busy) workersWait(&pool, &slots[i].done);
+            fz_drop_buffer(ctx, slots[i].buf);
+        }
+        workersDeinit(&pool);
+        free(slots);
+        if (out && !to_stdout) fz_drop_output(ctx, out);
+        if (doc) fz_drop_document(ctx, doc);
+        free((void*)idx);
+    }
+    fz_catch(ctx) {
+        const char* msg = fz_caught_message(ctx);
+        fprintf(stderr, "ERROR: %s\n", msg ? msg : "(unknown)");
+        result = 1;
+    }
+
+    return result;
+}
+
+// Renders RANGE once per combination of the machine-vision settings and
+// prints pages/sec for each. Nothing is written; only rasterization and the
+// bitonal cut are timed.
+static int runRenderBench(fz_context* ctx, const char* in_path, const char* range,
+                          const RenderOpts* base) {
+    static const RenderColor colors[] = {
+        RENDER_COLOR_RGB, RENDER_COLOR_GRAY, RENDER_COLOR_MONO,
+    };
+    static const char* color_names[] = { "rgb", "gray", "mono" };
+    static const int aa_levels[] = { 8, 0 };
+
+    fz_document* doc = NULL;
+    fz_pixmap* pix = NULL;
+    const int* idx = NULL;
+    int result = 0;
+
+    fz_var(doc);
+    fz_var(pix);
+    fz_var(idx);
+
+    fz_try(ctx) {
+        doc = fz_open_document(ctx, in_path);
+        if (!doc) fz_throw(ctx, FZ_ERROR_GENERIC, "cannot open document %s", in_path);
+
+        int n_idx = 0;
+        idx = subpdfParseRange(range, fz_count_pages(ctx, doc), &n_idx);
+        if (!idx || n_idx == 0)
+            fz_throw(ctx, FZ_ERROR_GENERIC, "bad page range or empty");
+
+        printf("%-6s %-3s %-4s %-7s %10s\n", "color", "aa", "icc", "annots", "pages/sec");
+
+        for (size_t c = 0; c < sizeof(colors) / sizeof(colors[0]); ++c)
+        for (size_t a = 0; a < sizeof(aa_levels) / sizeof(aa_levels[0]); ++a)
+        for (int no_icc = 0; no_icc <= 1; ++no_icc)
+        for (int no_annots = 0; no_annots <= 1; ++no_annots) {
+            RenderOpts opts = *base;
+            opts.color = colors[c];
+            opts.aa_level = aa_levels[a];
+            opts.no_icc = no_icc;
+            opts.no_annots = no_annots;
+            applyRenderSettings(ctx, &opts);
+
+            double start = nowSeconds();
+            for (int i = 0; i < n_idx; ++i) {
+                pix = renderPage(ctx, doc, idx[i], &opts);
+                fz_drop_pixmap(ctx, pix);
+                pix = NULL;
+            }
+            double elapsed = nowSeconds() - start;
+
+            printf("%-6s %-3d %-4s %-7s %10.2f\n", color_names[c], opts.aa_level,
+                   no_icc ? "off" : "on", no_annots ? "off" : "on",
+                   elapsed > 0 ? n_idx / elapsed : 0.0);
+        }
+    }
+    fz_always(ctx) {
+        if (pix) fz_drop_pixmap(ctx, pix);
+        if (doc) fz_drop_document(ctx, doc);
+        free((void*)idx);
+    }
+    fz_catch(ctx) {
+        const char* msg = fz_caught_message(ctx);
+        fprintf(stderr, "ERROR: %s\n", msg ? msg : "(unknown)");
+        result = 1;
+    }
+
+    return result;
+}
+
+// Page jobs: every worker opens its own handle on the document, so pages
+// are loaded and interpreted in parallel; the main thread consumes the
+// results in page order, with at most `window` pages in flight.
+typedef struct {
+    char* path;
+    fz_document* doc;
+} WorkerDoc;
+
+static void dropWorkerDoc(fz_context* ctx, void* local) {
+    WorkerDoc* wd = local;
+    if (wd->doc) fz_drop_document(ctx, wd->doc);
+    free(wd->path);
+    free(wd);
+}
+
+// returns this worker's handle on path, reopening when the path changes
+static fz_document* workerDocument(fz_context* ctx, void** local, const char* path) {
+    WorkerDoc* wd = *local;
+    if (!wd) {
+        wd = calloc(1, sizeof(WorkerDoc));
+        if (!wd) fz_throw(ctx, FZ_ERROR_GENERIC, "out of memory");
+        *local = wd;
+    }
+
+    if (wd->doc && strcmp(wd->path, path) == 0) return wd->doc;
+
+    if (wd->doc) fz_drop_document(ctx, wd->doc);
+    wd->doc = NULL;
+    free(wd->path);
+    wd->path = strdup(path);
+    if (!wd->path) fz_throw(ctx, FZ_ERROR_GENERIC, "out of memory");
+    wd->doc = fz_open_document(ctx, path);
+    return wd->doc;
+}
+
+typedef struct {
+    const char* path;
+    int page_no;
+    const void* opts;
+    fz_buffer* buf;
+    bool busy;
+    bool done;
+    bool failed;
+    char err[256];
+} PageJob;
+
+// Gets every finished job in page order. Returning false stops submitting
+// further pages; the ones already in flight are still handed over.
+typedef bool (*PageSink)(fz_context* ctx, PageJob* job, void* user);
+
+static bool finishPageJob(fz_context* ctx, Workers* pool, PageJob* job,
+                          PageSink sink, void* user) {
+    workersWait(pool, &job->done);
+    job->busy = false;
+
+    bool more = true;
+    fz_try(ctx) {
+        more = sink(ctx, job, user);
+    }
+    fz_always(ctx) {
+        fz_drop_buffer(ctx, job->buf);
+        job->buf = NULL;
+    }
+    fz_catch(ctx) {
+        fz_rethrow(ctx);
+    }
+    return more;
+}
+
+static void runPageJobs(fz_context* ctx, Workers* pool, PageJob* slots, int window,
+                        const char* path, const int* idx, int n_idx,
+                        WorkersFn fn, const void* opts, PageSink sink, void* user) {
+    bool more = true;
+    int submitted = 0;
+
+    fz_try(ctx) {
+        for (; submitted < n_idx && more; ++submitted) {
+            PageJob* job = &slots[submitted % window];
+            if (job->busy) more = finishPageJob(ctx, pool, job, sink, user);
+            if (!more) break;
+
+            job->path = path;
+            job->page_no = idx[submitted];
+            job->opts = opts;
+            job->failed = false;
+            job->busy = true;
+            workersSubmit(pool, fn, job, &job->done);
+        }
+
+        // the oldest job in flight sits right after the last one submitted
+        for (int i = submitted; i < submitted + window; ++i) {
+            PageJob* job = &slots[i % window];
+            if (job->busy) finishPageJob(ctx, pool, job, sink, user);
+        }
+    }
+    fz_catch(ctx) {
+        // let whatever is still in flight finish before the slots are reused
+        for (int i = 0; i < window; ++i) {
+            if (!slots[i].busy) continue;
+            workersWait(pool, &slots[i].done);
+            slots[i].busy = false;
+            fz_drop_buffer(ctx, slots[i].buf);
+            slots[i].buf = NULL;
+        }
+        fz_rethrow(ctx);
+    }
+}
+
+// a missing RANGE selects every page
+static const int* selectPages(const char* range, int page_count, int* count) {
+    if (range) return subpdfParseRange(range, page_count, count);
+
+    int* output = malloc(sizeof(int) * (page_count > 0 ? page_count : 1));
+    if (!output) return NULL;
+    for (int i = 0; i < page_count; ++i) output[i] = i;
+    *count = page_count;
+    return output;
+}
+
+// text: plain UTF-8 in page order, pages separated by form feeds
+static void extractText(fz_context* ctx, void** local, void* arg) {
+    PageJob* job = arg;
+    fz_page* page = NULL;
+    fz_stext_page* stext = NULL;
+    fz_output* out = NULL;
+
+    fz_var(page);
+    fz_var(stext);
+    fz_var(out);
+
+    fz_try(ctx) {
+        fz_document* doc = workerDocument(ctx, local, job->path);
+        page = fz_load_page(ctx, doc, job->page_no);
+        stext = fz_new_stext_page_from_page(ctx, page, NULL);
+        fz_drop_page(ctx, page);
+        page = NULL;
+
+        job->buf = fz_new_buffer(ctx, 4096);
+        out = fz_new_output_with_buffer(ctx, job->buf);
+        fz_print_stext_page_as_text(ctx, out, stext);
+        fz_write_byte(ctx, out, '\f');
+        fz_close_output(ctx, out);
+    }
+    fz_always(ctx) {
+        fz_drop_output(ctx, out);
+        fz_drop_stext_page(ctx, stext);
+        fz_drop_page(ctx, page);
+    }
+    fz_catch(ctx) {
+        const char* msg = fz_caught_message(ctx);
+        snprintf(job->err, sizeof(job->err), "%s", msg ? msg : "(unknown)");
+        job->failed = true;
+    }
+}
+
+// a page that cannot be extracted is reported and left empty
+static bool writePageText(fz_context* ctx, PageJob* job, void* user) {
+    fz_output* out = user;
+    if (job->failed) {
+        fprintf(stderr, "WARNING: %s: page %d: %s\n", job->path, job->page_no + 1, job->err);
+        fz_write_byte(ctx, out, '\f');
+    } else {
+        fz_write_buffer(ctx, out, job->buf);
+    }
+    return true;
+}
+
+// Runs fn over the selected pages of in_path and hands each result to sink
+// in page order, with the output as the sink's user pointer.
+static int runPageStream(fz_context* ctx, const char* in_path, const char* range,
+                         const char* out_path, int jobs, WorkersFn fn, PageSink sink) {
+    fz_document* doc = NULL;
+    fz_output* out = NULL;
+    const int* idx = NULL;
+    PageJob* slots = NULL;
+    Workers pool = {0};
+    bool to_stdout = strcmp(out_path, "-") == 0;
+    int n_idx = 0;
+    int result = 0;
+
+    fz_var(doc);
+    fz_var(out);
+    fz_var(idx);
+    fz_var(slots);
+
+#ifdef _WIN32
+    if (to_stdout) _setmode(_fileno(stdout), _O_BINARY);
+#endif
+
+    if (jobs <= 0) jobs = workersDefaultCount();
+    int window = 2 * jobs;
+
+    fz_try(ctx) {
+        doc = fz_open_document(ctx, in_path);
+        if (!doc) fz_throw(ctx, FZ_ERROR_GENERIC, "cannot open document %s", in_path);
+
+        idx = selectPages(range, fz_count_pages(ctx, doc), &n_idx);
+        if (!idx || n_idx == 0)
+            fz_throw(ctx, FZ_ERROR_GENERIC, "bad page range or empty");
+        // the workers open their own handles
+        fz_drop_document(ctx, doc);
+        doc = NULL;
+
+        slots = calloc(window, sizeof(PageJob));
+        if (!slots) fz_throw(ctx, FZ_ERROR_GENERIC, "out of memory");
+        if (!workersInit(&pool, ctx, jobs, window, dropWorkerDoc))
+            fz_throw(ctx, FZ_ERROR_GENERIC, "cannot start %d worker threads", jobs);
+
+        out = to_stdout ? fz_stdout(ctx) : fz_new_output_with_path(ctx, out_path, 0);
+        runPageJobs(ctx, &pool, slots, window, in_path, idx, n_idx,
+                    fn, NULL, sink, out);
+
+        if (to_stdout) fz_flush_output(ctx, out);
+        else fz_close_output(ctx, out);
+    }
+    fz_always(ctx) {
+        workersDeinit(&pool);
+        free(slots);
+        if (out && !to_stdout) fz_drop_output(ctx, out);
+        if (doc) fz_drop_document(ctx, doc);
+        free((void*)idx);
+    }
+    fz_catch(ctx) {
+        const char* msg = fz_caught_message(ctx);
+        fprintf(stderr, "ERROR: %s\n", msg ? msg : "(unknown)");
+        result = 1;
+    }
+
+    return result;
+}
+
+// words: one JSON object per line for every word on the selected pages
+static void jsonAppendRune(fz_context* ctx, fz_buffer* buf, int c) {
+    switch (c) {
+    case '"': fz_append_string(ctx, buf, "\\\""); break;
+    case '\\': fz_append_string(ctx, buf, "\\\\"); break;
+    default:
+        if (c < 0x20) fz_append_printf(ctx, buf, "\\u%04x", c);
+        else fz_append_rune(ctx, buf, c);
+        break;
+    }
+}
+
+static bool isWordBreak(int c) {
+    return c <= ' ' || c == 0xa0 || c == 0x2028 || c == 0x3000;
+}
+
+static void appendWordEnd(fz_context* ctx, fz_buffer* buf, fz_rect bbox, float size) {
+    fz_append_printf(ctx, buf, "\",\"bbox\":[%g,%g,%g,%g],\"size\":%g}\n",
+                     bbox.x0, bbox.y0, bbox.x1, bbox.y1, size);
+}
+
+static void extractWords(fz_context* ctx, void** local, void* arg) {
+    PageJob* job = arg;
+    fz_page* page = NULL;
+    fz_stext_page* stext = NULL;
+
+    fz_var(page);
+    fz_var(stext);
+
+    fz_try(ctx) {
+        fz_document* doc = workerDocument(ctx, local, job->path);
+        page = fz_load_page(ctx, doc, job->page_no);
+        stext = fz_new_stext_page_from_page(ctx, page, NULL);
+        fz_drop_page(ctx, page);
+        page = NULL;
+
+        job->buf = fz_new_buffer(ctx, 16384);
+        for (fz_stext_block* block = stext->first_block; block; block = block->next) {
+            if (block->type != FZ_STEXT_BLOCK_TEXT) continue;
+            for (fz_stext_line* line = block->u.t.first_line; line; line = line->next) {
+                bool in_word = false;
+                fz_rect bbox = {0};
+                float size = 0;
+
+                for (fz_stext_char* ch = line->first_char; ch; ch = ch->next) {
+                    if (isWordBreak(ch->c)) {
+                        if (in_word) appendWordEnd(ctx, job->buf, bbox, size);
+                        in_word = false;
+                        continue;
+                    }
+                    fz_rect r = fz_rect_from_quad(ch->quad);
+                    if (!in_word) {
+                        fz_append_printf(ctx, job->buf, "{\"page\":%d,\"text\":\"",
+                                         job->page_no + 1);
+                        bbox = r;
+                        size = ch->size;
+                        in_word = true;
+                    } else {
+                        bbox = fz_union_rect(bbox, r);
+                        if (ch->size > size) size = ch->size;
+                    }
+                    jsonAppendRune(ctx, job->buf, ch->c);
+                }
+                if (in_word) appendWordEnd(ctx, job->buf, bbox, size);
+            }
+        }
+    }
+    fz_always(ctx) {
+        fz_drop_stext_page(ctx, stext);
+        fz_drop_page(ctx, page);
+    }
+    fz_catch(ctx) {
+        const char* msg = fz_caught_message(ctx);
+        snprintf(job->err, sizeof(job->err), "%s", msg ? msg : "(unknown)");
+        job->failed = true;
+    }
+}
+
+// a page that cannot be extracted is reported and contributes no words
+static bool writePageWords(fz_context* ctx, PageJob* job, void* user) {
+    fz_output* out = user;
+    if (job->failed)
+        fprintf(stderr, "WARNING: %s: page %d: %s\n", job->path, job->page_no + 1, job->err);
+    else
+        fz_write_buffer(ctx, out, job->buf);
+    return true;
+}
+
+// grep: matching text lines as file:page:line
+typedef struct {
+    const char* pattern;
+    size_t pattern_len;
+    bool regex;
+} GrepOpts;
+
+typedef struct {
+    fz_output* out;
+    bool files_only;
+    uint32_t max_count; // matching lines per file, 0 for no limit
+    uint32_t count;
+    bool stop;
+    bool matched;
+} GrepState;
+
+static void appendGrepLine(fz_context* ctx, PageJob* job, const char* line, const char* end) {
+    fz_append_printf(ctx, job->buf, "%s:%d:", job->path, job->page_no + 1);
+    fz_append_data(ctx, job->buf, line, (size_t)(end - line));
+    fz_append_byte(ctx, job->buf, '\n');
+}
+
+static void grepPage(fz_context* ctx, void** local, void* arg) {
+    PageJob* job = arg;
+    const GrepOpts* opts = job->opts;
+    fz_page* page = NULL;
+    fz_stext_page* stext = NULL;
+    fz_buffer* text = NULL;
+
+    fz_var(page);
+    fz_var(stext);
+    fz_var(text);
+
+    fz_try(ctx) {
+        fz_document* doc = workerDocument(ctx, local, job->path);
+        page = fz_load_page(ctx, doc, job->page_no);
+        stext = fz_new_stext_page_from_page(ctx, page, NULL);
+        fz_drop_page(ctx, page);
+        page = NULL;
+        text = fz_new_buffer_from_stext_page(ctx, stext);
+        fz_drop_stext_page(ctx, stext);
+        stext = NULL;
+
+        unsigned char* data;
+        size_t len = fz_buffer_storage(ctx, text, &data);
+        const char* p = (const char*)data;
+        const char* end = p + len;
+
+        job->buf = fz_new_buffer(ctx, 256);
+        while (p < end) {
+            const char* line = p;
+            const char* eol;
+            if (opts->regex) {
+                eol = memchr(line, '\n', (size_t)(end - line));
+                if (!eol) eol = end;
+                if (searchRegex(opts->pattern, line, eol)) appendGrepLine(ctx, job, line, eol);
+            } else {
+                // jump straight to the next hit, then widen it to its line
+                const char* hit = searchLiteral(p, (size_t)(end - p),
+                                                opts->pattern, opts->pattern_len);
+                if (!hit) break;
+                for (line = hit; line > p && line[-1] != '\n'; --line);
+                eol = memchr(hit, '\n', (size_t)(end - hit));
+                if (!eol) eol = end;
+                appendGrepLine(ctx, job, line, eol);
+            }
+            p = eol + 1;
+        }
+    }
+    fz_always(ctx) {
+        fz_drop_buffer(ctx, text);
+        fz_drop_stext_page(ctx, stext);
+        fz_drop_page(ctx, page);
+    }
+    fz_catch(ctx) {
+        const char* msg = fz_caught_message(ctx);
+        snprintf(job->err, sizeof(job->err), "%s", msg ? msg : "(unknown)");
+        job->failed = true;
+    }
+}
+
+// stops the document once -l or -m is satisfied
+static bool writeGrepPage(fz_context* ctx, PageJob* job, void* user) {
+    GrepState* state = user;
+    if (state->stop) return false;
+    if (job->failed) {
+        fprintf(stderr, "WARNING: %s: page %d: %s\n", job->path, job->page_no + 1, job->err);
+        return true;
+    }
+
+    unsigned char* data;
+    size_t len = fz_buffer_storage(ctx, job->buf, &data);
+    const char* p = (const char*)data;
+    const char* end = p + len;
+    if (p == end) return true;
+
+    state->matched = true;
+    if (state->files_only) {
+        fz_write_printf(ctx, state->out, "%s\n", job->path);
+        state->stop = true;
+        return false;
+    }
+
+    while (p < end) {
+        const char* eol = memchr(p, '\n', (size_t)(end - p));
+        fz_write_data(ctx, state->out, p, (size_t)(eol - p) + 1);
+        p = eol + 1;
+        if (state->max_count && ++state->count >= state->max_count) {
+            state->stop = true;
+            return false;
+        }
+    }
+    return true;
+}
+
+// exits with 0 if anything matched, like grep
+static int runGrep(fz_context* ctx, const GrepOpts* opts, const ArrayList* files,
+                   bool files_only, uint32_t max_count, int jobs) {
+    PageJob* slots = NULL;
+    Workers pool = {0};
+    GrepState state = { .files_only = files_only, .max_count = max_count };
+    int result = 0;
+
+    fz_var(slots);
+
+    if (jobs <= 0) jobs = workersDefaultCount();
+    int window = 2 * jobs;
+
+    fz_try(ctx) {
+        slots = calloc(window, sizeof(PageJob));
+        if (!slots) fz_throw(ctx, FZ_ERROR_GENERIC, "out of memory");
+        if (!workersInit(&pool, ctx, jobs, window, dropWorkerDoc))
+            fz_throw(ctx, FZ_ERROR_GENERIC, "cannot start %d worker threads", jobs);
+        state.out = fz_stdout(ctx);
+
+        for (size_t i = 0; i < files->len; ++i) {
+            const char* path = ((const char**)files->items)[i];
+            fz_document* doc = NULL;
+            const int* idx = NULL;
+            int n_idx = 0;
+
+            fz_var(doc);
+            fz_var(idx);
+
+            state.count = 0;
+            state.stop = false;
+
+            // a file that cannot be searched does not stop the others
+            fz_try(ctx) {
+                doc = fz_open_document(ctx, path);
+                idx = selectPages(NULL, fz_count_pages(ctx, doc), &n_idx);
+                if (!idx) fz_throw(ctx, FZ_ERROR_GENERIC, "out of memory");
+                fz_drop_document(ctx, doc);
+                doc = NULL;
+
+                runPageJobs(ctx, &pool, slots, window, path, idx, n_idx,
+                            grepPage, opts, writeGrepPage, &state);
+            }
+            fz_always(ctx) {
+                if (doc) fz_drop_document(ctx, doc);
+                free((void*)idx);
+            }
+            fz_catch(ctx) {
+                const char* msg = fz_caught_message(ctx);
+                fprintf(stderr, "ERROR: %s: %s\n", path, msg ? msg : "(unknown)");
+            }
+        }
+
+        fz_flush_output(ctx, state.out);
+    }
+    fz_always(ctx) {
+        workersDeinit(&pool);
+        free(slots);
+    }
+    fz_catch(ctx) {
+        const char* msg = fz_caught_message(ctx);
+        fprintf(stderr, "ERROR: %s\n", msg ? msg : "(unknown)");
+        result = 1;
+    }
+
+    if (result == 0 && !state.matched) result = 1;
+    return result;
+}
+
+// index: build, update and query an inverted index over a directory
+static void indexPage(fz_context* ctx, void** local, void* arg) {
+    PageJob* job = arg;
+    fz_page* page = NULL;
+    fz_stext_page* stext = NULL;
+    fz_buffer* text = NULL;
+    // the terms of a typical page fit on the stack, so most pages never
+    // reach malloc; kept outside the fz_try so its release is not skipped
+    DEFER_ARENA(arena, 32 * 1024);
+
+    fz_var(page);
+    fz_var(stext);
+    fz_var(text);
+
+    fz_try(ctx) {
+        fz_document* doc = workerDocument(ctx, local, job->path);
+        page = fz_load_page(ctx, doc, job->page_no);
+        stext = fz_new_stext_page_from_page(ctx, page, NULL);
+        fz_drop_page(ctx, page);
+        page = NULL;
+        text = fz_new_buffer_from_stext_page(ctx, stext);
+        fz_drop_stext_page(ctx, stext);
+        stext = NULL;
+
+        // tokenizing and deduplicating here keeps the main thread to the
+        // hash table updates
+        unsigned char* data;
+        size_t len = fz_buffer_storage(ctx, text, &data);
+        size_t count;
+        const IndexToken* toks = indexPageTerms(&arena, (const char*)data, len, &count);
+        if (count == SIZE_MAX) fz_throw(ctx, FZ_ERROR_GENERIC, "out of memory");
+
+        job->buf = fz_new_buffer(ctx, count * 8 + 1);
+        for (size_t i = 0; i < count; ++i) {
+            fz_append_data(ctx, job->buf, toks[i].s, toks[i].len);
+            fz_append_byte(ctx, job->buf, '\n');
+        }
+    }
+    fz_always(ctx) {
+        fz_drop_buffer(ctx, text);
+        fz_drop_stext_page(ctx, stext);
+        fz_drop_page(ctx, page);
+    }
+    fz_catch(ctx) {
+        const char* msg = fz_caught_message(ctx);
+        snprintf(job->err, sizeof(job->err), "%s", msg ? msg : "(unknown)");
+        job->failed = true;
+    }
+}
+
+typedef struct {
+    IndexBuilder* builder;
+    uint32_t doc;
+} IndexState;
+
+static bool addPageTerms(fz_context* ctx, PageJob* job, void* user) {
+    IndexState* state = user;
+    if (job->failed) {
+        fprintf(stderr, "WARNING: %s: page %d: %s\n", job->path, job->page_no + 1, job->err);
+        return true;
+    }
+
+    unsigned char* data;
+    size_t len = fz_buffer_storage(ctx, job->buf, &data);
+    const char* p = (const char*)data;
+    const char* end = p + len;
+    while (p < end) {
+        const char* eol = memchr(p, '\n', (size_t)(end - p));
+        if (!indexBuilderAdd(state->builder, p, (size_t)(eol - p), state->doc,
+                             (uint32_t)job->page_no))
+            fz_throw(ctx, FZ_ERROR_GENERIC, "out of memory");
+        p = eol + 1;
+    }
+    return true;
+}
+
+// position of the path [path, path + len) in the sorted file list, or -1
+static long findListedFile(const FsutilList* files, const char* path, size_t len) {
+    size_t lo = 0, hi = files->len;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        const char* item = files->items[mid];
+        int c = strncmp(item, path, len);
+        if (c == 0 && item[len] != '\0') c = 1;
+        if (c == 0) return (long)mid;
+        if (c < 0) lo = mid + 1;
+        else hi = mid;
+    }
+    return -1;
+}
+
+// Carries over every document of the old index whose mtime and size still
+// match, so only new and changed files are extracted again.
+static size_t copyUnchangedDocs(fz_context* ctx, IndexBuilder* b, const IndexReader* old,
+                                const FsutilList* files, bool* reuse) {
+    long* remap = malloc((old->n_docs ? old->n_docs : 1) * sizeof(long));
+    if (!remap) fz_throw(ctx, FZ_ERROR_GENERIC, "out of memory");
+    size_t reused = 0;
+
+    for (uint32_t d = 0; d < old->n_docs; ++d) {
+        size_t len;
+        const char* path = indexDocPath(old, d, &len);
+        uint32_t pages;
+        uint64_t mtime, size, cur_mtime, cur_size;
+        indexDocInfo(old, d, &pages, &mtime, &size);
+
+        long i = path ? findListedFile(files, path, len) : -1;
+        remap[d] = -1;
+        // an mtime of 0 marks a document that failed last time
+        if (i < 0 || reuse[i] || mtime == 0) continue;
+        if (!fsutilStat(files->items[i], &cur_mtime, &cur_size)) continue;
+        if (cur_mtime != mtime || cur_size != size) continue;
+
+        if (!indexBuilderSetDoc(b, (uint32_t)i, files->items[i], pages, mtime, size)) {
+            free(remap);
+            fz_throw(ctx, FZ_ERROR_GENERIC, "out of memory");
+        }
+        remap[d] = i;
+        reuse[i] = true;
+        ++reused;
+    }
+
+    for (uint32_t t = 0; reused && t < old->n_terms; ++t) {
+        size_t len;
+        const char* term = indexTermString(old, t, &len);
+        if (!term) continue;
+        IndexCursor cur;
+        indexPostings(old, t, &cur);
+        while (indexNext(&cur)) {
+            if (cur.doc >= old->n_docs || remap[cur.doc] < 0) continue;
+            if (!indexBuilderAdd(b, term, len, (uint32_t)remap[cur.doc], cur.page)) {
+                free(remap);
+                fz_throw(ctx, FZ_ERROR_GENERIC, "out of memory");
+            }
+        }
+    }
+
+    free(remap);
+    return reused;
+}
+
+static int runIndexBuild(fz_context* ctx, const char* dir, const char* idx_path,
+                         int jobs, bool update) {
+    FsutilList files = {0};
+    IndexBuilder builder = {0};
+    IndexReader old = {0};
+    bool* reuse = NULL;
+    PageJob* slots = NULL;
+    Workers pool = {0};
+    char tmp_path[1024];
+    size_t reused = 0;
+    int result = 0;
+
+    fz_var(reuse);
+    fz_var(slots);
+    fz_var(reused);
+
+    if (!fsutilListFiles(dir, ".pdf", &files)) {
+        fprintf(stderr, "ERROR: cannot read directory %s\n", dir);
+        return 1;
+    }
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", idx_path);
+
+    if (jobs <= 0) jobs = workersDefaultCount();
+    int window = 2 * jobs;
+
+    fz_try(ctx) {
+        reuse = calloc(files.len ? files.len : 1, sizeof(bool));
+        if (!reuse || !indexBuilderInit(&builder, files.len))
+            fz_throw(ctx, FZ_ERROR_GENERIC, "out of memory");
+
+        if (update && indexOpen(&old, idx_path)) {
+            reused = copyUnchangedDocs(ctx, &builder, &old, &files, reuse);
+            indexClose(&old);
+        }
+
+        slots = calloc(window, sizeof(PageJob));
+        if (!slots) fz_throw(ctx, FZ_ERROR_GENERIC, "out of memory");
+        if (!workersInit(&pool, ctx, jobs, window, dropWorkerDoc))
+            fz_throw(ctx, FZ_ERROR_GENERIC, "cannot start %d worker threads", jobs);
+
+        for (size_t i = 0; i < files.len; ++i) {
+            if (reuse[i]) continue;
+
+            const char* path = files.items[i];
+            IndexState state = { .builder = &builder, .doc = (uint32_t)i };
+            fz_document* doc = NULL;
+            const int* idx = NULL;
+            uint64_t mtime = 0, size = 0;
+            int n_idx = 0;
+
+            fz_var(doc);
+            fz_var(idx);
+
+            fsutilStat(path, &mtime, &size);
+            fz_try(ctx) {
+                doc = fz_open_document(ctx, path);
+                int page_count = fz_count_pages(ctx, doc);
+                idx = selectPages(NULL, page_count, &n_idx);
+                if (!idx) fz_throw(ctx, FZ_ERROR_GENERIC, "out of memory");
+                fz_drop_document(ctx, doc);
+                doc = NULL;
+
+                if (!indexBuilderSetDoc(&builder, state.doc, path, (uint32_t)page_count,
+                                        mtime, size))
+                    fz_throw(ctx, FZ_ERROR_GENERIC, "out of memory");
+                runPageJobs(ctx, &pool, slots, window, path, idx, n_idx,
+                            indexPage, NULL, addPageTerms, &state);
+            }
+            fz_always(ctx) {
+                if (doc) fz_drop_document(ctx, doc);
+                free((void*)idx);
+            }
+            fz_catch(ctx) {
+                const char* msg = fz_caught_message(ctx);
+                fprintf(stderr, "WARNING: %s: %s\n", path, msg ? msg : "(unknown)");
+                // keep it listed with mtime 0, so the next update retries it
+                indexBuilderSetDoc(&builder, state.doc, path, 0, 0, 0);
+            }
+        }
+
+        if (!indexBuilderWrite(&builder, tmp_path) || !fsutilReplace(tmp_path, idx_path)) {
+            remove(tmp_path);
+            fz_throw(ctx, FZ_ERROR_GENERIC, "cannot write index %s", idx_path);
+        }
+        fprintf(stderr, "Indexed %zu files (%zu unchanged), %zu terms\n",
+                files.len, reused, builder.n_terms);
+    }
+    fz_always(ctx) {
+        workersDeinit(&pool);
+        free(slots);
+        free(reuse);
+        indexBuilderDeinit(&builder);
+        fsutilListFree(&files);
+    }
+    fz_catch(ctx) {
+        const char* msg = fz_caught_message(ctx);
+        fprintf(stderr, "ERROR: %s\n", msg ? msg : "(unknown)");
+        result = 1;
+    }
+
+    return result;
+}
+
+// prints file:page for the pages containing every term, in index order
+static int runIndexQuery(const char* idx_path, const ArrayList* args) {
+    IndexReader r;
+    if (!indexOpen(&r, idx_path)) {
+        fprintf(stderr, "ERROR: cannot open index %s\n", idx_path);
+        return 1;
+    }
+
+    uint64_t* hits = NULL;
+    size_t n_hits = 0;
+    bool any_term = false;
+    bool missing = false;
+
+    for (size_t a = 0; a < args->len && !missing; ++a) {
+        const char* p = ((const char**)args->items)[a];
+        const char* end = p + strlen(p);
+        char term[INDEX_MAX_TERM];
+        size_t len;
+
+        while (!missing && indexNextTerm(&p, end, term, &len)) {
+            uint32_t t;
+            if (!indexFind(&r, term, len, &t)) {
+                missing = true;
+                break;
+            }
+
+            IndexCursor cur;
+            indexPostings(&r, t, &cur);
+            if (!any_term) {
+                hits = malloc((cur.left ? cur.left : 1) * sizeof(uint64_t));
+                if (!hits) {
+                    fprintf(stderr, "ERROR: out of memory\n");
+                    indexClose(&r);
+                    return 1;
+                }
+                while (indexNext(&cur)) hits[n_hits++] = (uint64_t)cur.doc << 32 | cur.page;
+                any_term = true;
+                continue;
+            }
+
+            // both lists are sorted, so intersect in one merge pass
+            size_t kept = 0;
+            bool more = indexNext(&cur);
+            for (size_t i = 0; i < n_hits && more; ++i) {
+                uint64_t key = (uint64_t)cur.doc << 32 | cur.page;
+                while (more && key < hits[i]) {
+                    more = indexNext(&cur);
+                    key = (uint64_t)cur.doc << 32 | cur.page;
+                }
+                if (more && key == hits[i]) hits[kept++] = hits[i];
+            }
+            n_hits = kept;
+        }
+    }
+
+    if (!any_term && !missing) {
+        fprintf(stderr, "ERROR: no searchable term in the query\n");
+        indexClose(&r);
+        return 1;
+    }
+    if (missing) n_hits = 0;
+
+    for (size_t i = 0; i < n_hits; ++i) {
+        uint32_t doc = (uint32_t)(hits[i] >> 32);
+        size_t len;
+        const char* path = doc < r.n_docs ? indexDocPath(&r, doc, &len) : NULL;
+        if (!path) continue;
+        fwrite(path, 1, len, stdout);
+        printf(":%u\n", (uint32_t)hits[i] + 1);
+    }
+
+    free(hits);
+    indexClose(&r);
+    return n_hits ? 0 : 1;
+}
+
+// info: page count, encryption and Info dict per file, one line each
+#define INFO_FIELDS 7
+static const char* info_keys[INFO_FIELDS] = {
+    "Title", "Author", "Subject", "Producer", "Creator", "CreationDate", "ModDate",
+};
+
+typedef struct {
+    int pages; // -1 if it needs a password
+    bool encrypted;
+    char fields[INFO_FIELDS][256];
+} InfoRecord;
+
+typedef struct {
+    const char** files;
+    bool json;
+} InfoOpts;
+
+static void dropScratchDoc(fz_context* ctx, void* local) {
+    pdf_drop_document(ctx, local);
+}
+
+// Trailer, /Root, /Pages and /Info only. Encrypted files go through the
+// full open, since their Info strings need decrypting.
+static void probeXref(fz_context* ctx, void** local, const char* path, InfoRecord* rec) {
+    fz_stream* stm = NULL;
+    XrefReader* x = NULL;
+    pdf_obj* root = NULL;
+    pdf_obj* pages = NULL;
+    pdf_obj* count = NULL;
+    pdf_obj* info = NULL;
+
+    fz_var(stm);
+    fz_var(x);
+    fz_var(root);
+    fz_var(pages);
+    fz_var(count);
+    fz_var(info);
+
+    fz_try(ctx) {
+        if (!*local) *local = pdf_create_document(ctx);
+        x = calloc(1, sizeof(XrefReader));
+        if (!x) fz_throw(ctx, FZ_ERROR_GENERIC, "out of memory");
+
+        stm = fz_open_file(ctx, path);
+        xrefOpen(ctx, x, stm, *local);
+        if (pdf_dict_get(ctx, x->trailer, PDF_NAME(Encrypt)))
+            fz_throw(ctx, FZ_ERROR_FORMAT, "encrypted");
+
+        root = xrefResolve(ctx, x, pdf_dict_get(ctx, x->trailer, PDF_NAME(Root)));
+        pages = xrefResolve(ctx, x, pdf_dict_get(ctx, root, PDF_NAME(Pages)));
+        count = xrefResolve(ctx, x, pdf_dict_get(ctx, pages, PDF_NAME(Count)));
+        if (!pdf_is_int(ctx, count)) fz_throw(ctx, FZ_ERROR_FORMAT, "no page count");
+        rec->pages = pdf_to_int(ctx, count);
+
+        info = xrefResolve(ctx, x, pdf_dict_get(ctx, x->trailer, PDF_NAME(Info)));
+        for (int i = 0; i < INFO_FIELDS; ++i) {
+            pdf_obj* val = xrefResolve(ctx, x, pdf_dict_gets(ctx, info, info_keys[i]));
+            snprintf(rec->fields[i], sizeof(rec->fields[i]), "%s",
+                     pdf_is_string(ctx, val) ? pdf_to_text_string(ctx, val) : "");
+            pdf_drop_obj(ctx, val);
+        }
+    }
+    fz_always(ctx) {
+        pdf_drop_obj(ctx, info);
+        pdf_drop_obj(ctx, count);
+        pdf_drop_obj(ctx, pages);
+        pdf_drop_obj(ctx, root);
+        if (x) xrefClose(ctx, x);
+        free(x);
+        fz_drop_stream(ctx, stm);
+    }
+    fz_catch(ctx) {
+        fz_rethrow(ctx);
+    }
+}
+
+static void probeFull(fz_context* ctx, const char* path, InfoRecord* rec) {
+    fz_document* doc = NULL;
+    char buf[64];
+
+    fz_var(doc);
+
+    fz_try(ctx) {
+        doc = fz_open_document(ctx, path);
+        rec->encrypted = fz_lookup_metadata(ctx, doc, FZ_META_ENCRYPTION, buf, sizeof(buf)) > 0 &&
+                         strcmp(buf, "None") != 0;
+        rec->pages = -1;
+        if (!fz_needs_password(ctx, doc)) {
+            rec->pages = fz_count_pages(ctx, doc);
+            for (int i = 0; i < INFO_FIELDS; ++i) {
+                char key[32];
+                snprintf(key, sizeof(key), "info:%s", info_keys[i]);
+                if (fz_lookup_metadata(ctx, doc, key, rec->fields[i], sizeof(rec->fields[i])) < 0)
+                    rec->fields[i][0] = '\0';
+            }
+        }
+    }
+    fz_always(ctx) {
+        fz_drop_document(ctx, doc);
+    }
+    fz_catch(ctx) {
+        fz_rethrow(ctx);
+    }
+}
+
+// tabs and line breaks would split the row
+static void appendTsvField(fz_context* ctx, fz_buffer* buf, const char* s) {
+    fz_append_byte(ctx, buf, '\t');
+    for (; *s; ++s)
+        fz_append_byte(ctx, buf, (*s == '\t' || *s == '\n' || *s == '\r') ? ' ' : *s);
+}
+
+static void appendJsonString(fz_context* ctx, fz_buffer* buf, const char* s) {
+    fz_append_byte(ctx, buf, '"');
+    while (*s) {
+        int c;
+        s += fz_chartorune(&c, s);
+        jsonAppendRune(ctx, buf, c);
+    }
+    fz_append_byte(ctx, buf, '"');
+}
+
+// one job per file: page_no indexes the file list
+static void probeFile(fz_context* ctx, void** local, void* arg) {
+    PageJob* job = arg;
+    const InfoOpts* opts = job->opts;
+    InfoRecord rec = {0};
+
+    job->path = opts->files[job->page_no];
+    fz_try(ctx) {
+        fz_try(ctx) {
+            probeXref(ctx, local, job->path, &rec);
+        }
+        fz_catch(ctx) {
+            memset(&rec, 0, sizeof(rec));
+            probeFull(ctx, job->path, &rec);
+        }
+
+        job->buf = fz_new_buffer(ctx, 512);
+        if (opts->json) {
+            fz_append_string(ctx, job->buf, "{\"path\":");
+            appendJsonString(ctx, job->buf, job->path);
+            fz_append_printf(ctx, job->buf, ",\"pages\":%d,\"encrypted\":%s", rec.pages,
+                             rec.encrypted ? "true" : "false");
+            for (int i = 0; i < INFO_FIELDS; ++i) {
+                fz_append_printf(ctx, job->buf, ",\"%s\":", info_keys[i]);
+                appendJsonString(ctx, job->buf, rec.fields[i]);
+            }
+            fz_append_string(ctx, job->buf, "}\n");
+        } else {
+            fz_append_string(ctx, job->buf, job->path);
+            fz_append_printf(ctx, job->buf, "\t%d\t%s", rec.pages, rec.encrypted ? "yes" : "no");
+            for (int i = 0; i < INFO_FIELDS; ++i) appendTsvField(ctx, job->buf, rec.fields[i]);
+            fz_append_byte(ctx, job->buf, '\n');
+        }
+    }
+    fz_catch(ctx) {
+        const char* msg = fz_caught_message(ctx);
+        snprintf(job->err, sizeof(job->err), "%s", msg ? msg : "(unknown)");
+        job->failed = true;
+    }
+}
+
+static bool writeInfoLine(fz_context* ctx, PageJob* job, void* user) {
+    fz_output* out = user;
+    if (job->failed) fprintf(stderr, "WARNING: %s: %s\n", job->path, job->err);
+    else fz_write_buffer(ctx, out, job->buf);
+    return true;
+}
+
+static int runInfo(fz_context* ctx, const ArrayList* files, bool json, int jobs) {
+    InfoOpts opts = { .files = (const char**)files->items, .json = json };
+    const int* idx = NULL;
+    PageJob* slots = NULL;
+    Workers pool = {0};
+    int n_idx = 0;
+    int result = 0;
+
+    fz_var(idx);
+    fz_var(slots);
+
+    if (jobs <= 0) jobs = workersDefaultCount();
+    int window = 4 * jobs; // a probe is short, keep more of them queued
+
+    fz_try(ctx) {
+        idx = selectPages(NULL, (int)files->len, &n_idx);
+        slots = calloc(window, sizeof(PageJob));
+        if (!idx || !slots) fz_throw(ctx, FZ_ERROR_GENERIC, "out of memory");
+        if (!workersInit(&pool, ctx, jobs, window, dropScratchDoc))
+            fz_throw(ctx, FZ_ERROR_GENERIC, "cannot start %d worker threads", jobs);
+
+        fz_output* out = fz_stdout(ctx);
+        if (!json) {
+            fz_write_string(ctx, out, "path\tpages\tencrypted");
+            for (int i = 0; i < INFO_FIELDS; ++i) fz_write_printf(ctx, out, "\t%s", info_keys[i]);
+            fz_write_byte(ctx, out, '\n');
+        }
+        runPageJobs(ctx, &pool, slots, window, NULL, idx, n_idx,
+                    probeFile, &opts, writeInfoLine, out);
+        fz_flush_output(ctx, out);
+    }
+    fz_always(ctx) {
+        workersDeinit(&pool);
+        free(slots);
+        free((void*)idx);
+    }
+    fz_catch(ctx) {
+        const char* msg = fz_caught_message(ctx);
+        fprintf(stderr, "ERROR: %s\n", msg ? msg : "(unknown)");
+        result = 1;
+    }
+
+    return result;
+}
+
+// Runs `argv0 args...` once with its stdout on a pipe. first is the time from
+// spawning to the first byte the child writes, total the time until it exits.
+static bool timeChild(const char* argv0, const ArrayList* args, double* first,
+                      double* total) {
+    const char** items = (const char**)args->items;
+    char buf[4096];
+    bool ok = false;
+
+    *first = -1.0;
+#ifdef _WIN32
+    char self[MAX_PATH];
+    DWORD self_len = GetModuleFileNameA(NULL, self, sizeof(self));
+    if (self_len == 0 || self_len == sizeof(self)) return false;
+
+    // good enough quoting for paths and ranges; embedded quotes are not escaped
+    size_t cap = strlen(self) + 3;
+    for (size_t i = 0; i < args->len; ++i) cap += strlen(items[i]) + 3;
+    char* cmdline = malloc(cap);
+    if (!cmdline) return false;
+    size_t len = (size_t)snprintf(cmdline, cap, "\"%s\"", self);
+    for (size_t i = 0; i < args->len; ++i)
+        len += (size_t)snprintf(cmdline + len, cap - len, " \"%s\"", items[i]);
+
+    SECURITY_ATTRIBUTES sa = { sizeof(sa), NULL, TRUE };
+    HANDLE rd, wr;
+    if (!CreatePipe(&rd, &wr, &sa, 0)) {
+        free(cmdline);
+        return false;
+    }
+    SetHandleInformation(rd, HANDLE_FLAG_INHERIT, 0);
+
+    STARTUPINFOA si = {0};
+    si.cb = sizeof(si);
+    si.dwFlags = STARTF_USESTDHANDLES;
+    si.hStdInput = GetStdHandle(STD_INPUT_HANDLE);
+    si.hStdOutput = wr;
+    si.hStdError = GetStdHandle(STD_ERROR_HANDLE);
+    PROCESS_INFORMATION pi;
+
+    double start = nowSeconds();
+    BOOL spawned = CreateProcessA(self, cmdline, NULL, NULL, TRUE, 0, NULL, NULL, &si, &pi);
+    CloseHandle(wr);
+    free(cmdline);
+    if (!spawned) {
+        CloseHandle(rd);
+        return false;
+    }
+
+    DWORD n;
+    while (ReadFile(rd, buf, sizeof(buf), &n, NULL) && n > 0) {
+        if (*first < 0) *first = nowSeconds() - start;
+    }
+    WaitForSingleObject(pi.hProcess, INFINITE);
+    *total = nowSeconds() - start;
+
+    DWORD code = 1;
+    GetExitCodeProcess(pi.hProcess, &code);
+    ok = code == 0;
+    CloseHandle(pi.hThread);
+    CloseHandle(pi.hProcess);
+    CloseHandle(rd);
+    (void)argv0;
+#else
+    const char** child_argv = malloc((args->len + 2) * sizeof(char*));
+    if (!child_argv) return false;
+    child_argv[0] = argv0;
+    memcpy(child_argv + 1, items, args->len * sizeof(char*));
+    child_argv[args->len + 1] = NULL;
+
+    int fds[2];
+    if (pipe(fds) != 0) {
+        free(child_argv);
+        return false;
+    }
+
+    double start = nowSeconds();
+    pid_t pid = fork();
+    if (pid == 0) {
+        dup2(fds[1], STDOUT_FILENO);
+        close(fds[0]);
+        close(fds[1]);
+#ifdef __linux__
+        execv("/proc/self/exe", (char* const*)child_argv);
+#endif
+        execvp(argv0, (char* const*)child_argv);
+        _exit(127);
+    }
+    close(fds[1]);
+    free(child_argv);
+    if (pid < 0) {
+        close(fds[0]);
+        return false;
+    }
+
+    for (;;) {
+        ssize_t n = read(fds[0], buf, sizeof(buf));
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        if (*first < 0) *first = nowSeconds() - start;
+    }
+    close(fds[0]);
+
+    int status = 0;
+    while (waitpid(pid, &status, 0) < 0 && errno == EINTR);
+    *total = nowSeconds() - start;
+    ok = WIFEXITED(status) && WEXITSTATUS(status) == 0;
+#endif
+
+    // a command that prints nothing is done when it exits
+    if (*first < 0) *first = *total;
+    return ok;
+}
+
+static int compareDouble(const void* a, const void* b) {
+    double x = *(const double*)a;
+    double y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+// Times the one-page jobs this tool is mostly used for from the outside:
+// exec, context setup, opening the file and the first byte of output.
+static int runStartupBench(const char* argv0, const ArrayList* args, uint32_t runs) {
+    double* firsts = malloc(2 * runs * sizeof(double));
+    if (!firsts) {
+        fprintf(stderr, "ERROR: out of memory\n");
+        return 1;
+    }
+    double* totals = firsts + runs;
+
+    // one untimed run warms the page cache and the dynamic loader
+    double first, total;
+    for (uint32_t i = 0; i <= runs; ++i) {
+        if (!timeChild(argv0, args, &first, &total)) {
+            fprintf(stderr, "ERROR: run %u of the command failed\n", i);
+            free(firsts);
+            return 1;
+        }
+        if (i == 0) continue;
+        firsts[i - 1] = first;
+        totals[i - 1] = total;
+    }
+    qsort(firsts, runs, sizeof(double), compareDouble);
+    qsort(totals, runs, sizeof(double), compareDouble);
+
+    printf("%-11s %10s %10s %10s\n", "", "min ms", "median ms", "max ms");
+    printf("%-11s %10.2f %10.2f %10.2f\n", "first byte", firsts[0] * 1e3,
+           firsts[runs / 2] * 1e3, firsts[runs - 1] * 1e3);
+    printf("%-11s %10.2f %10.2f %10.2f\n", "exit", totals[0] * 1e3,
+           totals[runs / 2] * 1e3, totals[runs - 1] * 1e3);
+    printf("(%u runs)\n", runs);
+
+    free(firsts);
+    return 0;
+}
+
+// pool: subpdf jobs from a TSV file, run by child pdfutils processes that each
+// take one job line at a time on stdin and answer on stdout. A PDF that
+// crashes MuPDF only kills its worker: the job goes back on the queue and a
+// fresh worker takes over. With a timeout, a job that hangs its worker is
+// treated the same way once the worker is killed.
+#define POOL_LINE_MAX (16 * 1024)
+
+typedef struct {
+    const char* line; // IN_PATH \t RANGE \t OUT_PATH [\t sparse]
+    size_t line_no;
+    uint32_t deaths;
+    bool failed;
+} PoolJob;
+
+typedef struct {
+    const char* self;
+    const char* jobs_path;
+    PoolJob* jobs;
+    size_t* queue; // job indices; a job that killed its worker is appended again
+    size_t head;
+    size_t tail;
+    size_t requeued;
+    uint32_t retries;
+    uint32_t timeout; // seconds per job, 0 for none
+    WorkersMutex lock;
+    WorkersMutex spawn_lock;
+} Pool;
+
+typedef struct {
+    Pool* pool;
+    Nob_Proc proc;
+    FILE* to;   // the worker's stdin
+    FILE* from; // its replies, one line per job
+} PoolWorker;
+
+// where workers are started from; argv[0] may be a bare name found on PATH
+static const char* poolSelf(const char* argv0) {
+#ifdef _WIN32
+    static char self[MAX_PATH];
+    DWORD len = GetModuleFileNameA(NULL, self, sizeof(self));
+    return len == 0 || len == sizeof(self) ? argv0 : self;
+#elif defined(__linux__)
+    (void)argv0;
+    return "/proc/self/exe";
+#else
+    return argv0;
+#endif
+}
+
+// splits a job line in place
+static bool poolSplitJob(char* line, char** in_path, char** range, char** out_path,
+                         bool* sparse) {
+    char* fields[4] = { line };
+    int n = 1;
+    for (char* p = line; *p; ++p) {
+        if (*p != '\t') continue;
+        if (n == 4) return false;
+        *p = '\0';
+        fields[n++] = p + 1;
+    }
+    if (n < 3 || !*fields[0] || !*fields[1] || !*fields[2]) return false;
+    if (n == 4 && strcmp(fields[3], "sparse") != 0) return false;
+
+    *in_path = fields[0];
+    *range = fields[1];
+    *out_path = fields[2];
+    *sparse = n == 4;
+    return true;
+}
+
+// Serves `pdfutils pool --worker`: replies go to the original stdout, and
+// what runSubpdf prints is moved to stderr so it cannot mix with them.
+static int runPoolWorker(fz_context* ctx) {
+    fflush(stdout);
+#ifdef _WIN32
+    int reply_fd = _dup(_fileno(stdout));
+    FILE* reply = reply_fd < 0 ? NULL : _fdopen(reply_fd, "wb");
+    if (reply && _dup2(_fileno(stderr), _fileno(stdout)) != 0) {
+        fclose(reply);
+        reply = NULL;
+    }
+#else
+    int reply_fd = dup(STDOUT_FILENO);
+    FILE* reply = reply_fd < 0 ? NULL : fdopen(reply_fd, "w");
+    if (reply && dup2(STDERR_FILENO, STDOUT_FILENO) < 0) {
+        fclose(reply);
+        reply = NULL;
+    }
+#endif
+    if (!reply) {
+        fprintf(stderr, "ERROR: cannot set up the reply stream\n");
+        return 1;
+    }
+
+    char line[POOL_LINE_MAX];
+    while (fgets(line, sizeof(line), stdin)) {
+        line[strcspn(line, "\r\n")] = '\0';
+
+        char *job_in, *job_range, *job_out;
+        bool job_sparse;
+        bool ok = poolSplitJob(line, &job_in, &job_range, &job_out, &job_sparse) &&
+                  runSubpdf(ctx, job_in, job_range, job_out, job_sparse) == 0;
+        fflush(stdout);
+        if (fputs(ok ? "ok\n" : "fail\n", reply) < 0 || fflush(reply) != 0) break;
+    }
+
+    fclose(reply);
+    return 0;
+}
+
+// a pipe no child inherits unless it is handed one of the ends
+static bool poolPipe(Nob_Fd* rd, Nob_Fd* wr) {
+#ifdef _WIN32
+    return CreatePipe(rd, wr, NULL, 0);
+#else
+    int fds[2];
+    if (pipe(fds) != 0) return false;
+    fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+    fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+    *rd = fds[0];
+    *wr = fds[1];
+    return true;
+#endif
+}
+
+static void poolClose(Nob_Fd fd) {
+#ifdef _WIN32
+    CloseHandle(fd);
+#else
+    close(fd);
+#endif
+}
+
+// takes ownership of fd, closing it on failure
+static FILE* poolStream(Nob_Fd fd, const char* mode) {
+#ifdef _WIN32
+    int crt = _open_osfhandle((intptr_t)fd, mode[0] == 'r' ? _O_RDONLY : 0);
+    if (crt < 0) {
+        CloseHandle(fd);
+        return NULL;
+    }
+    FILE* file = _fdopen(crt, mode);
+    if (!file) _close(crt);
+#else
+    FILE* file = fdopen(fd, mode);
+    if (!file) close(fd);
+#endif
+    return file;
+}
+
+// Closes the worker's pipes, which makes a live worker exit, and waits for it.
+static void poolReap(PoolWorker* w) {
+    if (w->to) fclose(w->to);
+    if (w->from) fclose(w->from);
+    if (w->proc != NOB_INVALID_PROC) nob_proc_wait(w->proc);
+    w->to = NULL;
+    w->from = NULL;
+    w->proc = NOB_INVALID_PROC;
+}
+
+// Waits for the reply to the job just sent. False once pool->timeout seconds
+// pass without one; a worker that died counts as replied, fgets sees the end.
+static bool poolAwait(PoolWorker* w) {
+    uint32_t timeout = w->pool->timeout;
+    if (timeout == 0) return true;
+#ifdef _WIN32
+    HANDLE pipe = (HANDLE)_get_osfhandle(_fileno(w->from));
+    double deadline = nowSeconds() + timeout;
+    for (;;) {
+        DWORD avail = 0;
+        if (!PeekNamedPipe(pipe, NULL, 0, NULL, &avail, NULL) || avail > 0) return true;
+        if (nowSeconds() >= deadline) return false;
+        Sleep(10);
+    }
+#else
+    struct pollfd pfd = { .fd = fileno(w->from), .events = POLLIN };
+    int ms = timeout > INT_MAX / 1000 ? INT_MAX : (int)timeout * 1000;
+    int ready;
+    do ready = poll(&pfd, 1, ms); while (ready < 0 && errno == EINTR);
+    return ready != 0;
+#endif
+}
+
+static void poolKill(PoolWorker* w) {
+#ifdef _WIN32
+    TerminateProcess(w->proc, 1);
+#else
+    kill(w->proc, SIGKILL);
+#endif
+}
+
+// Spawns are serialized: on Windows the child ends are inheritable while a
+// worker starts, and no other worker may pick them up.
+static bool poolSpawn(PoolWorker* w) {
+    Pool* pool = w->pool;
+    Nob_Fd in_rd, in_wr, out_rd, out_wr;
+    Nob_Cmd cmd = {0};
+    nob_cmd_append(&cmd, pool->self, "pool", "--worker");
+
+    workersLock(&pool->spawn_lock);
+    bool piped = poolPipe(&in_rd, &in_wr);
+    if (piped && !poolPipe(&out_rd, &out_wr)) {
+        poolClose(in_rd);
+        poolClose(in_wr);
+        piped = false;
+    }
+    if (piped) {
+#ifdef _WIN32
+        SetHandleInformation(in_rd, HANDLE_FLAG_INHERIT, HANDLE_FLAG_INHERIT);
+        SetHandleInformation(out_wr, HANDLE_FLAG_INHERIT, HANDLE_FLAG_INHERIT);
+#endif
+        w->proc = nob_cmd_run_async_redirect(cmd, (Nob_Cmd_Redirect){
+            .fdin = &in_rd, .fdout = &out_wr });
+        poolClose(in_rd);
+        poolClose(out_wr);
+    }
+    workersUnlock(&pool->spawn_lock);
+    nob_cmd_free(cmd);
+
+    if (!piped) return false;
+    if (w->proc == NOB_INVALID_PROC) {
+        poolClose(in_wr);
+        poolClose(out_rd);
+        return false;
+    }
+    w->to = poolStream(in_wr, "wb");
+    w->from = poolStream(out_rd, "rb");
+    if (!w->to || !w->from) {
+        poolReap(w);
+        return false;
+    }
+    return true;
+}
+
+// Feeds one worker until the queue is empty. A job whose line gets no reply
+// killed the worker, or hung it and got it killed; it is requeued up to
+// pool->retries times.
+static void poolRun(PoolWorker* w) {
+    Pool* pool = w->pool;
+    char reply[16];
+
+    for (;;) {
+        workersLock(&pool->lock);
+        bool empty = pool->head == pool->tail;
+        size_t j = empty ? 0 : pool->queue[pool->head++];
+        workersUnlock(&pool->lock);
+        if (empty) break;
+
+        PoolJob* job = &pool->jobs[j];
+        if (!w->to && !poolSpawn(w)) {
+            fprintf(stderr, "ERROR: %s:%zu: cannot start a worker\n",
+                    pool->jobs_path, job->line_no);
+            job->failed = true;
+            continue;
+        }
+        bool sent = fprintf(w->to, "%s\n", job->line) > 0 && fflush(w->to) == 0;
+        bool hung = sent && !poolAwait(w);
+        if (sent && !hung && fgets(reply, sizeof(reply), w->from)) {
+            job->failed = strcmp(reply, "ok\n") != 0;
+            continue;
+        }
+
+        if (hung) poolKill(w);
+        poolReap(w);
+        bool again = ++job->deaths <= pool->retries;
+        workersLock(&pool->lock);
+        if (again) {
+            pool->queue[pool->tail++] = j;
+            ++pool->requeued;
+        }
+        workersUnlock(&pool->lock);
+        job->failed = !again;
+        fprintf(stderr, "WARNING: %s:%zu: %s%s\n", pool->jobs_path, job->line_no,
+                hung ? "the job timed out, worker killed" : "the job killed its worker",
+                again ? ", requeued" : "");
+    }
+
+    poolReap(w);
+}
+
+#ifdef _WIN32
+static DWORD WINAPI poolMain(LPVOID arg) {
+    poolRun(arg);
+    return 0;
+}
+#else
+static void* poolMain(void* arg) {
+    poolRun(arg);
+    return NULL;
+}
+#endif
+
+// whole file or stdin, NUL-terminated
+static char* poolReadJobs(const char* path) {
+    FILE* file = strcmp(path, "-") == 0 ? stdin : fopen(path, "rb");
+    if (!file) return NULL;
+
+    size_t len = 0, cap = 64 * 1024;
+    char* data = malloc(cap);
+    while (data) {
+        len += fread(data + len, 1, cap - len - 1, file);
+        if (len < cap - 1) break;
+        char* grown = realloc(data, cap *= 2);
+        if (!grown) free(data);
+        data = grown;
+    }
+    bool failed = ferror(file);
+    if (file != stdin) fclose(file);
+    if (!data || failed) {
+        free(data);
+        return NULL;
+    }
+    data[len] = '\0';
+    return data;
+}
+
+static int runPool(const char* self, const char* jobs_path, uint32_t procs,
+                   uint32_t retries, uint32_t timeout) {
+    char* data = poolReadJobs(jobs_path);
+    if (!data) {
+        fprintf(stderr, "ERROR: cannot read %s\n", jobs_path);
+        return 1;
+    }
+    DEFER(free, data);
+
+    // one job per line at most; every job is queued at most retries + 1 times
+    size_t max_jobs = 1;
+    for (const char* p = data; *p; ++p) max_jobs += *p == '\n';
+    if (max_jobs > SIZE_MAX / sizeof(size_t) / ((size_t)retries + 1)) {
+        fprintf(stderr, "ERROR: too many jobs or retries\n");
+        return 1;
+    }
+    PoolJob* jobs = malloc(max_jobs * sizeof(PoolJob));
+    DEFER(free, jobs);
+    size_t* queue = malloc(max_jobs * ((size_t)retries + 1) * sizeof(size_t));
+    DEFER(free, queue);
+    if (!jobs || !queue) {
+        fprintf(stderr, "ERROR: out of memory\n");
+        return 1;
+    }
+
+    // checked here so a malformed line is reported before any worker starts
+    size_t n_jobs = 0, line_no = 0;
+    char scratch[POOL_LINE_MAX];
+    for (char* line = data; line; ) {
+        char* next = strchr(line, '\n');
+        if (next) *next++ = '\0';
+        line[strcspn(line, "\r")] = '\0';
+        ++line_no;
+
+        size_t len = strlen(line);
+        if (len > 0 && line[0] != '#') {
+            char *job_in, *job_range, *job_out;
+            bool job_sparse;
+            if (len < sizeof(scratch) - 1) memcpy(scratch, line, len + 1);
+            if (len >= sizeof(scratch) - 1 ||
+                !poolSplitJob(scratch, &job_in, &job_range, &job_out, &job_sparse)) {
+                fprintf(stderr, "ERROR: %s:%zu: expected IN_PATH, RANGE, OUT_PATH "
+                        "and optionally `sparse`, separated by tabs\n", jobs_path, line_no);
+                return 1;
+            }
+            jobs[n_jobs] = (PoolJob){ .line = line, .line_no = line_no };
+            queue[n_jobs] = n_jobs;
+            ++n_jobs;
+        }
+        line = next;
+    }
+
+    Pool pool = {
+        .self = self,
+        .jobs_path = jobs_path,
+        .jobs = jobs,
+        .queue = queue,
+        .tail = n_jobs,
+        .retries = retries,
+        .timeout = timeout,
+    };
+    size_t count = procs ? procs : (size_t)nob_nprocs();
+    if (count > n_jobs) count = n_jobs;
+    PoolWorker* workers = calloc(count ? count : 1, sizeof(PoolWorker));
+    DEFER(free, workers);
+    WorkersThread* threads = calloc(count ? count : 1, sizeof(WorkersThread));
+    DEFER(free, threads);
+    if (!workers || !threads) {
+        fprintf(stderr, "ERROR: out of memory\n");
+        return 1;
+    }
+
+#ifndef _WIN32
+    // a worker dying mid-job must show up as a failed write, not kill us
+    signal(SIGPIPE, SIG_IGN);
+#endif
+    // nob logs every spawned command at INFO
+    nob_minimal_log_level = NOB_WARNING;
+    workersMutexInit(&pool.lock);
+    workersMutexInit(&pool.spawn_lock);
+
+    size_t started = 0;
+    for (; started < count; ++started) {
+        PoolWorker* w = &workers[started];
+        *w = (PoolWorker){ .pool = &pool, .proc = NOB_INVALID_PROC };
+#ifdef _WIN32
+        threads[started] = CreateThread(NULL, 0, poolMain, w, 0, NULL);
+        if (!threads[started]) break;
+#else
+        if (pthread_create(&threads[started], NULL, poolMain, w) != 0) break;
+#endif
+    }
+    // with no thread at all, this one feeds a single worker
+    if (started == 0 && n_jobs > 0) {
+        workers[0] = (PoolWorker){ .pool = &pool, .proc = NOB_INVALID_PROC };
+        poolRun(&workers[0]);
+    }
+    for (size_t i = 0; i < started; ++i) {
+#ifdef _WIN32
+        WaitForSingleObject(threads[i], INFINITE);
+        CloseHandle(threads[i]);
+#else
+        pthread_join(threads[i], NULL);
+#endif
+    }
+    workersMutexDeinit(&pool.spawn_lock);
+    workersMutexDeinit(&pool.lock);
+
+    size_t failed = 0;
+    for (size_t i = 0; i < n_jobs; ++i) failed += jobs[i].failed;
+    printf("%zu jobs: %zu ok, %zu failed, %zu requeued\n", n_jobs, n_jobs - failed,
+           failed, pool.requeued);
+    return failed ? 1 : 0;
+}
+
+int main(int argc, char** argv) {
+    // cpuid is read here, before render and grep start their workers
+    pixopsInit();
+    clparseInit("pdfutils", "PDF utilities");
+    DEFER(cleanClparse, NULL);
+
+    bool* subpdf = clparseSubcmd("subpdf", "Extract sub-PDF");
+    const char** in_path = clparseMainArg("IN_PATH", "asdasd", "subpdf");
+    const char** range = clparseMainArg("RANGE", "asdasd", "subpdf");
+    const char** out_path = clparseStr("output", 'o', "",
+        "output filename (default output.pdf), or the directory -R requires", "subpdf");
+    bool* sparse = clparseBool("sparse", 's', false,
+        "load only the objects the selected pages use", "subpdf");
+    const bool* subpdf_recursive = clparseBool("recursive", 'R', false,
+        "IN_PATH is a directory: extract RANGE from every PDF under it", "subpdf");
+    const bool* subpdf_sniff = clparseBool("sniff", NO_SHORT, false,
+        "with -R, pick PDFs by their %PDF- header, not the .pdf extension", "subpdf");
+    const uint32_t* subpdf_jobs = clparseU32("jobs", 'j', 0,
+        "with -R, worker threads (default: one per CPU)", "subpdf");
+    const bool* subpdf_each_page = clparseBool("each-page", NO_SHORT, false,
+        "write every page of RANGE as its own PDF into --archive", "subpdf");
+    const char** subpdf_archive = clparseStr("archive", NO_SHORT, "",
+        "with --each-page, a .zip or .tar file, or `-` for tar on stdout", "subpdf");
+
+    bool* burst = clparseSubcmd("burst", "Split a PDF into one file per page or per N pages");
+    const char** burst_in = clparseMainArg("IN_PATH", "input PDF", "burst");
+    const uint32_t* burst_every = clparseU32("every", 'n', 1,
+        "pages per output file", "burst");
+    const bool* burst_sparse = clparseBool("sparse", 's', false,
+        "load only the objects the selected pages use", "burst");
+    const uint32_t* burst_jobs = clparseU32("jobs", 'j', 0,
+        "threads saving outputs (default: one per CPU)", "burst");
+    const char** burst_out = clparseStr("output", 'o', "page-%05d.pdf",
+        "output pattern, numbered from 1", "burst");
+
+    bool* split_size = clparseSubcmd("split-size",
+        "Split a PDF into outputs of at most a given size");
+    const char** split_in = clparseMainArg("IN_PATH", "input PDF", "split-size");
+    const char** split_max_mb = clparseStr("max-mb", 'm', "10",
+        "largest output in MB (10^6 bytes), fractions allowed", "split-size");
+    const char** split_out = clparseStr("output", 'o', "part-%03d.pdf",
+        "output pattern, numbered from 1", "split-size");
+
+    bool* render = clparseSubcmd("render", "Rasterize pages as raw images");
+    const char** render_in = clparseMainArg("IN_PATH", "input document", "render");
+    const char** render_range = clparseMainArg("RANGE", "pages to render (ex: 3-5,8)", "render");
+    const char** render_format = clparseStr("format", NO_SHORT, "pam",
+        "image format: pam, pgm, ppm, pbm, png, tiff or qoi", "render");
+    const char** render_color = clparseStr("colorspace", NO_SHORT, "auto",
+        "pixels: auto, rgb, gray or mono (bitonal)", "render");
+    const uint32_t* render_dpi = clparseU32("dpi", 'r', 72,
+        "resolution in dots per inch", "render");
+    const int32_t* render_aa = clparseI32("aa", NO_SHORT, -1,
+        "anti-aliasing level 0-8 (default: MuPDF's)", "render");
+    const bool* render_no_icc = clparseBool("no-icc", NO_SHORT, false,
+        "disable ICC color management", "render");
+    const bool* render_no_annots = clparseBool("no-annots", NO_SHORT, false,
+        "skip annotations", "render");
+    const bool* render_luma = clparseBool("luma", NO_SHORT, false,
+        "render RGB and convert to gray afterwards", "render");
+    const char** render_levels = clparseStr("levels", NO_SHORT, "",
+        "black and white points, ex: 20:235", "render");
+    const char** render_gamma = clparseStr("gamma", NO_SHORT, "1.0",
+        "gamma applied after levels", "render");
+    const char** render_threshold = clparseStr("threshold", NO_SHORT, "128",
+        "bitonal cut: 0-255 or otsu", "render");
+    const uint8_t* render_png_level = clparseU8("png-level", NO_SHORT, 1,
+        "PNG deflate level 0-9", "render");
+    const char** render_png_filter = clparseStr("png-filter", NO_SHORT, "up",
+        "PNG row filter: none, sub, up or auto", "render");
+    const uint32_t* render_jobs = clparseU32("jobs", 'j', 0,
+        "encoder threads (default: one per CPU)", "render");
+    const bool* render_vision = clparseBool("vision", NO_SHORT, false,
+        "machine-vision profile: gray, no AA, no ICC, no annotations", "render");
+    const bool* render_bench = clparseBool("bench", NO_SHORT, false,
+        "print pages/sec for every profile combination", "render");
+    const char** render_out = clparseStr("output", 'o', "-",
+        "output filename, `-` for stdout, or a pattern like page-%03d.png", "render");
+
+    bool* text = clparseSubcmd("text", "Extract UTF-8 text, pages separated by form feeds");
+    const char** text_in = clparseMainArg("IN_PATH", "input document", "text");
+    const char** text_range = clparseMainArg("RANGE", "pages to extract (default: all)", "text");
+    const uint32_t* text_jobs = clparseU32("jobs", 'j', 0,
+        "worker threads (default: one per CPU)", "text");
+    const char** text_out = clparseStr("output", 'o', "-",
+        "output filename (`-` for stdout)", "text");
+
+    bool* words = clparseSubcmd("words", "Extract words with bounding boxes as JSON lines");
+    const char** words_in = clparseMainArg("IN_PATH", "input document", "words");
+    const char** words_range = clparseMainArg("RANGE", "pages to extract (default: all)", "words");
+    const uint32_t* words_jobs = clparseU32("jobs", 'j', 0,
+        "worker threads (default: one per CPU)", "words");
+    const char** words_out = clparseStr("output", 'o', "-",
+        "output filename (`-` for stdout)", "words");
+
+    bool* grep = clparseSubcmd("grep", "Search page text in PDFs, printing file:page:line");
+    const char** grep_pattern = clparseMainArg("PATTERN", "literal text to find", "grep");
+    const ArrayList* grep_files = clparseMainArgList("FILES...", "documents to search", "grep");
+    bool* grep_regex = clparseBool("regex", 'E', false,
+        "PATTERN is a regex (. [] * + ? ^ $)", "grep");
+    bool* grep_files_only = clparseBool("files-with-matches", 'l', false,
+        "print only the names of matching files", "grep");
+    const uint32_t* grep_max = clparseU32("max-count", 'm', 0,
+        "stop a file after N matching lines", "grep");
+    const uint32_t* grep_jobs = clparseU32("jobs", 'j', 0,
+        "worker threads (default: one per CPU)", "grep");
+
+    bool* index = clparseSubcmd("index", "Build, update or query an inverted index");
+    const char** index_action = clparseMainArg("ACTION", "build, update or query", "index");
+    const ArrayList* index_args = clparseMainArgList("ARGS...",
+        "DIR for build and update, terms for query", "index");
+    const uint32_t* index_jobs = clparseU32("jobs", 'j', 0,
+        "worker threads (default: one per CPU)", "index");
+    const char** index_out = clparseStr("output", 'o', "pdfutils.idx",
+        "index filename", "index");
+
+    bool* info = clparseSubcmd("info", "Print page count, encryption and Info dict per file");
+    const ArrayList* info_files = clparseMainArgList("FILES...", "documents to probe", "info");
+    const char** info_format = clparseStr("format", 'f', "tsv", "tsv or json", "info");
+    const uint32_t* info_jobs = clparseU32("jobs", 'j', 0,
+        "worker threads (default: one per CPU)", "info");
+
+    bool* index_xref = clparseSubcmd("index-xref",
+        "Save the resolved xref and page list next to a PDF for fast reopening");
+    const char** index_xref_in = clparseMainArg("IN_PATH", "input PDF", "index-xref");
+
+    bool* startup_bench = clparseSubcmd("startup-bench",
+        "Time a pdfutils command from exec to its first output byte");
+    const ArrayList* startup_args = clparseMainArgList("COMMAND...",
+        "pdfutils arguments to run, after `--`", "startup-bench");
+    const uint32_t* startup_runs = clparseU32("runs", 'n', 20,
+        "number of timed runs", "startup-bench");
+
+    bool* pool = clparseSubcmd("pool", "Run subpdf jobs from a TSV file on worker processes");
+    const char** pool_jobs = clparseMainArg("JOBS",
+        "IN_PATH, RANGE, OUT_PATH[, sparse] per line, tab-separated; `-` for stdin", "pool");
+    const uint32_t* pool_procs = clparseU32("procs", 'p', 0,
+        "worker processes (default: one per CPU)", "pool");
+    const uint32_t* pool_retries = clparseU32("retries", NO_SHORT, 1,
+        "times a job that kills its worker, or times out, is requeued", "pool");
+    const uint32_t* pool_timeout = clparseU32("timeout", NO_SHORT, 0,
+        "seconds a job may run before its worker is killed (default: no limit)", "pool");
+    const bool* pool_worker = clparseBool("worker", NO_SHORT, false,
+        "serve job lines from stdin (started by pool itself)", "pool");
+
+    if (!clparseParse(argc, argv)) {
+        fprintf(stderr, "ERROR: parsing commandline failed\n");
+        return 1;
+    }
+
+    if (clparseIsHelp()) {
+        clparsePrintHelp();
+        return 0;
+    }
+
+    if (!*subpdf && !*render && !*text && !*words && !*grep && !*index && !*info &&
+        !*index_xref && !*startup_bench && !*pool && !*burst &&
+        !*split_size) {
+        fprintf(stderr, "ERROR: %s\n", clparseGetErr());
+        clparsePrintHelp();
+        return 1;
+    }
+
+    // runs other processes, this one never needs MuPDF
+    if (*startup_bench) {
+        if (startup_args->len == 0 || *startup_runs == 0) {
+            fprintf(stderr, "ERROR: COMMAND and a positive run count are required\n");
+            return 1;
+        }
+        return runStartupBench(argv[0], startup_args, *startup_runs);
+    }
+
+    // the workers need MuPDF, the process feeding them does not
+    if (*pool && !*pool_worker) {
+        if (!*pool_jobs) {
+            fprintf(stderr, "ERROR: JOBS is required\n");
+            return 1;
+        }
+        return runPool(poolSelf(argv[0]), *pool_jobs, *pool_procs, *pool_retries,
+                       *pool_timeout);
+    }
+
+    if (*subpdf && (!*in_path || !*range)) {
+        fprintf(stderr, "ERROR: IN_PATH and RANGE are required\n");
+        return 1;
+    }
+    if (*subpdf && *subpdf_each_page != (**subpdf_archive != '\0')) {
+        fprintf(stderr, "ERROR: --each-page and --archive go together\n");
+        return 1;
+    }
+    if (*subpdf && *subpdf_each_page && *subpdf_recursive) {
+        fprintf(stderr, "ERROR: --each-page does not combine with -R\n");
+        return 1;
+    }
+
+    if (*burst) {
+        if (!*burst_in) {
+            fprintf(stderr, "ERROR: IN_PATH is required\n");
+            return 1;
+        }
+        if (*burst_every == 0 || *burst_every > INT_MAX) {
+            fprintf(stderr, "ERROR: every must be positive\n");
+            return 1;
+        }
+        if (!isPagePattern(*burst_out)) {
+            fprintf(stderr, "ERROR: output needs one %%d for the file number\n");
+            return 1;
+        }
+    }
+
+    size_t split_max_bytes = 0;
+    if (*split_size) {
+        if (!*split_in) {
+            fprintf(stderr, "ERROR: IN_PATH is required\n");
+            return 1;
+        }
+        char* end = NULL;
+        double mb = strtod(*split_max_mb, &end);
+        if (end == *split_max_mb || *end || !(mb > 0.0) || mb > 1e12) {
+            fprintf(stderr, "ERROR: invalid size `%s`\n", *split_max_mb);
+            return 1;
+        }
+        split_max_bytes = (size_t)(mb * 1e6);
+        if (!isPagePattern(*split_out)) {
+            fprintf(stderr, "ERROR: output needs one %%d for the file number\n");
+            return 1;
+        }
+    }
+
+    RenderOpts render_opts = {0};
+    if (*render) {
+        if (!*render_in || !*render_range) {
+            fprintf(stderr, "ERROR: IN_PATH and RANGE are required\n");
+            return 1;
+        }
+        if (!parseRenderFormat(*render_format, &render_opts.format)) {
+            fprintf(stderr, "ERROR: unknown image format `%s`\n", *render_format);
+            return 1;
+        }
+        if (!parseRenderColor(*render_color, &render_opts.color)) {
+            fprintf(stderr, "ERROR: unknown colorspace `%s`\n", *render_color);
+            return 1;
+        }
+        if (*render_dpi == 0) {
+            fprintf(stderr, "ERROR: dpi must be positive\n");
+            return 1;
+        }
+        if (*render_aa > 8) {
+            fprintf(stderr, "ERROR: aa level must be between 0 and 8\n");
+            return 1;
+        }
+
+        render_opts.dpi = *render_dpi;
+        render_opts.aa_level = *render_aa;
+        render_opts.no_icc = *render_no_icc;
+        render_opts.no_annots = *render_no_annots;
+        render_opts.luma = *render_luma;
+        if (!parseThreshold(*render_threshold, &render_opts.threshold)) {
+            fprintf(stderr, "ERROR: invalid threshold `%s`\n", *render_threshold);
+            return 1;
+        }
+        if (!parseTone(*render_levels, *render_gamma, &render_opts)) {
+            fprintf(stderr, "ERROR: invalid levels or gamma\n");
+            return 1;
+        }
+        if (*render_png_level > 9) {
+            fprintf(stderr, "ERROR: PNG level must be between 0 and 9\n");
+            return 1;
+        }
+        render_opts.png_level = *render_png_level;
+        if (!parsePngFilter(*render_png_filter, &render_opts.png_filter)) {
+            fprintf(stderr, "ERROR: unknown PNG filter `%s`\n", *render_png_filter);
+            return 1;
+        }
+        if (*render_vision) {
+            if (render_opts.color == RENDER_COLOR_AUTO &&
+                render_opts.format != RENDER_FORMAT_PBM)
+                render_opts.color = RENDER_COLOR_GRAY;
+            if (render_opts.aa_level < 0) render_opts.aa_level = 0;
+            render_opts.no_icc = true;
+            render_opts.no_annots = true;
+        }
+        if (!resolveRenderColor(&render_opts)) {
+            fprintf(stderr, "ERROR: %s cannot hold %s pixels\n",
+                    *render_format, *render_color);
+            return 1;
+        }
+    }
+
+    if ((*index_xref && !*index_xref_in) || (*text && !*text_in) || (*words && !*words_in)) {
+        fprintf(stderr, "ERROR: IN_PATH is required\n");
+        return 1;
+    }
+
+    GrepOpts grep_opts = {0};
+    if (*grep) {
+        if (!*grep_pattern || !**grep_pattern || grep_files->len == 0) {
+            fprintf(stderr, "ERROR: PATTERN and at least one file are required\n");
+            return 1;
+        }
+        grep_opts.pattern = *grep_pattern;
+        grep_opts.pattern_len = strlen(*grep_pattern);
+        grep_opts.regex = *grep_regex;
+        if (grep_opts.regex && !searchRegexValid(grep_opts.pattern)) {
+            fprintf(stderr, "ERROR: unsupported regex `%s`\n", grep_opts.pattern);
+            return 1;
+        }
+    }
+
+    bool index_query = false;
+    if (*index) {
+        const char* action = *index_action ? *index_action : "";
+        index_query = strcmp(action, "query") == 0;
+        if (!index_query && strcmp(action, "build") != 0 && strcmp(action, "update") != 0) {
+            fprintf(stderr, "ERROR: index ACTION must be build, update or query\n");
+            return 1;
+        }
+        if (index_query ? index_args->len == 0 : index_args->len != 1) {
+            fprintf(stderr, "ERROR: index %s takes %s\n", action,
+                    index_query ? "at least one term" : "exactly one DIR");
+            return 1;
+        }
+    }
+    // a query only reads the mapped index
+    if (*index && index_query) {
+        return runIndexQuery(*index_out, index_args);
+    }
+
+    bool info_json = false;
+    if (*info) {
+        if (info_files->len == 0) {
+            fprintf(stderr, "ERROR: at least one file is required\n");
+            return 1;
+        }
+        info_json = strcmp(*info_format, "json") == 0;
+        if (!info_json && strcmp(*info_format, "tsv") != 0) {
+            fprintf(stderr, "ERROR: unknown format `%s`\n", *info_format);
+            return 1;
+        }
+    }
+
+    fz_context* ctx = fz_new_context(NULL, workersLocks(), FZ_STORE_UNLIMITED);
+    if (!ctx) {
+        fprintf(stderr, "ERROR: failed initializing fz_context\n");
+        return 1;
+    }
+    DEFER(cleanCtx, ctx);
+
+    // Registering every handler (XPS, EPUB, CBZ, images...) costs more than a
+    // one-page subpdf itself; PDF-only commands call the PDF opener directly.
+    if (!*subpdf && !*index_xref && !*pool && !*burst && !*split_size) {
+        fz_try(ctx) {
+            fz_register_document_handlers(ctx);
+        }
+        fz_catch(ctx) {
+            const char* msg = fz_caught_message(ctx);
+            fprintf(stderr, "ERROR: %s\n", msg ? msg : "(unknown)");
+            return 1;
+        }
+    }
+
+    if (*pool) {
+        return runPoolWorker(ctx);
+    }
+    if (*split_size) {
+        return runSplitSize(ctx, *split_in, *split_out, split_max_bytes);
+    }
+    if (*burst) {
+        return runBurst(ctx, *burst_in, *burst_out, (int)*burst_every, *burst_sparse,
+                        (int)*burst_jobs);
+    }
+    if (*text) {
+        return runPageStream(ctx, *text_in, *text_range, *text_out, (int)*text_jobs,
+                             extractText, writePageText);
+    }
+    if (*index_xref) {
+        fz_try(ctx) {
+            sidecarWrite(ctx, *index_xref_in);
+        }
+        fz_catch(ctx) {
+            const char* msg = fz_caught_message(ctx);
+            fprintf(stderr, "ERROR: %s\n", msg ? msg : "(unknown)");
+            return 1;
+        }
+        printf("Wrote %s%s\n", *index_xref_in, SIDECAR_EXT);
+        return 0;
+    }
+    if (*info) {
+        return runInfo(ctx, info_files, info_json, (int)*info_jobs);
+    }
+    if (*index) {
+        return runIndexBuild(ctx, ((const char**)index_args->items)[0], *index_out,
+                             (int)*index_jobs, strcmp(*index_action, "update") == 0);
+    }
+    if (*grep) {
+        return runGrep(ctx, &grep_opts, grep_files, *grep_files_only, *grep_max,
+                       (int)*grep_jobs);
+    }
+    if (*words) {
+        return runPageStream(ctx, *words_in, *words_range, *words_out, (int)*words_jobs,
+                             extractWords, writePageWords);
+    }
+
+    if (*render && *render_bench) {
+        return runRenderBench(ctx, *render_in, *render_range, &render_opts);
+    }
+    if (*render) {
+        return runRender(ctx, *render_in, *render_range, *render_out,
+                         &render_opts, (int)*render_jobs);
+    }
+
+    if (*subpdf_each_page) {
+        return runSubpdfArchive(ctx, *in_path, *range, *subpdf_archive, *sparse);
+    }
+    if (*subpdf_recursive) {
+        // no default here: writing a tree into "output.pdf/" would surprise
+        if (**out_path == '\0') {
+            fprintf(stderr, "ERROR: -R needs -o OUTDIR\n");
+            return 1;
+        }
+        return runSubpdfTree(ctx, *in_path, *range, *out_path, *sparse, *subpdf_sniff,
+                             (int)*subpdf_jobs);
+    }
+    return runSubpdf(ctx, *in_path, *range, **out_path ? *out_path : "output.pdf", *sparse);
 }
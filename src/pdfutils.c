@@ -0,0 +1,201 @@
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#include <mupdf/fitz.h>
+#include <mupdf/pdf.h>
+
+#define PDFUTILS_BUILD
+#include "pdfutils.h"
+
+// page ranges and page copying, shared with the CLI
+#include "subpdf.h"
+
+struct PdfutilsContext {
+    fz_context* ctx;
+    char err[256];
+};
+
+// a library must not print; failures reach the caller through err
+static void quietCallback(void* user, const char* message) {
+    (void)user;
+    (void)message;
+}
+
+int pdfutilsApiVersion(void) {
+    return PDFUTILS_API_VERSION;
+}
+
+PdfutilsContext* pdfutilsNew(void) {
+    PdfutilsContext* pc = calloc(1, sizeof(PdfutilsContext));
+    if (!pc) return NULL;
+
+    pc->ctx = fz_new_context(NULL, NULL, FZ_STORE_DEFAULT);
+    if (!pc->ctx) {
+        free(pc);
+        return NULL;
+    }
+    fz_set_error_callback(pc->ctx, quietCallback, NULL);
+    fz_set_warning_callback(pc->ctx, quietCallback, NULL);
+    return pc;
+}
+
+void pdfutilsFree(PdfutilsContext* pc) {
+    if (!pc) return;
+    fz_drop_context(pc->ctx);
+    free(pc);
+}
+
+const char* pdfutilsLastError(const PdfutilsContext* pc) {
+    return pc ? pc->err : "no context";
+}
+
+/**********/
+/* Output */
+/**********/
+typedef struct {
+    PdfutilsWriteFn write;
+    void* user;
+    int64_t pos; // pdf_write_document asks for offsets as it goes
+    bool failed;
+} Sink;
+
+static void sinkWrite(fz_context* ctx, void* state, const void* data, size_t n) {
+    Sink* sink = state;
+    if (sink->write(sink->user, data, n) != 0) {
+        sink->failed = true;
+        fz_throw(ctx, FZ_ERROR_GENERIC, "write callback failed");
+    }
+    sink->pos += (int64_t)n;
+}
+
+static int64_t sinkTell(fz_context* ctx, void* state) {
+    return ((Sink*)state)->pos;
+}
+
+int pdfutilsBufferWrite(void* user, const void* data, size_t len) {
+    PdfutilsBuffer* buffer = user;
+    if (len > buffer->cap - buffer->len) {
+        size_t cap = buffer->cap ? buffer->cap : 64 * 1024;
+        while (cap - buffer->len < len) {
+            if (cap > SIZE_MAX / 2) return 1;
+            cap *= 2;
+        }
+        unsigned char* grown = realloc(buffer->data, cap);
+        if (!grown) return 1;
+        buffer->data = grown;
+        buffer->cap = cap;
+    }
+    memcpy(buffer->data + buffer->len, data, len);
+    buffer->len += len;
+    return 0;
+}
+
+void pdfutilsBufferFree(PdfutilsBuffer* buffer) {
+    if (!buffer) return;
+    free(buffer->data);
+    memset(buffer, 0, sizeof(*buffer));
+}
+
+/**********/
+/* Subpdf */
+/**********/
+// reads from file when it is not NULL, else from data[0..len)
+static PdfutilsStatus runSubpdf(PdfutilsContext* pc, const void* data, size_t len,
+                                FILE* file, const char* range, unsigned flags,
+                                PdfutilsWriteFn write, void* user) {
+    fz_context* ctx = pc->ctx;
+    fz_stream* stm = NULL;
+    pdf_document* src = NULL;
+    pdf_document* dst = NULL;
+    fz_output* out = NULL;
+    const int* idx = NULL;
+    Sink sink = { .write = write, .user = user };
+    PdfutilsStatus status = PDFUTILS_OK;
+
+    fz_var(stm);
+    fz_var(src);
+    fz_var(dst);
+    fz_var(out);
+    fz_var(idx);
+    fz_var(status);
+
+    pc->err[0] = '\0';
+
+    fz_try(ctx) {
+        stm = file ? fz_open_file_ptr_no_close(ctx, file)
+                   : fz_open_memory(ctx, (const unsigned char*)data, len);
+        src = pdf_open_document_with_stream(ctx, stm);
+
+        int n_idx = 0;
+        idx = subpdfParseRange(range, pdf_count_pages(ctx, src), &n_idx);
+        if (!idx || n_idx == 0) {
+            status = PDFUTILS_ERR_RANGE;
+            fz_throw(ctx, FZ_ERROR_GENERIC, "bad page range or empty");
+        }
+
+        dst = subpdfExtract(ctx, src, NULL, idx, n_idx, (flags & PDFUTILS_SPARSE) != 0);
+
+        out = fz_new_output(ctx, 64 * 1024, &sink, sinkWrite, NULL, NULL);
+        out->tell = sinkTell;
+        pdf_write_document(ctx, dst, out, NULL);
+        fz_close_output(ctx, out);
+    }
+    fz_always(ctx) {
+        fz_drop_output(ctx, out);
+        if (dst) pdf_drop_document(ctx, dst);
+        if (src) pdf_drop_document(ctx, src);
+        fz_drop_stream(ctx, stm);
+        free((void*)idx);
+    }
+    fz_catch(ctx) {
+        if (status == PDFUTILS_OK) status = sink.failed ? PDFUTILS_ERR_WRITE : PDFUTILS_ERR_PDF;
+        const char* msg = fz_caught_message(ctx);
+        snprintf(pc->err, sizeof(pc->err), "%s", msg ? msg : "(unknown)");
+    }
+
+    return status;
+}
+
+PdfutilsStatus pdfutilsSubpdf(PdfutilsContext* pc, const void* data, size_t len,
+                              const char* range, unsigned flags,
+                              PdfutilsWriteFn write, void* user) {
+    if (!pc || !data || !range || !write) return PDFUTILS_ERR_ARGS;
+    return runSubpdf(pc, data, len, NULL, range, flags, write, user);
+}
+
+PdfutilsStatus pdfutilsSubpdfFd(PdfutilsContext* pc, int fd, const char* range,
+                                unsigned flags, PdfutilsWriteFn write, void* user) {
+    if (!pc || fd < 0 || !range || !write) return PDFUTILS_ERR_ARGS;
+
+    // a duplicate, so closing the FILE leaves the caller's fd open
+#ifdef _WIN32
+    int dup_fd = _dup(fd);
+    FILE* file = dup_fd < 0 ? NULL : _fdopen(dup_fd, "rb");
+    if (!file && dup_fd >= 0) _close(dup_fd);
+#else
+    int dup_fd = dup(fd);
+    FILE* file = dup_fd < 0 ? NULL : fdopen(dup_fd, "rb");
+    if (!file && dup_fd >= 0) close(dup_fd);
+#endif
+    if (!file) {
+        snprintf(pc->err, sizeof(pc->err), "cannot read from fd %d", fd);
+        return PDFUTILS_ERR_ARGS;
+    }
+
+    PdfutilsStatus status = runSubpdf(pc, NULL, 0, file, range, flags, write, user);
+    fclose(file);
+    return status;
+}
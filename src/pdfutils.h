@@ -0,0 +1,90 @@
+#ifndef _PDFUTILS
+#define _PDFUTILS
+
+// libpdfutils: the subpdf command as a C library, for programs that would
+// otherwise spawn the CLI and pass temp files around. Input and output stay
+// in memory.
+//
+// A PdfutilsContext keeps MuPDF's caches between calls. It may be reused for
+// any number of calls but by one thread at a time; use one per thread.
+//
+//     PdfutilsContext* pc = pdfutilsNew();
+//     PdfutilsBuffer out = {0};
+//     if (pdfutilsSubpdf(pc, data, len, "3-5,8", 0, pdfutilsBufferWrite, &out))
+//         fprintf(stderr, "%s\n", pdfutilsLastError(pc));
+//     ...
+//     pdfutilsBufferFree(&out);
+//     pdfutilsFree(pc);
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#if defined(_WIN32) && defined(PDFUTILS_SHARED)
+#   ifdef PDFUTILS_BUILD
+#       define PDFUTILS_API __declspec(dllexport)
+#   else
+#       define PDFUTILS_API __declspec(dllimport)
+#   endif
+#elif defined(PDFUTILS_BUILD) && (defined(__GNUC__) || defined(__clang__))
+#   define PDFUTILS_API __attribute__((visibility("default")))
+#else
+#   define PDFUTILS_API
+#endif
+
+// bumped on any incompatible change to the declarations below
+#define PDFUTILS_API_VERSION 1
+
+typedef enum {
+    PDFUTILS_OK = 0,
+    PDFUTILS_ERR_ARGS,  // NULL where a pointer is required
+    PDFUTILS_ERR_RANGE, // range is malformed, empty or past the last page
+    PDFUTILS_ERR_PDF,   // input cannot be read as a PDF or copied
+    PDFUTILS_ERR_WRITE, // the write callback returned nonzero
+} PdfutilsStatus;
+
+// flags
+#define PDFUTILS_SPARSE 0x1u // read only the page-tree path to each page
+
+typedef struct PdfutilsContext PdfutilsContext;
+
+// Receives the output in order, in pieces. Returning nonzero aborts the call.
+typedef int (*PdfutilsWriteFn)(void* user, const void* data, size_t len);
+
+// growable output buffer, filled by passing pdfutilsBufferWrite and &buffer
+typedef struct {
+    unsigned char* data;
+    size_t len;
+    size_t cap;
+} PdfutilsBuffer;
+
+PDFUTILS_API int pdfutilsApiVersion(void);
+
+// NULL when out of memory
+PDFUTILS_API PdfutilsContext* pdfutilsNew(void);
+PDFUTILS_API void pdfutilsFree(PdfutilsContext* pc);
+
+// message for the last failed call, "" after a successful one
+PDFUTILS_API const char* pdfutilsLastError(const PdfutilsContext* pc);
+
+// Writes a PDF holding the pages in range (ex: 3-5,8) of the PDF in
+// data[0..len). data is only read during the call.
+PDFUTILS_API PdfutilsStatus pdfutilsSubpdf(PdfutilsContext* pc, const void* data, size_t len,
+                                           const char* range, unsigned flags,
+                                           PdfutilsWriteFn write, void* user);
+
+// Same, reading the PDF from fd. fd stays open but its offset is moved.
+PDFUTILS_API PdfutilsStatus pdfutilsSubpdfFd(PdfutilsContext* pc, int fd, const char* range,
+                                             unsigned flags, PdfutilsWriteFn write, void* user);
+
+// a PdfutilsWriteFn appending to the PdfutilsBuffer in user
+PDFUTILS_API int pdfutilsBufferWrite(void* user, const void* data, size_t len);
+PDFUTILS_API void pdfutilsBufferFree(PdfutilsBuffer* buffer);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _PDFUTILS
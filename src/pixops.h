@@ -0,0 +1,380 @@
+#ifndef _PIXOPS
+#define _PIXOPS
+
+// Post-processing kernels that run directly on 8-bit pixmap samples.
+// Every kernel has a scalar version; on x86 a 128-bit and an AVX2 version are
+// picked at runtime from cpuid, so the binary still runs on any x86-64 CPU.
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#if __STDC_VERSION__ < 202311L // on c23, bool is introduced
+#include <stdbool.h>
+#endif
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64)
+#define PIXOPS_X86
+#include <cpuid.h>
+#include <immintrin.h>
+#define PIXOPS_TARGET(_isa) __attribute__((target(_isa)))
+#endif
+
+typedef enum {
+    PIXOPS_SCALAR = 0,
+    PIXOPS_SSE,     // SSE2, plus SSSE3 for the RGB deinterleave
+    PIXOPS_AVX2,
+} PixopsLevel;
+
+static PixopsLevel pixopsDetect(void) {
+#ifdef PIXOPS_X86
+    unsigned a, b, c, d;
+    if (!__get_cpuid(1, &a, &b, &c, &d)) return PIXOPS_SCALAR;
+
+    bool ssse3 = c & bit_SSSE3;
+    bool osxsave = c & bit_OSXSAVE;
+    bool avx = c & bit_AVX;
+    if (!ssse3) return PIXOPS_SCALAR;
+    if (!osxsave || !avx) return PIXOPS_SSE;
+
+    // the OS must save the ymm registers too
+    unsigned xcr0_lo, xcr0_hi;
+    __asm__ volatile("xgetbv" : "=a"(xcr0_lo), "=d"(xcr0_hi) : "c"(0));
+    if ((xcr0_lo & 0x6) != 0x6) return PIXOPS_SSE;
+
+    if (!__get_cpuid_count(7, 0, &a, &b, &c, &d)) return PIXOPS_SSE;
+    return (b & bit_AVX2) ? PIXOPS_AVX2 : PIXOPS_SSE;
+#else
+    return PIXOPS_SCALAR;
+#endif
+}
+
+// Written once by pixopsInit, before any thread runs a kernel, and only read
+// after; kernels stay scalar if it is never called.
+static PixopsLevel pixops_level = PIXOPS_SCALAR;
+
+static void pixopsInit(void) {
+    pixops_level = pixopsDetect();
+}
+
+static PixopsLevel pixopsLevel(void) {
+    return pixops_level;
+}
+
+/**********************/
+/* RGB to gray (luma) */
+/**********************/
+// BT.601 weights in 8.8 fixed point; they sum to 256 so white stays 255.
+#define PIXOPS_WR 77
+#define PIXOPS_WG 150
+#define PIXOPS_WB 29
+
+static void pixopsRgbToGrayScalar(const uint8_t* rgb, uint8_t* gray, size_t n) {
+    for (size_t i = 0; i < n; ++i, rgb += 3) {
+        gray[i] = (uint8_t)((PIXOPS_WR * rgb[0] + PIXOPS_WG * rgb[1] +
+                             PIXOPS_WB * rgb[2] + 128) >> 8);
+    }
+}
+
+#ifdef PIXOPS_X86
+// splits 16 packed RGB pixels into one register per channel
+PIXOPS_TARGET("ssse3")
+static inline void pixopsDeinterleave16(const uint8_t* rgb,
+                                        __m128i* r, __m128i* g, __m128i* b) {
+    __m128i x = _mm_loadu_si128((const __m128i*)rgb);
+    __m128i y = _mm_loadu_si128((const __m128i*)(rgb + 16));
+    __m128i z = _mm_loadu_si128((const __m128i*)(rgb + 32));
+
+    *r = _mm_or_si128(_mm_or_si128(
+        _mm_shuffle_epi8(x, _mm_setr_epi8(0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1)),
+        _mm_shuffle_epi8(y, _mm_setr_epi8(-1, -1, -1, -1, -1, -1, 2, 5, 8, 11, 14, -1, -1, -1, -1, -1))),
+        _mm_shuffle_epi8(z, _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 1, 4, 7, 10, 13)));
+    *g = _mm_or_si128(_mm_or_si128(
+        _mm_shuffle_epi8(x, _mm_setr_epi8(1, 4, 7, 10, 13, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1)),
+        _mm_shuffle_epi8(y, _mm_setr_epi8(-1, -1, -1, -1, -1, 0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1))),
+        _mm_shuffle_epi8(z, _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 2, 5, 8, 11, 14)));
+    *b = _mm_or_si128(_mm_or_si128(
+        _mm_shuffle_epi8(x, _mm_setr_epi8(2, 5, 8, 11, 14, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1)),
+        _mm_shuffle_epi8(y, _mm_setr_epi8(-1, -1, -1, -1, -1, 1, 4, 7, 10, 13, -1, -1, -1, -1, -1, -1))),
+        _mm_shuffle_epi8(z, _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 0, 3, 6, 9, 12, 15)));
+}
+
+PIXOPS_TARGET("ssse3")
+static inline __m128i pixopsLuma8(__m128i r, __m128i g, __m128i b) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i wr = _mm_set1_epi16(PIXOPS_WR);
+    const __m128i wg = _mm_set1_epi16(PIXOPS_WG);
+    const __m128i wb = _mm_set1_epi16(PIXOPS_WB);
+    const __m128i half = _mm_set1_epi16(128);
+
+    // the weighted sum is below 2^16, so wrapping 16-bit adds are exact
+    __m128i lo = _mm_add_epi16(_mm_add_epi16(
+        _mm_mullo_epi16(_mm_unpacklo_epi8(r, zero), wr),
+        _mm_mullo_epi16(_mm_unpacklo_epi8(g, zero), wg)), _mm_add_epi16(
+        _mm_mullo_epi16(_mm_unpacklo_epi8(b, zero), wb), half));
+    __m128i hi = _mm_add_epi16(_mm_add_epi16(
+        _mm_mullo_epi16(_mm_unpackhi_epi8(r, zero), wr),
+        _mm_mullo_epi16(_mm_unpackhi_epi8(g, zero), wg)), _mm_add_epi16(
+        _mm_mullo_epi16(_mm_unpackhi_epi8(b, zero), wb), half));
+
+    return _mm_packus_epi16(_mm_srli_epi16(lo, 8), _mm_srli_epi16(hi, 8));
+}
+
+PIXOPS_TARGET("ssse3")
+static void pixopsRgbToGraySse(const uint8_t* rgb, uint8_t* gray, size_t n) {
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i r, g, b;
+        pixopsDeinterleave16(rgb + 3 * i, &r, &g, &b);
+        _mm_storeu_si128((__m128i*)(gray + i), pixopsLuma8(r, g, b));
+    }
+    pixopsRgbToGrayScalar(rgb + 3 * i, gray + i, n - i);
+}
+
+PIXOPS_TARGET("avx2")
+static void pixopsRgbToGrayAvx2(const uint8_t* rgb, uint8_t* gray, size_t n) {
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i wr = _mm256_set1_epi16(PIXOPS_WR);
+    const __m256i wg = _mm256_set1_epi16(PIXOPS_WG);
+    const __m256i wb = _mm256_set1_epi16(PIXOPS_WB);
+    const __m256i half = _mm256_set1_epi16(128);
+
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m128i r0, g0, b0, r1, g1, b1;
+        pixopsDeinterleave16(rgb + 3 * i, &r0, &g0, &b0);
+        pixopsDeinterleave16(rgb + 3 * i + 48, &r1, &g1, &b1);
+        __m256i r = _mm256_inserti128_si256(_mm256_castsi128_si256(r0), r1, 1);
+        __m256i g = _mm256_inserti128_si256(_mm256_castsi128_si256(g0), g1, 1);
+        __m256i b = _mm256_inserti128_si256(_mm256_castsi128_si256(b0), b1, 1);
+
+        __m256i lo = _mm256_add_epi16(_mm256_add_epi16(
+            _mm256_mullo_epi16(_mm256_unpacklo_epi8(r, zero), wr),
+            _mm256_mullo_epi16(_mm256_unpacklo_epi8(g, zero), wg)), _mm256_add_epi16(
+            _mm256_mullo_epi16(_mm256_unpacklo_epi8(b, zero), wb), half));
+        __m256i hi = _mm256_add_epi16(_mm256_add_epi16(
+            _mm256_mullo_epi16(_mm256_unpackhi_epi8(r, zero), wr),
+            _mm256_mullo_epi16(_mm256_unpackhi_epi8(g, zero), wg)), _mm256_add_epi16(
+            _mm256_mullo_epi16(_mm256_unpackhi_epi8(b, zero), wb), half));
+
+        // unpack and pack both work per 128-bit lane, so the order comes back
+        _mm256_storeu_si256((__m256i*)(gray + i), _mm256_packus_epi16(
+            _mm256_srli_epi16(lo, 8), _mm256_srli_epi16(hi, 8)));
+    }
+    pixopsRgbToGraySse(rgb + 3 * i, gray + i, n - i);
+}
+#endif // PIXOPS_X86
+
+// converts n packed RGB pixels; gray may alias rgb since every step loads
+// its pixels before storing below them
+static void pixopsRgbToGray(const uint8_t* rgb, uint8_t* gray, size_t n) {
+#ifdef PIXOPS_X86
+    switch (pixopsLevel()) {
+    case PIXOPS_AVX2: pixopsRgbToGrayAvx2(rgb, gray, n); return;
+    case PIXOPS_SSE:  pixopsRgbToGraySse(rgb, gray, n);  return;
+    default: break;
+    }
+#endif
+    pixopsRgbToGrayScalar(rgb, gray, n);
+}
+
+/*************/
+/* Threshold */
+/*************/
+// Otsu's method over a 256-bin histogram
+static uint8_t pixopsOtsu(const uint64_t hist[256]) {
+    uint64_t total = 0;
+    double sum = 0;
+    for (int i = 0; i < 256; ++i) {
+        total += hist[i];
+        sum += (double)i * hist[i];
+    }
+    if (total == 0) return 128;
+
+    double sum_bg = 0, best = -1;
+    uint64_t w_bg = 0;
+    int threshold = 128;
+    for (int t = 0; t < 256; ++t) {
+        w_bg += hist[t];
+        if (w_bg == 0) continue;
+        uint64_t w_fg = total - w_bg;
+        if (w_fg == 0) break;
+
+        sum_bg += (double)t * hist[t];
+        double m_bg = sum_bg / w_bg;
+        double m_fg = (sum - sum_bg) / w_fg;
+        double between = (double)w_bg * w_fg * (m_bg - m_fg) * (m_bg - m_fg);
+        if (between > best) {
+            best = between;
+            threshold = t + 1;
+        }
+    }
+
+    return (uint8_t)(threshold > 255 ? 255 : threshold);
+}
+
+// four sub-histograms hide the store-to-load dependency on repeated values
+static void pixopsHistogram(const uint8_t* px, size_t n, uint64_t hist[256]) {
+    uint32_t sub[4][256];
+    memset(sub, 0, sizeof(sub));
+
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        ++sub[0][px[i]];
+        ++sub[1][px[i + 1]];
+        ++sub[2][px[i + 2]];
+        ++sub[3][px[i + 3]];
+    }
+    for (; i < n; ++i) ++sub[0][px[i]];
+
+    for (int k = 0; k < 256; ++k)
+        hist[k] += (uint64_t)sub[0][k] + sub[1][k] + sub[2][k] + sub[3][k];
+}
+
+static void pixopsThresholdScalar(uint8_t* px, size_t n, uint8_t t) {
+    for (size_t i = 0; i < n; ++i) px[i] = px[i] < t ? 0 : 255;
+}
+
+#ifdef PIXOPS_X86
+PIXOPS_TARGET("sse2")
+static void pixopsThresholdSse(uint8_t* px, size_t n, uint8_t t) {
+    // unsigned x >= t  <=>  max(x, t) == x
+    const __m128i vt = _mm_set1_epi8((char)t);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i x = _mm_loadu_si128((const __m128i*)(px + i));
+        _mm_storeu_si128((__m128i*)(px + i),
+                         _mm_cmpeq_epi8(_mm_max_epu8(x, vt), x));
+    }
+    pixopsThresholdScalar(px + i, n - i, t);
+}
+
+PIXOPS_TARGET("avx2")
+static void pixopsThresholdAvx2(uint8_t* px, size_t n, uint8_t t) {
+    const __m256i vt = _mm256_set1_epi8((char)t);
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m256i x = _mm256_loadu_si256((const __m256i*)(px + i));
+        _mm256_storeu_si256((__m256i*)(px + i),
+                            _mm256_cmpeq_epi8(_mm256_max_epu8(x, vt), x));
+    }
+    pixopsThresholdSse(px + i, n - i, t);
+}
+#endif // PIXOPS_X86
+
+// maps every sample to 0 (below t) or 255, in place
+static void pixopsThreshold(uint8_t* px, size_t n, uint8_t t) {
+#ifdef PIXOPS_X86
+    switch (pixopsLevel()) {
+    case PIXOPS_AVX2: pixopsThresholdAvx2(px, n, t); return;
+    case PIXOPS_SSE:  pixopsThresholdSse(px, n, t);  return;
+    default: break;
+    }
+#endif
+    pixopsThresholdScalar(px, n, t);
+}
+
+/*****************/
+/* 1-bit packing */
+/*****************/
+// movemask yields the first pixel in bit 0, PBM wants it in bit 7
+static const uint8_t pixops_bitrev[256] = {
+#define R2(n) n, n + 2*64, n + 1*64, n + 3*64
+#define R4(n) R2(n), R2(n + 2*16), R2(n + 1*16), R2(n + 3*16)
+#define R6(n) R4(n), R4(n + 2*4), R4(n + 1*4), R4(n + 3*4)
+    R6(0), R6(2), R6(1), R6(3)
+#undef R6
+#undef R4
+#undef R2
+};
+
+static void pixopsPackScalar(const uint8_t* px, uint8_t* bits, size_t n, uint8_t t) {
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        uint8_t byte = 0;
+        for (int k = 0; k < 8; ++k) byte = (byte << 1) | (px[i + k] < t);
+        *bits++ = byte;
+    }
+    if (i < n) {
+        uint8_t byte = 0;
+        for (int k = 0; k < 8; ++k)
+            byte = (byte << 1) | (i + k < n && px[i + k] < t);
+        *bits = byte;
+    }
+}
+
+#ifdef PIXOPS_X86
+PIXOPS_TARGET("sse2")
+static void pixopsPackSse(const uint8_t* px, uint8_t* bits, size_t n, uint8_t t) {
+    const __m128i vt = _mm_set1_epi8((char)t);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i x = _mm_loadu_si128((const __m128i*)(px + i));
+        // black where x < t, i.e. where max(x, t) != x
+        unsigned white = (unsigned)_mm_movemask_epi8(
+            _mm_cmpeq_epi8(_mm_max_epu8(x, vt), x));
+        unsigned black = ~white;
+        *bits++ = pixops_bitrev[black & 0xff];
+        *bits++ = pixops_bitrev[(black >> 8) & 0xff];
+    }
+    pixopsPackScalar(px + i, bits, n - i, t);
+}
+
+PIXOPS_TARGET("avx2")
+static void pixopsPackAvx2(const uint8_t* px, uint8_t* bits, size_t n, uint8_t t) {
+    const __m256i vt = _mm256_set1_epi8((char)t);
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m256i x = _mm256_loadu_si256((const __m256i*)(px + i));
+        uint32_t black = ~(uint32_t)_mm256_movemask_epi8(
+            _mm256_cmpeq_epi8(_mm256_max_epu8(x, vt), x));
+        *bits++ = pixops_bitrev[black & 0xff];
+        *bits++ = pixops_bitrev[(black >> 8) & 0xff];
+        *bits++ = pixops_bitrev[(black >> 16) & 0xff];
+        *bits++ = pixops_bitrev[black >> 24];
+    }
+    pixopsPackSse(px + i, bits, n - i, t);
+}
+#endif // PIXOPS_X86
+
+// packs one row of n gray samples into (n + 7) / 8 bytes, 1 = black (< t),
+// most significant bit first as PBM expects
+static void pixopsPack(const uint8_t* px, uint8_t* bits, size_t n, uint8_t t) {
+#ifdef PIXOPS_X86
+    switch (pixopsLevel()) {
+    case PIXOPS_AVX2: pixopsPackAvx2(px, bits, n, t); return;
+    case PIXOPS_SSE:  pixopsPackSse(px, bits, n, t);  return;
+    default: break;
+    }
+#endif
+    pixopsPackScalar(px, bits, n, t);
+}
+
+/****************/
+/* Tone mapping */
+/****************/
+// Builds a lookup table for levels (black/white points) followed by gamma.
+static void pixopsToneLut(uint8_t lut[256], uint8_t black, uint8_t white, double gamma) {
+    if (white <= black) white = black + 1;
+    for (int i = 0; i < 256; ++i) {
+        double v = (double)(i - black) / (double)(white - black);
+        v = v < 0 ? 0 : v > 1 ? 1 : v;
+        if (gamma != 1.0) v = pow(v, 1.0 / gamma);
+        lut[i] = (uint8_t)(v * 255.0 + 0.5);
+    }
+}
+
+// A 256-entry table stays in L1, so plain indexing beats a gather here.
+static void pixopsApplyLut(uint8_t* px, size_t n, const uint8_t lut[256]) {
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        px[i] = lut[px[i]];
+        px[i + 1] = lut[px[i + 1]];
+        px[i + 2] = lut[px[i + 2]];
+        px[i + 3] = lut[px[i + 3]];
+    }
+    for (; i < n; ++i) px[i] = lut[px[i]];
+}
+
+#endif // _PIXOPS
@@ -0,0 +1,186 @@
+#ifndef _SEARCH
+#define _SEARCH
+
+// Pattern search over extracted page text.
+// Literal patterns use a SIMD first/last byte filter: each block of
+// candidate positions is kept only if both the first and the last byte of
+// the needle match there, and only those candidates get a memcmp. Regex
+// patterns are a small backtracking subset, matched one line at a time.
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#if __STDC_VERSION__ < 202311L // on c23, bool is introduced
+#include <stdbool.h>
+#endif
+
+#include "pixops.h" // cpuid dispatch
+
+/***********/
+/* Literal */
+/***********/
+static const char* searchLiteralScalar(const char* hay, size_t n, const char* needle,
+                                       size_t m) {
+    if (m == 0) return hay;
+    const char* end = hay + n - m + 1;
+    for (const char* p = hay; p < end; ++p) {
+        p = memchr(p, needle[0], (size_t)(end - p));
+        if (!p) return NULL;
+        if (memcmp(p + 1, needle + 1, m - 1) == 0) return p;
+    }
+    return NULL;
+}
+
+#ifdef PIXOPS_X86
+PIXOPS_TARGET("sse2")
+static const char* searchLiteralSse(const char* hay, size_t n, const char* needle,
+                                    size_t m) {
+    __m128i first = _mm_set1_epi8(needle[0]);
+    __m128i last = _mm_set1_epi8(needle[m - 1]);
+    size_t i = 0;
+
+    for (; i + m - 1 + 16 <= n; i += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i*)(hay + i));
+        __m128i b = _mm_loadu_si128((const __m128i*)(hay + i + m - 1));
+        unsigned mask = (unsigned)_mm_movemask_epi8(
+            _mm_and_si128(_mm_cmpeq_epi8(a, first), _mm_cmpeq_epi8(b, last)));
+        while (mask) {
+            unsigned bit = (unsigned)__builtin_ctz(mask);
+            if (memcmp(hay + i + bit + 1, needle + 1, m - 1) == 0) return hay + i + bit;
+            mask &= mask - 1;
+        }
+    }
+
+    return searchLiteralScalar(hay + i, n - i, needle, m);
+}
+
+PIXOPS_TARGET("avx2")
+static const char* searchLiteralAvx2(const char* hay, size_t n, const char* needle,
+                                     size_t m) {
+    __m256i first = _mm256_set1_epi8(needle[0]);
+    __m256i last = _mm256_set1_epi8(needle[m - 1]);
+    size_t i = 0;
+
+    for (; i + m - 1 + 32 <= n; i += 32) {
+        __m256i a = _mm256_loadu_si256((const __m256i*)(hay + i));
+        __m256i b = _mm256_loadu_si256((const __m256i*)(hay + i + m - 1));
+        unsigned mask = (unsigned)_mm256_movemask_epi8(
+            _mm256_and_si256(_mm256_cmpeq_epi8(a, first), _mm256_cmpeq_epi8(b, last)));
+        while (mask) {
+            unsigned bit = (unsigned)__builtin_ctz(mask);
+            if (memcmp(hay + i + bit + 1, needle + 1, m - 1) == 0) return hay + i + bit;
+            mask &= mask - 1;
+        }
+    }
+
+    return searchLiteralScalar(hay + i, n - i, needle, m);
+}
+#endif
+
+// first occurrence of needle[0..m) in hay[0..n), or NULL
+static const char* searchLiteral(const char* hay, size_t n, const char* needle, size_t m) {
+    if (m > n) return NULL;
+    if (m < 2) return searchLiteralScalar(hay, n, needle, m);
+#ifdef PIXOPS_X86
+    switch (pixopsLevel()) {
+    case PIXOPS_AVX2: return searchLiteralAvx2(hay, n, needle, m);
+    case PIXOPS_SSE: return searchLiteralSse(hay, n, needle, m);
+    default: break;
+    }
+#endif
+    return searchLiteralScalar(hay, n, needle, m);
+}
+
+/*********/
+/* Regex */
+/*********/
+// Supported: literal bytes, `.`, `[...]` with ranges and `^` negation,
+// `\` escapes, the postfix operators `*`, `+`, `?`, and `^`/`$` anchors.
+// There is no grouping or alternation, which keeps backtracking polynomial.
+
+// length of the atom at re, or 0 if it is malformed
+static size_t searchAtomLen(const char* re) {
+    if (re[0] == '\\') return re[1] ? 2 : 0;
+    if (re[0] != '[') return 1;
+
+    size_t i = 1;
+    if (re[i] == '^') ++i;
+    if (re[i] == ']') ++i; // a leading `]` is literal
+    while (re[i] && re[i] != ']') ++i;
+    return re[i] ? i + 1 : 0;
+}
+
+static bool searchAtomMatches(const char* re, size_t len, unsigned char c) {
+    if (re[0] == '\\') return (unsigned char)re[1] == c;
+    if (re[0] == '.') return true;
+    if (re[0] != '[') return (unsigned char)re[0] == c;
+
+    size_t i = 1;
+    bool negate = re[i] == '^';
+    if (negate) ++i;
+    bool found = false;
+    for (; i < len - 1; ++i) {
+        unsigned char lo = (unsigned char)re[i];
+        unsigned char hi = lo;
+        if (re[i + 1] == '-' && i + 2 < len - 1) {
+            hi = (unsigned char)re[i + 2];
+            i += 2;
+        }
+        if (lo <= c && c <= hi) found = true;
+    }
+    return found != negate;
+}
+
+// true if the whole pattern is in the supported subset
+static bool searchRegexValid(const char* re) {
+    if (*re == '^') ++re;
+    while (*re) {
+        if (*re == '*' || *re == '+' || *re == '?') return false; // nothing to repeat
+        if (re[0] == '$' && re[1] == '\0') return true;
+        size_t len = searchAtomLen(re);
+        if (!len) return false;
+        re += len;
+        if (*re == '*' || *re == '+' || *re == '?') ++re;
+    }
+    return true;
+}
+
+static bool searchRegexHere(const char* re, const char* s, const char* end) {
+    for (;;) {
+        if (*re == '\0') return true;
+        if (re[0] == '$' && re[1] == '\0') return s == end;
+
+        size_t len = searchAtomLen(re);
+        char op = re[len];
+        if (op == '*' || op == '+' || op == '?') {
+            size_t min = op == '+' ? 1 : 0;
+            size_t max = op == '?' ? 1 : (size_t)(end - s);
+            size_t n = 0;
+            while (n < max && s + n < end &&
+                   searchAtomMatches(re, len, (unsigned char)s[n]))
+                ++n;
+            // greedy: try the longest run first
+            for (;;) {
+                if (n < min) return false;
+                if (searchRegexHere(re + len + 1, s + n, end)) return true;
+                if (n-- == 0) return false;
+            }
+        }
+
+        if (s == end || !searchAtomMatches(re, len, (unsigned char)*s)) return false;
+        re += len;
+        ++s;
+    }
+}
+
+// true if re matches anywhere in the line [s, end)
+static bool searchRegex(const char* re, const char* s, const char* end) {
+    if (*re == '^') return searchRegexHere(re + 1, s, end);
+    do {
+        if (searchRegexHere(re, s, end)) return true;
+    } while (s++ < end);
+    return false;
+}
+
+#endif // _SEARCH
@@ -0,0 +1,392 @@
+#ifndef _SIDECAR
+#define _SIDECAR
+
+// An xref sidecar (`IN.pxi`) lets a big or damaged PDF open without parsing
+// or repairing its xref. It holds the xref exactly as MuPDF resolved it,
+// written as one xref stream whose offsets point into the original file,
+// plus the page object numbers and a fingerprint of the file.
+//
+// To open, the PDF is read through a stream that appends the sidecar's xref
+// bytes to the file, so MuPDF finds a single valid xref right at the end.
+//
+// Layout:
+//   %PXI1\n
+//   <size> <mtime> <head hash> <tail hash>\n
+//   <page count>\n  then one u32 little-endian object number per page
+//   <xref bytes>\n  then the bytes to append to the file
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <mupdf/fitz.h>
+#include <mupdf/pdf.h>
+
+#include "fsutil.h"
+
+#define SIDECAR_MAGIC "%PXI1\n"
+#define SIDECAR_EXT ".pxi"
+#define SIDECAR_PROBE (64 * 1024) // bytes hashed at each end of the file
+
+typedef struct {
+    pdf_document* doc;
+    int* pages; // object number of every page
+    int page_count;
+} Sidecar;
+
+static void sidecarPath(char* out, size_t n, const char* in_path) {
+    snprintf(out, n, "%s%s", in_path, SIDECAR_EXT);
+}
+
+static uint64_t sidecarHash(const unsigned char* p, size_t n) {
+    uint64_t h = 0xcbf29ce484222325ull;
+    for (size_t i = 0; i < n; ++i) {
+        h ^= p[i];
+        h *= 0x100000001b3ull;
+    }
+    return h;
+}
+
+// hashes of the first and last SIDECAR_PROBE bytes
+static void sidecarFingerprint(fz_context* ctx, const char* path, uint64_t size,
+                               uint64_t* head, uint64_t* tail) {
+    fz_stream* stm = fz_open_file(ctx, path);
+    unsigned char* buf = NULL;
+
+    fz_var(buf);
+
+    fz_try(ctx) {
+        buf = fz_malloc(ctx, SIDECAR_PROBE);
+        size_t n = fz_read(ctx, stm, buf, SIDECAR_PROBE);
+        *head = sidecarHash(buf, n);
+
+        int64_t from = size > SIDECAR_PROBE ? (int64_t)(size - SIDECAR_PROBE) : 0;
+        fz_seek(ctx, stm, from, SEEK_SET);
+        n = fz_read(ctx, stm, buf, SIDECAR_PROBE);
+        *tail = sidecarHash(buf, n);
+    }
+    fz_always(ctx) {
+        fz_free(ctx, buf);
+        fz_drop_stream(ctx, stm);
+    }
+    fz_catch(ctx) {
+        fz_rethrow(ctx);
+    }
+}
+
+static void sidecarPutBe(unsigned char* p, uint64_t v, int n) {
+    for (int i = n - 1; i >= 0; --i, v >>= 8) p[i] = (unsigned char)v;
+}
+
+// the xref stream and trailer to append to a file of file_size bytes
+static fz_buffer* sidecarXref(fz_context* ctx, pdf_document* doc, int64_t file_size) {
+    fz_buffer* data = NULL;
+    fz_buffer* out_buf = NULL;
+    fz_output* out = NULL;
+
+    fz_var(data);
+    fz_var(out_buf);
+    fz_var(out);
+
+    fz_try(ctx) {
+        int n = pdf_xref_len(ctx, doc);
+        data = fz_new_buffer(ctx, (size_t)(n + 1) * 9);
+
+        for (int num = 0; num < n; ++num) {
+            pdf_xref_entry* e = pdf_get_xref_entry(ctx, doc, num);
+            unsigned char row[9] = {0};
+            if (e && e->type == 'n' && num != 0) {
+                // objects made up by a repair have nothing to point at
+                if (e->ofs <= 0 || e->ofs >= file_size)
+                    fz_throw(ctx, FZ_ERROR_GENERIC, "object %d is not in the file", num);
+                row[0] = 1;
+                sidecarPutBe(row + 1, (uint64_t)e->ofs, 6);
+                sidecarPutBe(row + 7, e->gen, 2);
+            } else if (e && e->type == 'o') {
+                row[0] = 2;
+                sidecarPutBe(row + 1, (uint64_t)e->ofs, 6);
+                sidecarPutBe(row + 7, e->gen, 2);
+            }
+            fz_append_data(ctx, data, row, sizeof(row));
+        }
+
+        // the xref stream is object n, right after a separating newline
+        int64_t obj_ofs = file_size + 1;
+        unsigned char self[9] = {1};
+        sidecarPutBe(self + 1, (uint64_t)obj_ofs, 6);
+        fz_append_data(ctx, data, self, sizeof(self));
+
+        unsigned char* rows;
+        size_t rows_len = fz_buffer_storage(ctx, data, &rows);
+        char line[64];
+
+        out_buf = fz_new_buffer(ctx, rows_len + 512);
+        out = fz_new_output_with_buffer(ctx, out_buf);
+        fz_write_printf(ctx, out, "\n%d 0 obj\n<</Type/XRef/Size %d/W[1 6 2]", n, n + 1);
+
+        pdf_obj* trailer = pdf_trailer(ctx, doc);
+        pdf_obj* keys[] = { PDF_NAME(Root), PDF_NAME(Info), PDF_NAME(Encrypt), PDF_NAME(ID) };
+        const char* names[] = { "Root", "Info", "Encrypt", "ID" };
+        for (size_t i = 0; i < sizeof(keys) / sizeof(keys[0]); ++i) {
+            pdf_obj* val = pdf_dict_get(ctx, trailer, keys[i]);
+            if (!val) continue;
+            fz_write_printf(ctx, out, "/%s ", names[i]);
+            pdf_print_obj(ctx, out, val, 1, 1);
+        }
+
+        fz_write_printf(ctx, out, "/Length %d>>\nstream\n", (int)rows_len);
+        fz_write_data(ctx, out, rows, rows_len);
+        snprintf(line, sizeof(line), "\nendstream\nendobj\nstartxref\n%lld\n%%%%EOF\n",
+                 (long long)obj_ofs);
+        fz_write_string(ctx, out, line);
+        fz_close_output(ctx, out);
+    }
+    fz_always(ctx) {
+        fz_drop_output(ctx, out);
+        fz_drop_buffer(ctx, data);
+    }
+    fz_catch(ctx) {
+        fz_drop_buffer(ctx, out_buf);
+        fz_rethrow(ctx);
+    }
+
+    return out_buf;
+}
+
+// Opens in_path the normal way (repairing it if needed) and writes its
+// sidecar next to it.
+static void sidecarWrite(fz_context* ctx, const char* in_path) {
+    char path[1024], tmp_path[1040];
+    pdf_document* doc = NULL;
+    fz_buffer* xref = NULL;
+    fz_output* out = NULL;
+
+    fz_var(doc);
+    fz_var(xref);
+    fz_var(out);
+
+    sidecarPath(path, sizeof(path), in_path);
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+
+    fz_try(ctx) {
+        uint64_t size, mtime, head, tail;
+        if (!fsutilStat(in_path, &mtime, &size))
+            fz_throw(ctx, FZ_ERROR_GENERIC, "cannot stat %s", in_path);
+
+        doc = pdf_open_document(ctx, in_path);
+        int page_count = pdf_count_pages(ctx, doc);
+        xref = sidecarXref(ctx, doc, (int64_t)size);
+        sidecarFingerprint(ctx, in_path, size, &head, &tail);
+
+        char line[128];
+        snprintf(line, sizeof(line), "%llu %llu %llx %llx\n%d\n", (unsigned long long)size,
+                 (unsigned long long)mtime, (unsigned long long)head,
+                 (unsigned long long)tail, page_count);
+        out = fz_new_output_with_path(ctx, tmp_path, 0);
+        fz_write_string(ctx, out, SIDECAR_MAGIC);
+        fz_write_string(ctx, out, line);
+        for (int i = 0; i < page_count; ++i) {
+            pdf_obj* page = pdf_lookup_page_obj(ctx, doc, i);
+            if (!pdf_is_indirect(ctx, page))
+                fz_throw(ctx, FZ_ERROR_GENERIC, "page %d is not an indirect object", i + 1);
+            unsigned char num[4];
+            uint32_t v = (uint32_t)pdf_to_num(ctx, page);
+            num[0] = (unsigned char)v;
+            num[1] = (unsigned char)(v >> 8);
+            num[2] = (unsigned char)(v >> 16);
+            num[3] = (unsigned char)(v >> 24);
+            fz_write_data(ctx, out, num, sizeof(num));
+        }
+        unsigned char* xref_data;
+        size_t xref_len = fz_buffer_storage(ctx, xref, &xref_data);
+        fz_write_printf(ctx, out, "%d\n", (int)xref_len);
+        fz_write_data(ctx, out, xref_data, xref_len);
+        fz_close_output(ctx, out);
+        fz_drop_output(ctx, out);
+        out = NULL;
+
+        if (!fsutilReplace(tmp_path, path))
+            fz_throw(ctx, FZ_ERROR_GENERIC, "cannot write %s", path);
+    }
+    fz_always(ctx) {
+        fz_drop_output(ctx, out);
+        fz_drop_buffer(ctx, xref);
+        pdf_drop_document(ctx, doc);
+    }
+    fz_catch(ctx) {
+        remove(tmp_path);
+        fz_rethrow(ctx);
+    }
+}
+
+/******************/
+/* Appended xref  */
+/******************/
+typedef struct {
+    fz_stream* file;
+    int64_t file_size;
+    fz_buffer* tail; // xref bytes, logically at file_size
+    int64_t pos;
+    unsigned char buf[8192];
+} SidecarStream;
+
+static int sidecarNext(fz_context* ctx, fz_stream* stm, size_t max) {
+    SidecarStream* s = stm->state;
+    size_t n;
+    (void)max;
+
+    if (s->pos < s->file_size) {
+        size_t want = sizeof(s->buf);
+        if ((int64_t)want > s->file_size - s->pos) want = (size_t)(s->file_size - s->pos);
+        if (fz_tell(ctx, s->file) != s->pos) fz_seek(ctx, s->file, s->pos, SEEK_SET);
+        n = fz_read(ctx, s->file, s->buf, want);
+        stm->rp = s->buf;
+        stm->wp = s->buf + n;
+    } else {
+        unsigned char* data;
+        size_t len = fz_buffer_storage(ctx, s->tail, &data);
+        int64_t at = s->pos - s->file_size;
+        n = at < (int64_t)len ? len - (size_t)at : 0;
+        stm->rp = data + (n ? at : 0);
+        stm->wp = stm->rp + n;
+    }
+
+    s->pos += (int64_t)n;
+    stm->pos += (int64_t)n;
+    if (n == 0) return EOF;
+    return *stm->rp++;
+}
+
+static void sidecarSeek(fz_context* ctx, fz_stream* stm, int64_t offset, int whence) {
+    SidecarStream* s = stm->state;
+    int64_t total = s->file_size + (int64_t)fz_buffer_storage(ctx, s->tail, NULL);
+
+    if (whence == SEEK_END) offset += total;
+    if (offset < 0) offset = 0;
+    if (offset > total) offset = total;
+    s->pos = offset;
+    stm->pos = offset;
+    stm->rp = stm->wp = s->buf;
+}
+
+static void sidecarDropStream(fz_context* ctx, void* state) {
+    SidecarStream* s = state;
+    fz_drop_stream(ctx, s->file);
+    fz_drop_buffer(ctx, s->tail);
+    fz_free(ctx, s);
+}
+
+// takes ownership of file and tail
+static fz_stream* sidecarOpenStream(fz_context* ctx, fz_stream* file, int64_t file_size,
+                                    fz_buffer* tail) {
+    SidecarStream* s = NULL;
+    fz_try(ctx) {
+        s = fz_calloc(ctx, 1, sizeof(SidecarStream));
+    }
+    fz_catch(ctx) {
+        fz_drop_stream(ctx, file);
+        fz_drop_buffer(ctx, tail);
+        fz_rethrow(ctx);
+    }
+    s->file = file;
+    s->file_size = file_size;
+    s->tail = tail;
+
+    fz_stream* stm = fz_new_stream(ctx, s, sidecarNext, sidecarDropStream);
+    stm->seek = sidecarSeek;
+    return stm;
+}
+
+static void sidecarClose(fz_context* ctx, Sidecar* car) {
+    pdf_drop_document(ctx, car->doc);
+    free(car->pages);
+    memset(car, 0, sizeof(*car));
+}
+
+// Opens in_path through its sidecar. Returns false when there is none or it
+// no longer matches the file; only a broken sidecar or document throws.
+static bool sidecarOpen(fz_context* ctx, const char* in_path, Sidecar* car) {
+    char path[1024];
+    uint64_t size, mtime, car_size, car_mtime;
+    fz_buffer* buf = NULL;
+    fz_buffer* tail = NULL;
+    fz_stream* stm = NULL;
+    bool found = false;
+
+    fz_var(buf);
+    fz_var(tail);
+    fz_var(stm);
+    fz_var(found);
+
+    memset(car, 0, sizeof(*car));
+    sidecarPath(path, sizeof(path), in_path);
+    if (!fsutilStat(path, &car_mtime, &car_size)) return false;
+    if (!fsutilStat(in_path, &mtime, &size)) return false;
+
+    fz_try(ctx) {
+        buf = fz_read_file(ctx, path);
+        fz_terminate_buffer(ctx, buf);
+        unsigned char* data;
+        size_t len = fz_buffer_storage(ctx, buf, &data);
+        const char* p = (const char*)data;
+        const char* end = p + len;
+        char* next;
+
+        size_t magic_len = strlen(SIDECAR_MAGIC);
+        if (len < magic_len || memcmp(p, SIDECAR_MAGIC, magic_len) != 0)
+            fz_throw(ctx, FZ_ERROR_FORMAT, "%s is not a sidecar", path);
+
+        uint64_t want_size = strtoull(p + magic_len, &next, 10);
+        uint64_t want_mtime = strtoull(next, &next, 10);
+        uint64_t want_head = strtoull(next, &next, 16);
+        uint64_t want_tail = strtoull(next, &next, 16);
+        long page_count = strtol(next, &next, 10);
+        if (*next != '\n' || page_count < 0 || (end - next - 1) / 4 < page_count)
+            fz_throw(ctx, FZ_ERROR_FORMAT, "broken sidecar %s", path);
+        const unsigned char* q = (const unsigned char*)next + 1;
+
+        // size and mtime first, so a stale sidecar costs no reads
+        if (want_size == size && want_mtime == mtime) {
+            uint64_t head, tail_hash;
+            sidecarFingerprint(ctx, in_path, size, &head, &tail_hash);
+            found = head == want_head && tail_hash == want_tail;
+        }
+
+        if (found) {
+            car->pages = malloc(sizeof(int) * (page_count ? page_count : 1));
+            if (!car->pages) fz_throw(ctx, FZ_ERROR_GENERIC, "out of memory");
+            for (long i = 0; i < page_count; ++i, q += 4)
+                car->pages[i] = (int)((uint32_t)q[0] | (uint32_t)q[1] << 8 |
+                                      (uint32_t)q[2] << 16 | (uint32_t)q[3] << 24);
+            car->page_count = (int)page_count;
+
+            long xref_len = strtol((const char*)q, &next, 10);
+            if (*next != '\n' || xref_len <= 0 || end - next - 1 != xref_len)
+                fz_throw(ctx, FZ_ERROR_FORMAT, "broken sidecar %s", path);
+            tail = fz_new_buffer_from_copied_data(ctx, (const unsigned char*)next + 1,
+                                                  (size_t)xref_len);
+
+            fz_stream* file = fz_open_file(ctx, in_path);
+            fz_buffer* owned = tail;
+            tail = NULL;
+            stm = sidecarOpenStream(ctx, file, (int64_t)size, owned);
+            car->doc = pdf_open_document_with_stream(ctx, stm);
+        } else {
+            fz_warn(ctx, "ignoring stale sidecar %s", path);
+        }
+    }
+    fz_always(ctx) {
+        fz_drop_stream(ctx, stm);
+        fz_drop_buffer(ctx, tail);
+        fz_drop_buffer(ctx, buf);
+    }
+    fz_catch(ctx) {
+        sidecarClose(ctx, car);
+        fz_rethrow(ctx);
+    }
+
+    return found;
+}
+
+#endif // _SIDECAR
@@ -0,0 +1,190 @@
+#ifndef _SUBPDF
+#define _SUBPDF
+
+// Page ranges and page copying shared by the CLI and libpdfutils.
+
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if __STDC_VERSION__ < 202311L // on c23, bool is introduced
+#include <stdbool.h>
+#endif
+
+#include <mupdf/fitz.h>
+#include <mupdf/pdf.h>
+
+#include "cefer.h"
+
+// ex: 3-5,8,10-12
+static const int* subpdfParseRange(const char* range_str, int page_count, int* count) {
+    int cap = 32, n = 0;
+    int* output = malloc(sizeof(int) * cap);
+    bool cleanup = false;
+    DEFER_IF(&cleanup, free, output);
+
+    if (!output) return NULL;
+
+    const char* ptr = range_str;
+
+    while (*ptr) {
+        while (isspace((unsigned char)*ptr) || *ptr == ',') ++ptr;
+        if (!*ptr) break;
+
+        char* end_ptr;
+        long start = strtol(ptr, &end_ptr, 10);
+        if (end_ptr == ptr || start <= 0 || start > page_count) {
+            cleanup = true;
+            return NULL;
+        }
+
+        ptr = end_ptr;
+        long end = start;
+        if (*ptr == '-') {
+            end = strtol(++ptr, &end_ptr, 10);
+            if (end_ptr == ptr || end <= 0 || end < start || end > page_count) {
+                cleanup = true;
+                return NULL;
+            }
+            ptr = end_ptr;
+        }
+
+        for (long k = start; k <= end; ++k) {
+            if (n == cap) {
+                // the deferred free must see the live block
+                int* grown = realloc(output, sizeof(int) * (cap <<= 1));
+                if (!grown) {
+                    cleanup = true;
+                    return NULL;
+                }
+                output = grown;
+            }
+            output[n++] = (int)k - 1;
+        }
+    }
+
+    *count = n;
+    return output;
+}
+
+// The page keys an extracted page keeps, as pdf_graft_page copies them; the
+// first SUBPDF_INHERITED may come from an ancestor in the page tree.
+#define SUBPDF_PAGE_KEYS 9
+#define SUBPDF_INHERITED 4
+static void subpdfPageKeys(pdf_obj* keys[SUBPDF_PAGE_KEYS]) {
+    pdf_obj* all[SUBPDF_PAGE_KEYS] = {
+        PDF_NAME(Resources), PDF_NAME(MediaBox), PDF_NAME(CropBox), PDF_NAME(Rotate),
+        PDF_NAME(Contents), PDF_NAME(BleedBox), PDF_NAME(TrimBox), PDF_NAME(ArtBox),
+        PDF_NAME(UserUnit),
+    };
+    memcpy(keys, all, sizeof(all));
+}
+
+// Copies the page object src_page into dst the way pdf_graft_page does, but
+// from its object number and through a caller-owned graft map, so shared
+// resources are copied once per output document.
+static void subpdfGraftPage(fz_context* ctx, pdf_graft_map* map, pdf_document* dst,
+                            pdf_document* src, int src_page) {
+    pdf_obj* page = NULL;
+    pdf_obj* copy = NULL;
+    pdf_obj* ref = NULL;
+
+    fz_var(page);
+    fz_var(copy);
+    fz_var(ref);
+
+    fz_try(ctx) {
+        page = pdf_load_object(ctx, src, src_page);
+        copy = pdf_new_dict(ctx, dst, 4);
+        pdf_dict_put(ctx, copy, PDF_NAME(Type), PDF_NAME(Page));
+
+        pdf_obj* keys[SUBPDF_PAGE_KEYS];
+        subpdfPageKeys(keys);
+        for (int i = 0; i < SUBPDF_PAGE_KEYS; ++i) {
+            pdf_obj* val = i < SUBPDF_INHERITED ? pdf_dict_get_inheritable(ctx, page, keys[i])
+                                                : pdf_dict_get(ctx, page, keys[i]);
+            if (val) pdf_dict_put_drop(ctx, copy, keys[i], pdf_graft_mapped_object(ctx, map, val));
+        }
+
+        ref = pdf_add_object(ctx, dst, copy);
+        pdf_insert_page(ctx, dst, -1, ref);
+    }
+    fz_always(ctx) {
+        pdf_drop_obj(ctx, ref);
+        pdf_drop_obj(ctx, copy);
+        pdf_drop_obj(ctx, page);
+    }
+    fz_catch(ctx) {
+        fz_rethrow(ctx);
+    }
+}
+
+// Object number of page page_no, found by descending the page tree with
+// /Count, so only the nodes on the path and their direct kids are loaded.
+static int subpdfFindPage(fz_context* ctx, pdf_document* doc, int page_no) {
+    pdf_obj* node = pdf_dict_get(ctx, pdf_dict_get(ctx, pdf_trailer(ctx, doc), PDF_NAME(Root)),
+                                 PDF_NAME(Pages));
+
+    // a malformed tree could loop; real ones are a few levels deep
+    for (int depth = 0; depth < 64; ++depth) {
+        pdf_obj* kids = pdf_dict_get(ctx, node, PDF_NAME(Kids));
+        int n = pdf_array_len(ctx, kids);
+        pdf_obj* next = NULL;
+
+        for (int i = 0; i < n && !next; ++i) {
+            pdf_obj* kid = pdf_array_get(ctx, kids, i);
+            if (pdf_name_eq(ctx, pdf_dict_get(ctx, kid, PDF_NAME(Type)), PDF_NAME(Pages))) {
+                int count = pdf_to_int(ctx, pdf_dict_get(ctx, kid, PDF_NAME(Count)));
+                if (page_no < count) next = kid;
+                else page_no -= count;
+            } else if (page_no == 0) {
+                if (!pdf_is_indirect(ctx, kid))
+                    fz_throw(ctx, FZ_ERROR_FORMAT, "page is not an indirect object");
+                return pdf_to_num(ctx, kid);
+            } else {
+                --page_no;
+            }
+        }
+        if (!next) break;
+        node = next;
+    }
+    fz_throw(ctx, FZ_ERROR_FORMAT, "cannot find page in the page tree");
+}
+
+// A new document holding pages idx of src, in order. pages, when not NULL,
+// maps each page index to its object number (as a sidecar stores it).
+// Sparse: only the page-tree path to each selected leaf and what the pages
+// reference are loaded, and shared resources are copied once.
+static pdf_document* subpdfExtract(fz_context* ctx, pdf_document* src, const int* pages,
+                                   const int* idx, int n_idx, bool sparse) {
+    pdf_document* dst = NULL;
+    pdf_graft_map* map = NULL;
+
+    fz_var(dst);
+    fz_var(map);
+
+    fz_try(ctx) {
+        dst = pdf_create_document(ctx);
+        if (pages || sparse) {
+            map = pdf_new_graft_map(ctx, dst);
+            for (int i = 0; i < n_idx; ++i) {
+                int num = pages ? pages[idx[i]] : subpdfFindPage(ctx, src, idx[i]);
+                subpdfGraftPage(ctx, map, dst, src, num);
+            }
+        } else {
+            for (int i = 0; i < n_idx; ++i) {
+                pdf_graft_page(ctx, dst, i, src, idx[i]);
+            }
+        }
+    }
+    fz_always(ctx) {
+        pdf_drop_graft_map(ctx, map);
+    }
+    fz_catch(ctx) {
+        pdf_drop_document(ctx, dst);
+        fz_rethrow(ctx);
+    }
+    return dst;
+}
+
+#endif // _SUBPDF
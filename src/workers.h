@@ -0,0 +1,324 @@
+#ifndef _WORKERS
+#define _WORKERS
+
+// A fixed pool of threads, each owning a clone of the main fz_context.
+// MuPDF needs lock callbacks for that, so the main context must be created
+// with workersLocks().
+
+#include <stdlib.h>
+#include <string.h>
+
+#if __STDC_VERSION__ < 202311L // on c23, bool is introduced
+#include <stdbool.h>
+#endif
+
+#include <mupdf/fitz.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+typedef SRWLOCK WorkersMutex;
+typedef CONDITION_VARIABLE WorkersCond;
+typedef HANDLE WorkersThread;
+#else
+#include <pthread.h>
+#include <unistd.h>
+typedef pthread_mutex_t WorkersMutex;
+typedef pthread_cond_t WorkersCond;
+typedef pthread_t WorkersThread;
+#endif
+
+static inline void workersMutexInit(WorkersMutex* m) {
+#ifdef _WIN32
+    InitializeSRWLock(m);
+#else
+    pthread_mutex_init(m, NULL);
+#endif
+}
+
+static inline void workersMutexDeinit(WorkersMutex* m) {
+#ifdef _WIN32
+    (void)m;
+#else
+    pthread_mutex_destroy(m);
+#endif
+}
+
+static inline void workersLock(WorkersMutex* m) {
+#ifdef _WIN32
+    AcquireSRWLockExclusive(m);
+#else
+    pthread_mutex_lock(m);
+#endif
+}
+
+static inline void workersUnlock(WorkersMutex* m) {
+#ifdef _WIN32
+    ReleaseSRWLockExclusive(m);
+#else
+    pthread_mutex_unlock(m);
+#endif
+}
+
+static inline void workersCondInit(WorkersCond* c) {
+#ifdef _WIN32
+    InitializeConditionVariable(c);
+#else
+    pthread_cond_init(c, NULL);
+#endif
+}
+
+static inline void workersCondDeinit(WorkersCond* c) {
+#ifdef _WIN32
+    (void)c;
+#else
+    pthread_cond_destroy(c);
+#endif
+}
+
+static inline void workersCondWait(WorkersCond* c, WorkersMutex* m) {
+#ifdef _WIN32
+    SleepConditionVariableSRW(c, m, INFINITE, 0);
+#else
+    pthread_cond_wait(c, m);
+#endif
+}
+
+static inline void workersCondBroadcast(WorkersCond* c) {
+#ifdef _WIN32
+    WakeAllConditionVariable(c);
+#else
+    pthread_cond_broadcast(c);
+#endif
+}
+
+static inline int workersDefaultCount(void) {
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return (int)info.dwNumberOfProcessors;
+#else
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (int)n : 1;
+#endif
+}
+
+/***************/
+/* MuPDF locks */
+/***************/
+static WorkersMutex workers_fz_mutexes[FZ_LOCK_MAX];
+
+static void workersFzLock(void* user, int lock) {
+    workersLock(&((WorkersMutex*)user)[lock]);
+}
+
+static void workersFzUnlock(void* user, int lock) {
+    workersUnlock(&((WorkersMutex*)user)[lock]);
+}
+
+// pass this to fz_new_context before any fz_clone_context
+static const fz_locks_context* workersLocks(void) {
+    static fz_locks_context locks;
+    if (!locks.lock) {
+        for (int i = 0; i < FZ_LOCK_MAX; ++i) workersMutexInit(&workers_fz_mutexes[i]);
+        locks.user = workers_fz_mutexes;
+        locks.lock = workersFzLock;
+        locks.unlock = workersFzUnlock;
+    }
+    return &locks;
+}
+
+/********/
+/* Pool */
+/********/
+// A job runs on one worker with that worker's context and its private
+// `local` slot (NULL at start), where a job can keep state such as an open
+// document for the next job on the same thread. It must catch its own fz
+// errors; the pool only reports completion through `done`.
+typedef void (*WorkersFn)(fz_context* ctx, void** local, void* arg);
+
+// releases a worker's local slot at workersDeinit
+typedef void (*WorkersDropFn)(fz_context* ctx, void* local);
+
+typedef struct {
+    WorkersFn fn;
+    void* arg;
+    bool* done;
+} WorkersTask;
+
+typedef struct {
+    WorkersMutex mutex;
+    WorkersCond has_task;
+    WorkersCond has_room;
+    WorkersCond task_done;
+    WorkersThread* threads;
+    fz_context** ctxs;
+    void** locals;
+    WorkersDropFn drop_local;
+    int count;
+    WorkersTask* queue;
+    size_t queue_cap;
+    size_t queue_head;
+    size_t queue_len;
+    bool quit;
+} Workers;
+
+typedef struct {
+    Workers* pool;
+    fz_context* ctx;
+    void** local;
+} WorkersStart;
+
+static void workersLoop(Workers* pool, fz_context* ctx, void** local) {
+    for (;;) {
+        workersLock(&pool->mutex);
+        while (!pool->quit && pool->queue_len == 0)
+            workersCondWait(&pool->has_task, &pool->mutex);
+        if (pool->queue_len == 0) {
+            workersUnlock(&pool->mutex);
+            return;
+        }
+        WorkersTask task = pool->queue[pool->queue_head];
+        pool->queue_head = (pool->queue_head + 1) % pool->queue_cap;
+        --pool->queue_len;
+        workersCondBroadcast(&pool->has_room);
+        workersUnlock(&pool->mutex);
+
+        task.fn(ctx, local, task.arg);
+
+        workersLock(&pool->mutex);
+        if (task.done) *task.done = true;
+        workersCondBroadcast(&pool->task_done);
+        workersUnlock(&pool->mutex);
+    }
+}
+
+#ifdef _WIN32
+static DWORD WINAPI workersMain(LPVOID arg) {
+    WorkersStart* start = arg;
+    workersLoop(start->pool, start->ctx, start->local);
+    free(start);
+    return 0;
+}
+#else
+static void* workersMain(void* arg) {
+    WorkersStart* start = arg;
+    workersLoop(start->pool, start->ctx, start->local);
+    free(start);
+    return NULL;
+}
+#endif
+
+static void workersDeinit(Workers* pool);
+
+// Starts `count` workers with clones of ctx; queue_cap bounds pending tasks.
+// drop_local may be NULL if no job uses the local slot.
+static bool workersInit(Workers* pool, fz_context* ctx, int count, size_t queue_cap,
+                        WorkersDropFn drop_local) {
+    memset(pool, 0, sizeof(*pool));
+    if (count < 1) count = 1;
+    if (queue_cap < 1) queue_cap = 1;
+
+    workersMutexInit(&pool->mutex);
+    workersCondInit(&pool->has_task);
+    workersCondInit(&pool->has_room);
+    workersCondInit(&pool->task_done);
+    pool->queue = calloc(queue_cap, sizeof(WorkersTask));
+    pool->queue_cap = queue_cap;
+    pool->threads = calloc(count, sizeof(WorkersThread));
+    pool->ctxs = calloc(count, sizeof(fz_context*));
+    pool->locals = calloc(count, sizeof(void*));
+    pool->drop_local = drop_local;
+    if (!pool->queue || !pool->threads || !pool->ctxs || !pool->locals) {
+        workersDeinit(pool);
+        return false;
+    }
+
+    for (int i = 0; i < count; ++i) {
+        WorkersStart* start = malloc(sizeof(WorkersStart));
+        fz_context* clone = start ? fz_clone_context(ctx) : NULL;
+        if (!clone) {
+            free(start);
+            workersDeinit(pool);
+            return false;
+        }
+        start->pool = pool;
+        start->ctx = clone;
+        start->local = &pool->locals[i];
+
+#ifdef _WIN32
+        HANDLE thread = CreateThread(NULL, 0, workersMain, start, 0, NULL);
+        bool started = thread != NULL;
+#else
+        pthread_t thread;
+        bool started = pthread_create(&thread, NULL, workersMain, start) == 0;
+#endif
+        if (!started) {
+            fz_drop_context(clone);
+            free(start);
+            workersDeinit(pool);
+            return false;
+        }
+        pool->threads[pool->count] = thread;
+        pool->ctxs[pool->count] = clone;
+        ++pool->count;
+    }
+
+    return true;
+}
+
+// queues a task, blocking while the queue is full
+static void workersSubmit(Workers* pool, WorkersFn fn, void* arg, bool* done) {
+    workersLock(&pool->mutex);
+    if (done) *done = false;
+    while (pool->queue_len == pool->queue_cap)
+        workersCondWait(&pool->has_room, &pool->mutex);
+    size_t tail = (pool->queue_head + pool->queue_len) % pool->queue_cap;
+    pool->queue[tail] = (WorkersTask){ .fn = fn, .arg = arg, .done = done };
+    ++pool->queue_len;
+    workersCondBroadcast(&pool->has_task);
+    workersUnlock(&pool->mutex);
+}
+
+// waits until the task submitted with this flag has finished
+static void workersWait(Workers* pool, bool* done) {
+    workersLock(&pool->mutex);
+    while (!*done) workersCondWait(&pool->task_done, &pool->mutex);
+    workersUnlock(&pool->mutex);
+}
+
+// finishes the queued tasks, then joins the threads
+static void workersDeinit(Workers* pool) {
+    if (!pool->queue_cap) return; // never initialized
+
+    if (pool->threads) {
+        workersLock(&pool->mutex);
+        pool->quit = true;
+        workersCondBroadcast(&pool->has_task);
+        workersUnlock(&pool->mutex);
+
+        for (int i = 0; i < pool->count; ++i) {
+#ifdef _WIN32
+            WaitForSingleObject(pool->threads[i], INFINITE);
+            CloseHandle(pool->threads[i]);
+#else
+            pthread_join(pool->threads[i], NULL);
+#endif
+            if (pool->drop_local && pool->locals[i])
+                pool->drop_local(pool->ctxs[i], pool->locals[i]);
+            fz_drop_context(pool->ctxs[i]);
+        }
+    }
+
+    free(pool->threads);
+    free(pool->ctxs);
+    free(pool->locals);
+    free(pool->queue);
+    workersCondDeinit(&pool->task_done);
+    workersCondDeinit(&pool->has_room);
+    workersCondDeinit(&pool->has_task);
+    workersMutexDeinit(&pool->mutex);
+    memset(pool, 0, sizeof(*pool));
+}
+
+#endif // _WORKERS
@@ -0,0 +1,173 @@
+#ifndef _XREF
+#define _XREF
+
+// Reads single objects of a classic (table) xref PDF straight from the file.
+// pdf_open_document parses every xref entry and checks the document before
+// anything can be asked; this reader only records where each subsection
+// starts and seeks to the one entry it needs. It understands exactly the
+// well-formed case: xref streams, hybrid files and tables whose entries are
+// not 20 bytes throw, and the caller falls back to a full open.
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <mupdf/fitz.h>
+#include <mupdf/pdf.h>
+
+#define XREF_MAX_SUBSECTIONS 1024
+#define XREF_MAX_SECTIONS 32
+#define XREF_ENTRY_SIZE 20
+
+typedef struct {
+    int start;
+    int count;
+    int64_t pos;
+} XrefSub;
+
+typedef struct {
+    fz_stream* stm;
+    pdf_document* scratch; // owner of the parsed objects, never saved
+    pdf_lexbuf lexbuf;
+    bool has_lexbuf;
+    pdf_obj* trailer; // of the newest section
+    XrefSub subs[XREF_MAX_SUBSECTIONS]; // newest section first
+    int n_subs;
+} XrefReader;
+
+static int64_t xrefStartOffset(fz_context* ctx, fz_stream* stm) {
+    unsigned char buf[1024];
+
+    fz_seek(ctx, stm, 0, SEEK_END);
+    int64_t size = fz_tell(ctx, stm);
+    int64_t from = size > (int64_t)sizeof(buf) ? size - (int64_t)sizeof(buf) : 0;
+    fz_seek(ctx, stm, from, SEEK_SET);
+    size_t n = fz_read(ctx, stm, buf, (size_t)(size - from));
+
+    for (size_t i = n >= 9 ? n - 9 + 1 : 0; i-- > 0;) {
+        if (memcmp(buf + i, "startxref", 9) != 0) continue;
+
+        size_t j = i + 9;
+        while (j < n && (buf[j] == ' ' || buf[j] == '\r' || buf[j] == '\n' || buf[j] == '\t'))
+            ++j;
+        int64_t ofs = 0;
+        size_t digits = 0;
+        for (; j < n && buf[j] >= '0' && buf[j] <= '9' && digits < 18; ++j, ++digits)
+            ofs = ofs * 10 + (buf[j] - '0');
+        if (digits == 0 || ofs >= size) break;
+        return ofs;
+    }
+    fz_throw(ctx, FZ_ERROR_FORMAT, "cannot find startxref");
+}
+
+// reads the table at ofs and returns its trailer
+static pdf_obj* xrefReadSection(fz_context* ctx, XrefReader* x, int64_t ofs) {
+    char line[64];
+
+    fz_seek(ctx, x->stm, ofs, SEEK_SET);
+    fz_skip_space(ctx, x->stm);
+    if (fz_skip_string(ctx, x->stm, "xref"))
+        fz_throw(ctx, FZ_ERROR_FORMAT, "not a classic xref table");
+    fz_skip_space(ctx, x->stm);
+
+    for (;;) {
+        int c = fz_peek_byte(ctx, x->stm);
+        if (c < '0' || c > '9') break;
+
+        fz_read_line(ctx, x->stm, line, sizeof(line));
+        char* s = line;
+        long start = strtol(s, &s, 10);
+        long count = strtol(s, &s, 10);
+        if (start < 0 || count < 0 || start > INT32_MAX - count)
+            fz_throw(ctx, FZ_ERROR_FORMAT, "bad xref subsection");
+        if (x->n_subs == XREF_MAX_SUBSECTIONS)
+            fz_throw(ctx, FZ_ERROR_FORMAT, "too many xref subsections");
+
+        x->subs[x->n_subs++] = (XrefSub){
+            .start = (int)start, .count = (int)count, .pos = fz_tell(ctx, x->stm)
+        };
+        fz_seek(ctx, x->stm, (int64_t)count * XREF_ENTRY_SIZE, SEEK_CUR);
+        fz_skip_space(ctx, x->stm);
+    }
+
+    // lands anywhere else if the entries are not exactly 20 bytes
+    if (pdf_lex(ctx, x->stm, &x->lexbuf) != PDF_TOK_TRAILER ||
+        pdf_lex(ctx, x->stm, &x->lexbuf) != PDF_TOK_OPEN_DICT)
+        fz_throw(ctx, FZ_ERROR_FORMAT, "cannot find trailer");
+    return pdf_parse_dict(ctx, x->scratch, x->stm, &x->lexbuf);
+}
+
+// Reads the newest table and every /Prev before it. stm and scratch stay
+// owned by the caller and must outlive the reader.
+static void xrefOpen(fz_context* ctx, XrefReader* x, fz_stream* stm, pdf_document* scratch) {
+    x->stm = stm;
+    x->scratch = scratch;
+    x->trailer = NULL;
+    x->n_subs = 0;
+    pdf_lexbuf_init(ctx, &x->lexbuf, PDF_LEXBUF_SMALL);
+    x->has_lexbuf = true;
+
+    int64_t ofs = xrefStartOffset(ctx, stm);
+    for (int i = 0;; ++i) {
+        pdf_obj* trailer = xrefReadSection(ctx, x, ofs);
+        if (!x->trailer) x->trailer = trailer;
+
+        bool hybrid = pdf_dict_get(ctx, trailer, PDF_NAME(XRefStm)) != NULL;
+        pdf_obj* prev = pdf_dict_get(ctx, trailer, PDF_NAME(Prev));
+        int64_t next = pdf_is_int(ctx, prev) ? pdf_to_int64(ctx, prev) : -1;
+        if (trailer != x->trailer) pdf_drop_obj(ctx, trailer);
+
+        if (hybrid) fz_throw(ctx, FZ_ERROR_FORMAT, "hybrid xref");
+        if (next < 0) break;
+        if (i + 1 == XREF_MAX_SECTIONS) fz_throw(ctx, FZ_ERROR_FORMAT, "too many xref sections");
+        ofs = next;
+    }
+}
+
+static void xrefClose(fz_context* ctx, XrefReader* x) {
+    pdf_drop_obj(ctx, x->trailer);
+    x->trailer = NULL;
+    if (x->has_lexbuf) pdf_lexbuf_fin(ctx, &x->lexbuf);
+    x->has_lexbuf = false;
+}
+
+// byte offset of object num, from the newest section that lists it
+static int64_t xrefObjectOffset(fz_context* ctx, XrefReader* x, int num) {
+    for (int i = 0; i < x->n_subs; ++i) {
+        const XrefSub* sub = &x->subs[i];
+        if (num < sub->start || num - sub->start >= sub->count) continue;
+
+        unsigned char entry[XREF_ENTRY_SIZE];
+        fz_seek(ctx, x->stm, sub->pos + (int64_t)(num - sub->start) * XREF_ENTRY_SIZE,
+                SEEK_SET);
+        if (fz_read(ctx, x->stm, entry, sizeof(entry)) != sizeof(entry))
+            fz_throw(ctx, FZ_ERROR_FORMAT, "truncated xref entry");
+        if (entry[17] != 'n') fz_throw(ctx, FZ_ERROR_FORMAT, "object %d is free", num);
+
+        int64_t ofs = 0;
+        for (int k = 0; k < 10; ++k) {
+            if (entry[k] < '0' || entry[k] > '9')
+                fz_throw(ctx, FZ_ERROR_FORMAT, "bad xref entry");
+            ofs = ofs * 10 + (entry[k] - '0');
+        }
+        return ofs;
+    }
+    fz_throw(ctx, FZ_ERROR_FORMAT, "object %d is not in the xref", num);
+}
+
+// a new reference to object num; streams come back as their dictionary
+static pdf_obj* xrefLoad(fz_context* ctx, XrefReader* x, int num) {
+    fz_seek(ctx, x->stm, xrefObjectOffset(ctx, x, num), SEEK_SET);
+    if (pdf_lex(ctx, x->stm, &x->lexbuf) != PDF_TOK_INT || x->lexbuf.i != num ||
+        pdf_lex(ctx, x->stm, &x->lexbuf) != PDF_TOK_INT ||
+        pdf_lex(ctx, x->stm, &x->lexbuf) != PDF_TOK_OBJ)
+        fz_throw(ctx, FZ_ERROR_FORMAT, "object %d is not where the xref says", num);
+    return pdf_parse_stm_obj(ctx, x->scratch, x->stm, &x->lexbuf);
+}
+
+// a new reference to obj, loading it first if it is indirect
+static pdf_obj* xrefResolve(fz_context* ctx, XrefReader* x, pdf_obj* obj) {
+    if (!pdf_is_indirect(ctx, obj)) return pdf_keep_obj(ctx, obj);
+    return xrefLoad(ctx, x, pdf_to_num(ctx, obj));
+}
+
+#endif // _XREF